@@ -26,7 +26,8 @@ echo
 if [ ! -f "$DISK_IMG" ]; then
     echo "ERROR: no existe $DISK_IMG."
     echo "Crea el disco primero con:  make format-disk"
-    echo "Luego crea la partición 0x77 con fdisk y formatea (si toca) con ./tools/mesafs-format disk.img"
+    echo "Luego crea la partición con ./tools/mesafs-part disk.img (GPT; -m para MBR 0x77)"
+    echo "y formatea (si toca) con ./tools/mesafs-format disk.img"
     exit 1
 fi
 
@@ -1,328 +1,354 @@
 /**
  * @file inject-file.c
  * @brief Inyecta un archivo en MesaFS (compatible con MesaOS)
+ *
+ * Compilar: gcc -o inject-file inject-file.c mesafs.c
+ * Uso: ./inject-file [-d] <disk.img> <archivo> <ruta-destino>
+ *      ./inject-file -l <disk.img> <destino-del-enlace> <ruta-destino>
+ *      ./inject-file -H <disk.img> <ruta-existente> <ruta-destino>
+ *      ./inject-file -r <disk.img> <ruta>
+ *      programa | ./inject-file <disk.img> - <ruta-destino>
+ *
+ * Los bloques del archivo origen que son huecos (SEEK_DATA/SEEK_HOLE) no se
+ * asignan: su puntero queda a 0 y se leen como ceros. Con -l se crea un
+ * symlink; si el destino es corto va dentro del propio inodo. Con -H se
+ * crea un enlace duro: una entrada más para el inodo de un archivo que ya
+ * está en la imagen, sin copiar sus bloques. Con -r se borra una entrada:
+ * los bloques solo se liberan al quitar el último nombre del inodo.
+ *
+ * Los bloques físicamente contiguos se escriben en una sola petición. Con
+ * -d la imagen se abre con O_DIRECT para no llenar la page cache con datos
+ * que no se vuelven a leer al construir imágenes grandes.
+ *
+ * Si el origen es "-" (la entrada estándar) o una tubería, el tamaño no se
+ * conoce de antemano: se escribe con mesafs_stream_*, que asigna los
+ * bloques en reservas contiguas a medida que llenan la ventana, y el
+ * archivo queda tan seguido como uno de tamaño conocido.
+ *
+ * Varios inject-file pueden escribir a la vez en la misma imagen: solo la
+ * reserva de bloques y la creación del inodo y la entrada se serializan.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mesafs.h"
 
-#define SECTOR_SIZE             512
-#define MESAFS_MAGIC            0x4D455341  /* "MESA" */
-#define MESAFS_BLOCK_SIZE       4096
-#define MESAFS_TYPE_FILE        1
-#define MESAFS_TYPE_DIR         2
-#define MESAFS_FLAG_USED        0x01
-#define MESAFS_MAX_FILENAME     56
-#define MESAFS_DIRECT_BLOCKS    10
+#define READ_CHUNK  (64 * 1024)         /* Lecturas de una tubería */
 
-#define MESAFS_BLOCK_BITMAP_BLOCK   0
-#define MESAFS_INODE_BITMAP_BLOCK   1
-#define MESAFS_INODE_TABLE_START    2
-#define MESAFS_DATA_START           10
-
-/* Superbloque */
-typedef struct {
-    uint32_t magic;
-    uint32_t version;
-    uint32_t block_size;
-    uint32_t total_blocks;
-    uint32_t free_blocks;
-    uint32_t total_inodes;
-    uint32_t free_inodes;
-    uint32_t root_inode;
-    uint32_t first_data_block;
-    uint8_t  reserved[476];
-} __attribute__((packed)) mesafs_superblock_t;
-
-/* Inodo (128 bytes) */
-typedef struct {
-    uint32_t inode_num;
-    uint8_t  type;
-    uint8_t  flags;
-    uint16_t links;
-    uint32_t size;
-    uint32_t blocks_used;
-    uint32_t direct_blocks[MESAFS_DIRECT_BLOCKS];
-    uint32_t indirect_block;
-    uint64_t created;
-    uint64_t modified;
-    uint8_t  reserved[36];
-} __attribute__((packed)) mesafs_inode_t;
-
-/* Entrada de directorio (64 bytes) */
-typedef struct {
-    uint32_t inode;
-    uint8_t  type;
-    uint8_t  name_len;
-    char     name[58];
-} __attribute__((packed)) mesafs_dirent_t;
-
-static FILE *disk_fp = NULL;
-static uint32_t part_offset = 0;
-
-static void bitmap_set(uint8_t *bitmap, uint32_t bit) {
-    bitmap[bit / 8] |= (1 << (bit % 8));
-}
-
-static int bitmap_test(uint8_t *bitmap, uint32_t bit) {
-    return (bitmap[bit / 8] & (1 << (bit % 8))) != 0;
+/**
+ * Marca en has_data los bloques lógicos que contienen datos. Si el sistema
+ * de archivos no informa de huecos, todos cuentan como datos.
+ */
+static void find_data_blocks(int fd, off_t size, uint8_t *has_data, uint32_t nblocks) {
+    off_t off = 0;
+    while (off < size) {
+        off_t data = lseek(fd, off, SEEK_DATA);
+        if (data < 0) {
+            if (errno != ENXIO)
+                memset(has_data, 1, nblocks);
+            return;
+        }
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        if (hole < 0 || hole > size)
+            hole = size;
+        for (off_t b = data >> MESAFS_BLOCK_SHIFT; b < nblocks && mesafs_block_offset(b) < (uint64_t)hole; b++)
+            has_data[b] = 1;
+        off = hole;
+    }
 }
 
-static int read_block(uint32_t block_num, void *buf) {
-    fseek(disk_fp, part_offset + block_num * MESAFS_BLOCK_SIZE, SEEK_SET);
-    return fread(buf, 1, MESAFS_BLOCK_SIZE, disk_fp) == MESAFS_BLOCK_SIZE ? 0 : -1;
-}
+/* Copia src, de tamaño desconocido, al archivo name de la imagen */
+static int inject_stream(mesafs_t *fs, int src, const char *name) {
+    mesafs_stream_t *s = malloc(sizeof(*s));
+    uint8_t *buf = malloc(READ_CHUNK);
+    if (!s || !buf) {
+        perror("malloc");
+        free(s);
+        free(buf);
+        return -1;
+    }
+    int ino = -1;
+    if (mesafs_stream_open(fs, s) == 0) {
+        ssize_t n;
+        while ((n = read(src, buf, READ_CHUNK)) > 0 && mesafs_stream_write(s, buf, n) == 0)
+            ;
+        if (n < 0)
+            perror("read source");
+        if (n == 0)
+            ino = mesafs_stream_close(s, name);
+        else
+            mesafs_stream_abort(s);
+    }
+    free(buf);
+    if (ino < 0) {
+        printf("Failed to create %s\n", name);
+        free(s);
+        return -1;
+    }
 
-static int write_block(uint32_t block_num, const void *buf) {
-    fseek(disk_fp, part_offset + block_num * MESAFS_BLOCK_SIZE, SEEK_SET);
-    return fwrite(buf, 1, MESAFS_BLOCK_SIZE, disk_fp) == MESAFS_BLOCK_SIZE ? 0 : -1;
+    uint32_t extents = s->nblocks > 0;
+    for (uint32_t i = 1; i < s->nblocks; i++)
+        extents += s->blocks[i] != s->blocks[i - 1] + 1;
+    printf("\nFile injected successfully!\n");
+    printf("  Inode: %d\n", ino);
+    printf("  Blocks: %u (%u extents)\n", s->nblocks, extents);
+    printf("  Size: %llu bytes\n", (unsigned long long)s->size);
+    free(s);
+    return 0;
 }
 
 int main(int argc, char **argv) {
-    if (argc != 4) {
-        printf("Usage: %s <disk.img> <source-file> <dest-path>\n", argv[0]);
-        printf("Example: %s disk.img hello.msa /hello.msa\n", argv[0]);
-        return 1;
-    }
-    
-    const char *disk_path = argv[1];
-    const char *source_file = argv[2];
-    const char *dest_path = argv[3];
-    
-    /* Abrir disco */
-    disk_fp = fopen(disk_path, "r+b");
-    if (!disk_fp) {
-        perror("Cannot open disk");
-        return 1;
-    }
-    
-    /* Buscar partición MesaFS */
-    uint8_t mbr[512];
-    fread(mbr, 1, 512, disk_fp);
-    
-    uint32_t part_lba = 0;
-    for (int i = 0; i < 4; i++) {
-        uint8_t *entry = &mbr[446 + i * 16];
-        if (entry[4] == 0x77) {
-            part_lba = entry[8] | (entry[9] << 8) | (entry[10] << 16) | (entry[11] << 24);
-            break;
+    int symlink_mode = 0;
+    int hardlink_mode = 0;
+    int remove_mode = 0;
+    int direct = 0;
+    int bad_option = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "lHrd")) != -1) {
+        switch (opt) {
+            case 'l': symlink_mode = 1; break;
+            case 'H': hardlink_mode = 1; break;
+            case 'r': remove_mode = 1; break;
+            case 'd': direct = 1; break;
+            default: bad_option = 1; break;
         }
     }
-    
-    if (part_lba == 0) {
-        printf("No MesaFS partition found\n");
-        fclose(disk_fp);
+    if (bad_option || argc - optind != (remove_mode ? 2 : 3) ||
+        symlink_mode + hardlink_mode + remove_mode > 1) {
+        printf("Usage: %s [-d] <disk.img> <source-file> <dest-path>\n", argv[0]);
+        printf("       %s -l <disk.img> <link-target> <dest-path>\n", argv[0]);
+        printf("       %s -H <disk.img> <existing-path> <dest-path>\n", argv[0]);
+        printf("       %s -r <disk.img> <path>\n", argv[0]);
+        printf("  -d  Write with O_DIRECT (bypass the page cache)\n");
+        printf("Source \"-\" reads standard input.\n");
+        printf("Example: %s disk.img hello.msa /hello.msa\n", argv[0]);
         return 1;
     }
     
-    part_offset = part_lba * SECTOR_SIZE;
-    printf("Found MesaFS partition at LBA %u (offset %u)\n", part_lba, part_offset);
+    const char *disk_path = argv[optind];
+    const char *source_file = argv[optind + 1];
+    const char *dest_path = argv[optind + (remove_mode ? 1 : 2)];
     
-    /* Leer superblock (primeros 512 bytes del bloque 0) */
-    uint8_t block[MESAFS_BLOCK_SIZE];
-    if (read_block(0, block) != 0) {
-        printf("Failed to read superblock\n");
-        fclose(disk_fp);
+    /* Abrir disco y buscar partición MesaFS */
+    mesafs_t fs;
+    if (mesafs_open(&fs, disk_path, O_RDWR | (direct ? O_DIRECT : 0)) != 0)
         return 1;
-    }
-    
-    mesafs_superblock_t *sb = (mesafs_superblock_t *)block;
     
-    if (sb->magic != MESAFS_MAGIC) {
-        printf("Invalid MesaFS magic: 0x%08X (expected 0x%08X)\n", sb->magic, MESAFS_MAGIC);
-        fclose(disk_fp);
-        return 1;
-    }
+    printf("Found MesaFS partition at LBA %llu (offset %llu)\n", (unsigned long long)fs.part_lba,
+           (unsigned long long)fs.part_offset);
     
     printf("MesaFS: %u blocks, %u free, %u inodes, %u free\n",
-           sb->total_blocks, sb->free_blocks, sb->total_inodes, sb->free_inodes);
-    
-    /* Guardar copia del superblock para actualizar después */
-    mesafs_superblock_t sb_copy = *sb;
-    
-    /* Leer bitmaps */
-    /* Block bitmap está en bloque 0, pero superblock usa primeros 512 bytes */
-    /* Los bits de bitmap empiezan después del superblock en el mismo bloque */
-    uint8_t *block_bitmap = block;  /* Reutilizamos el bloque 0 */
-    
-    uint8_t inode_bitmap[MESAFS_BLOCK_SIZE];
-    if (read_block(MESAFS_INODE_BITMAP_BLOCK, inode_bitmap) != 0) {
-        printf("Failed to read inode bitmap\n");
-        fclose(disk_fp);
-        return 1;
+           fs.sb.total_blocks, fs.sb.free_blocks, fs.sb.total_inodes, fs.sb.free_inodes);
+    
+    if (remove_mode) {
+        const char *name = dest_path[0] == '/' ? dest_path + 1 : dest_path;
+        int ret = mesafs_unlink(&fs, name);
+        if (ret != 0)
+            printf("Failed to remove /%s\n", name);
+        else
+            printf("\nRemoved /%s (%u blocks free)\n", name, fs.sb.free_blocks);
+        mesafs_close(&fs);
+        return ret == 0 ? 0 : 1;
     }
     
-    /* Leer archivo fuente */
-    FILE *src = fopen(source_file, "rb");
-    if (!src) {
-        perror("Cannot open source file");
-        fclose(disk_fp);
-        return 1;
+    /* Enlace duro: otra entrada para un inodo que ya existe */
+    if (hardlink_mode) {
+        const char *target = source_file[0] == '/' ? source_file + 1 : source_file;
+        const char *name = dest_path[0] == '/' ? dest_path + 1 : dest_path;
+        int ret = mesafs_hardlink(&fs, target, name);
+        mesafs_close(&fs);
+        if (ret != 0)
+            return 1;
+        printf("\nHard link /%s -> /%s created successfully!\n", name, target);
+        return 0;
     }
     
-    fseek(src, 0, SEEK_END);
-    long file_size = ftell(src);
-    fseek(src, 0, SEEK_SET);
-    
-    uint8_t *file_data = malloc(file_size);
-    if (!file_data) {
-        perror("malloc");
-        fclose(src);
-        fclose(disk_fp);
-        return 1;
+    /* Abrir archivo fuente (en modo symlink, source_file es el destino del enlace) */
+    int src = -1;
+    off_t file_size;
+    if (symlink_mode) {
+        file_size = strlen(source_file);
+        if (file_size == 0 || file_size >= MESAFS_BLOCK_SIZE) {
+            printf("Invalid link target length %lld\n", (long long)file_size);
+            mesafs_close(&fs);
+            return 1;
+        }
+        printf("Symlink target: %s\n", source_file);
+    } else {
+        struct stat st;
+        src = strcmp(source_file, "-") == 0 ? STDIN_FILENO : open(source_file, O_RDONLY);
+        if (src < 0 || fstat(src, &st) != 0) {
+            perror("Cannot open source file");
+            mesafs_close(&fs);
+            return 1;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            printf("Source file: %s (streamed)\n", source_file);
+            int ret = inject_stream(&fs, src, dest_path[0] == '/' ? dest_path + 1 : dest_path);
+            close(src);
+            mesafs_close(&fs);
+            return ret == 0 ? 0 : 1;
+        }
+        file_size = st.st_size;
+        printf("Source file: %s (%lld bytes)\n", source_file, (long long)file_size);
     }
-    fread(file_data, 1, file_size, src);
-    fclose(src);
-    
-    printf("Source file: %s (%ld bytes)\n", source_file, file_size);
+    int fast_symlink = symlink_mode && file_size <= (off_t)MESAFS_FAST_SYMLINK_MAX;
     
     /* Extraer nombre del archivo */
     const char *filename = dest_path;
     if (dest_path[0] == '/') filename++;
     
-    /* Calcular bloques necesarios */
-    uint32_t blocks_needed = (file_size + MESAFS_BLOCK_SIZE - 1) / MESAFS_BLOCK_SIZE;
+    /* Calcular bloques lógicos y cuáles tienen datos */
+    uint32_t blocks_needed = mesafs_blocks_for(file_size);
     if (blocks_needed == 0) blocks_needed = 1;
     
-    if (blocks_needed > MESAFS_DIRECT_BLOCKS) {
-        printf("File too large (max %d blocks = %d bytes)\n", 
-               MESAFS_DIRECT_BLOCKS, MESAFS_DIRECT_BLOCKS * MESAFS_BLOCK_SIZE);
-        free(file_data);
-        fclose(disk_fp);
+    if (file_size > (off_t)MESAFS_MAX_FILE_BLOCKS * MESAFS_BLOCK_SIZE) {
+        printf("File too large (max %u blocks = %u bytes)\n",
+               (unsigned)MESAFS_MAX_FILE_BLOCKS, (unsigned)(MESAFS_MAX_FILE_BLOCKS * MESAFS_BLOCK_SIZE));
+        if (src >= 0) close(src);
+        mesafs_close(&fs);
         return 1;
     }
     
-    /* Asignar inodo */
-    uint32_t new_inode = 0;
-    for (uint32_t i = 2; i < sb_copy.total_inodes; i++) {
-        if (!bitmap_test(inode_bitmap, i)) {
-            new_inode = i;
-            bitmap_set(inode_bitmap, i);
-            sb_copy.free_inodes--;
-            break;
+    uint8_t has_data[MESAFS_MAX_FILE_BLOCKS] = {0};
+    if (fast_symlink)
+        blocks_needed = 0;      /* El destino va en el inodo */
+    else if (symlink_mode || file_size == 0)
+        has_data[0] = 1;
+    else
+        find_data_blocks(src, file_size, has_data, blocks_needed);
+    
+    uint32_t data_count = 0;
+    uint32_t needs_indirect = 0;
+    for (uint32_t i = 0; i < blocks_needed; i++) {
+        if (has_data[i]) {
+            data_count++;
+            if (i >= MESAFS_DIRECT_BLOCKS)
+                needs_indirect = 1;
         }
     }
     
-    if (new_inode == 0) {
-        printf("No free inodes\n");
-        free(file_data);
-        fclose(disk_fp);
+    /*
+     * Reservar inodo y bloques de datos (y el indirecto si hace falta); los
+     * huecos quedan a 0. La reserva se confirma en disco enseguida, así que
+     * otros inject-file pueden escribir en la misma imagen a la vez.
+     */
+    uint32_t data_blocks[MESAFS_MAX_FILE_BLOCKS] = {0};
+    uint32_t indirect_block = 0;
+    uint32_t to_allocate = data_count + needs_indirect;
+    uint32_t allocated[MESAFS_MAX_FILE_BLOCKS + 1];
+    
+    int new_inode = mesafs_alloc(&fs, to_allocate, allocated);
+    if (new_inode < 0) {
+        if (src >= 0) close(src);
+        mesafs_close(&fs);
         return 1;
     }
     
-    printf("Allocated inode: %u\n", new_inode);
+    printf("Allocated inode: %d\n", new_inode);
     
-    /* Asignar bloques de datos */
-    uint32_t data_blocks[MESAFS_DIRECT_BLOCKS] = {0};
-    uint32_t blocks_allocated = 0;
-    
-    for (uint32_t i = MESAFS_DATA_START + 1; i < sb_copy.total_blocks && blocks_allocated < blocks_needed; i++) {
-        if (!bitmap_test(block_bitmap, i)) {
-            data_blocks[blocks_allocated] = i;
-            bitmap_set(block_bitmap, i);
-            sb_copy.free_blocks--;
-            blocks_allocated++;
-        }
+    uint32_t next = 0;
+    if (needs_indirect)
+        indirect_block = allocated[next++];
+    for (uint32_t i = 0; i < blocks_needed; i++) {
+        if (has_data[i])
+            data_blocks[i] = allocated[next++];
     }
     
-    if (blocks_allocated < blocks_needed) {
-        printf("Not enough free blocks (need %u, got %u)\n", blocks_needed, blocks_allocated);
-        free(file_data);
-        fclose(disk_fp);
+    printf("Allocated %u data blocks (%u holes)\n", data_count, blocks_needed - data_count);
+    
+    /* Escribir datos del archivo: cada tramo contiguo en disco va en una petición */
+    uint8_t *run_buf = mesafs_buffer_get(&fs);
+    if (!run_buf) {
+        perror("malloc");
+        if (src >= 0) close(src);
+        mesafs_free(&fs, new_inode, allocated, to_allocate);
+        mesafs_close(&fs);
         return 1;
     }
-    
-    printf("Allocated %u data blocks\n", blocks_allocated);
-    
-    /* Escribir datos del archivo */
-    uint32_t offset = 0;
-    for (uint32_t i = 0; i < blocks_allocated; i++) {
-        uint8_t data_block[MESAFS_BLOCK_SIZE];
-        memset(data_block, 0, MESAFS_BLOCK_SIZE);
-        
-        uint32_t chunk = (file_size - offset > MESAFS_BLOCK_SIZE) ? MESAFS_BLOCK_SIZE : (file_size - offset);
-        memcpy(data_block, file_data + offset, chunk);
+    uint32_t requests = 0;
+    for (uint32_t i = 0; i < blocks_needed; ) {
+        if (!data_blocks[i]) {
+            i++;
+            continue;
+        }
+        uint32_t run = 1;
+        while (i + run < blocks_needed && run < MESAFS_RUN_BLOCKS &&
+               data_blocks[i + run] == data_blocks[i] + run)
+            run++;
         
-        write_block(data_blocks[i], data_block);
-        offset += chunk;
-    }
-    
-    /* Crear inodo del archivo */
-    uint32_t inode_block_num = MESAFS_INODE_TABLE_START + (new_inode / 32);
-    uint32_t inode_index = new_inode % 32;
-    
-    uint8_t inode_block[MESAFS_BLOCK_SIZE];
-    read_block(inode_block_num, inode_block);
-    
-    mesafs_inode_t *inodes = (mesafs_inode_t *)inode_block;
-    memset(&inodes[inode_index], 0, sizeof(mesafs_inode_t));
-    
-    inodes[inode_index].inode_num = new_inode;
-    inodes[inode_index].type = MESAFS_TYPE_FILE;
-    inodes[inode_index].flags = MESAFS_FLAG_USED;
-    inodes[inode_index].links = 1;
-    inodes[inode_index].size = file_size;
-    inodes[inode_index].blocks_used = blocks_allocated;
-    
-    for (uint32_t i = 0; i < blocks_allocated; i++) {
-        inodes[inode_index].direct_blocks[i] = data_blocks[i];
-    }
-    
-    write_block(inode_block_num, inode_block);
-    
-    /* Leer directorio raíz */
-    /* Root inode es 1, su bloque de datos está en direct_blocks[0] */
-    uint8_t root_inode_block[MESAFS_BLOCK_SIZE];
-    read_block(MESAFS_INODE_TABLE_START, root_inode_block);
-    mesafs_inode_t *root_inodes = (mesafs_inode_t *)root_inode_block;
-    uint32_t root_dir_block = root_inodes[1].direct_blocks[0];
-    
-    printf("Root directory at block %u\n", root_dir_block);
-    
-    uint8_t dir_block[MESAFS_BLOCK_SIZE];
-    read_block(root_dir_block, dir_block);
-    
-    /* Buscar slot libre */
-    mesafs_dirent_t *entries = (mesafs_dirent_t *)dir_block;
-    int max_entries = MESAFS_BLOCK_SIZE / sizeof(mesafs_dirent_t);
-    int free_slot = -1;
-    
-    for (int i = 0; i < max_entries; i++) {
-        if (entries[i].inode == 0) {
-            free_slot = i;
-            break;
+        size_t len = (size_t)run * MESAFS_BLOCK_SIZE;
+        memset(run_buf, 0, len);
+        if (symlink_mode)
+            memcpy(run_buf, source_file, file_size);
+        else if (pread(src, run_buf, len, (off_t)mesafs_block_offset(i)) < 0) {
+            perror("read source");
+            close(src);
+            mesafs_free(&fs, new_inode, allocated, to_allocate);
+            mesafs_close(&fs);
+            return 1;
+        }
+        if (mesafs_write_run(&fs, data_blocks[i], run, run_buf) != 0) {
+            perror("write data");
+            if (src >= 0) close(src);
+            mesafs_free(&fs, new_inode, allocated, to_allocate);
+            mesafs_close(&fs);
+            return 1;
         }
+        requests++;
+        i += run;
     }
-    
-    if (free_slot < 0) {
-        printf("Root directory full\n");
-        free(file_data);
-        fclose(disk_fp);
+    mesafs_buffer_put(&fs, run_buf);
+    if (src >= 0) close(src);
+    
+    mesafs_inode_t inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.inode_num = new_inode;
+    inode.type = symlink_mode ? MESAFS_TYPE_SYMLINK : MESAFS_TYPE_FILE;
+    inode.flags = MESAFS_FLAG_USED;
+    inode.links = 1;
+    inode.size = file_size;
+    inode.blocks_used = blocks_needed;
+    inode.indirect_block = indirect_block;
+    for (uint32_t i = 0; i < blocks_needed && i < MESAFS_DIRECT_BLOCKS; i++)
+        inode.direct_blocks[i] = data_blocks[i];
+    if (fast_symlink)
+        memcpy(inode.direct_blocks, source_file, file_size);
+    
+    /* Bloque indirecto, inodo y, al final, la entrada: un solo cambio para los lectores */
+    int failed = mesafs_epoch_enter(&fs) != 0;
+    if (!failed && indirect_block) {
+        uint32_t ptrs[MESAFS_PTRS_PER_BLOCK] = {0};
+        memcpy(ptrs, data_blocks + MESAFS_DIRECT_BLOCKS,
+               (blocks_needed - MESAFS_DIRECT_BLOCKS) * sizeof(uint32_t));
+        failed = mesafs_write_block(&fs, indirect_block, ptrs) != 0;
+    }
+    if (failed || mesafs_write_inode(&fs, &inode) != 0 ||
+        mesafs_link(&fs, filename, new_inode, inode.type) != 0) {
+        printf("Failed to create %s\n", filename);
+        mesafs_free(&fs, new_inode, allocated, to_allocate);
+        mesafs_epoch_exit(&fs);
+        mesafs_close(&fs);
         return 1;
     }
+    mesafs_epoch_exit(&fs);
     
-    /* Agregar entrada */
-    entries[free_slot].inode = new_inode;
-    entries[free_slot].type = MESAFS_TYPE_FILE;
-    entries[free_slot].name_len = strlen(filename);
-    strncpy(entries[free_slot].name, filename, MESAFS_MAX_FILENAME);
-    
-    write_block(root_dir_block, dir_block);
+    int used_direct = fs.direct;
+    mesafs_close(&fs);
     
-    /* Actualizar superblock y bitmaps */
-    memcpy(block, &sb_copy, sizeof(sb_copy));
-    write_block(0, block);
-    write_block(MESAFS_INODE_BITMAP_BLOCK, inode_bitmap);
-    
-    free(file_data);
-    fclose(disk_fp);
-    
-    printf("\nFile injected successfully!\n");
-    printf("  Inode: %u\n", new_inode);
-    printf("  Blocks: %u\n", blocks_allocated);
-    printf("  Size: %ld bytes\n", file_size);
+    printf("\n%s injected successfully!\n", symlink_mode ? "Symlink" : "File");
+    printf("  Inode: %d\n", new_inode);
+    printf("  Blocks: %u (%u allocated, %u write requests%s)\n", blocks_needed, data_count,
+           requests, used_direct ? ", O_DIRECT" : "");
+    printf("  Size: %lld bytes\n", (long long)file_size);
     
     return 0;
-}
\ No newline at end of file
+}
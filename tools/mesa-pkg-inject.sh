@@ -23,7 +23,18 @@ MSA="${NAME}-${VERSION}.msa"
     "$PKG_DIR" \
     "$MSA"
 
-# 2) Inyectarlo en la imagen, dentro de /pkgs
+# 2) Comprobar que no pisa archivos de otros paquetes (índice /pkgs/owners.idx);
+#    sin msa-owner compilado se inyecta sin índice
+OWNER=./tools/msa-owner
+if [ ! -x "$OWNER" ]; then
+    echo "AVISO: falta $OWNER, no se comprueban ni registran las rutas del paquete."
+    echo "Compílalo con: cd tools && gcc -o msa-owner msa-owner.c msa.c mesafs.c"
+    OWNER=""
+fi
+[ -z "$OWNER" ] || "$OWNER" -c "$MSA" "$DISK_IMG"
+
+# 3) Inyectarlo en la imagen, dentro de /pkgs, y registrar sus rutas
 ./tools/inject-file "$DISK_IMG" "$MSA" "/pkgs/$MSA"
+[ -z "$OWNER" ] || "$OWNER" -a "$MSA" "$DISK_IMG"
 
 echo "Paquete $NAME-$VERSION inyectado en $DISK_IMG como /pkgs/$MSA"
\ No newline at end of file
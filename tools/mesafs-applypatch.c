@@ -0,0 +1,253 @@
+/**
+ * @file mesafs-applypatch.c
+ * @brief Aplica un parche de mesafs-mkpatch a una imagen MesaFS
+ *
+ * Compilar: gcc -O2 -o mesafs-applypatch mesafs-applypatch.c mesafs.c -lz
+ * Uso: ./mesafs-applypatch [-n] <disk.img> <parche.mpt>
+ *
+ * Primero se comprueba la base: superbloque y bitmaps, y el CRC de cada
+ * bloque que el parche va a sustituir. Solo si todo coincide se escriben
+ * los bloques nuevos, en orden de bloque y leyendo el parche de principio
+ * a fin; los bloques consecutivos van en una sola petición. La E/S es
+ * proporcional al cambio, no a la imagen. Con -n solo se comprueba.
+ * La escritura es un solo cambio para los lectores sin bloqueos
+ * (mesafs_epoch_enter), así que sb.generation no entra en los CRC.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "mesafs.h"
+
+/* CRC32 de un bloque; sb.generation es propia de cada imagen y cuenta como 0 */
+static uint32_t block_crc(uint32_t block, const uint8_t *data) {
+    if (block != MESAFS_BLOCK_BITMAP_BLOCK)
+        return crc32(0, data, MESAFS_BLOCK_SIZE);
+    uint8_t copy[MESAFS_BLOCK_SIZE];
+    memcpy(copy, data, MESAFS_BLOCK_SIZE);
+    memset(copy + offsetof(mesafs_superblock_t, generation), 0, sizeof(uint32_t));
+    return crc32(0, copy, MESAFS_BLOCK_SIZE);
+}
+
+/* CRC32 de los bloques 0-1: superbloque y bitmaps */
+static int metadata_crc(mesafs_t *fs, uint32_t *crc) {
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    *crc = 0;
+    for (uint32_t b = MESAFS_BLOCK_BITMAP_BLOCK; b <= MESAFS_INODE_BITMAP_BLOCK; b++) {
+        if (mesafs_read_block(fs, b, block) != 0)
+            return -1;
+        *crc = crc32_combine(*crc, block_crc(b, block), MESAFS_BLOCK_SIZE);
+    }
+    return 0;
+}
+
+/* Entradas consecutivas desde i con bloques contiguos (como mucho un tramo) */
+static uint32_t run_length(const mesafs_patch_entry_t *e, uint32_t i, uint32_t count) {
+    uint32_t run = 1;
+    while (i + run < count && run < MESAFS_RUN_BLOCKS && e[i + run].block == e[i].block + run)
+        run++;
+    return run;
+}
+
+/* Comprueba que los bloques a sustituir son los de la base */
+static int verify_base(mesafs_t *fs, const mesafs_patch_entry_t *e, uint32_t count, uint8_t *buf) {
+    for (uint32_t i = 0; i < count; ) {
+        uint32_t run = run_length(e, i, count);
+        if (mesafs_read_run(fs, e[i].block, run, buf) != 0) {
+            printf("Failed to read blocks %u-%u\n", e[i].block, e[i].block + run - 1);
+            return -1;
+        }
+        for (uint32_t k = 0; k < run; k++) {
+            if (block_crc(e[i + k].block, buf + mesafs_block_offset(k)) != e[i + k].base_crc) {
+                printf("Block %u does not match the patch base\n", e[i + k].block);
+                return -1;
+            }
+        }
+        i += run;
+    }
+    return 0;
+}
+
+/* Bloque nuevo de la entrada e en out */
+static int patch_block(int fd, const mesafs_patch_entry_t *e, uint8_t *out) {
+    if (e->stored == 0) {
+        memset(out, 0, MESAFS_BLOCK_SIZE);
+    } else if (e->stored == MESAFS_BLOCK_SIZE) {
+        if (pread(fd, out, MESAFS_BLOCK_SIZE, e->offset) != MESAFS_BLOCK_SIZE)
+            return -1;
+    } else {
+        uint8_t packed[MESAFS_BLOCK_SIZE];
+        uLongf len = MESAFS_BLOCK_SIZE;
+        if (e->stored > MESAFS_BLOCK_SIZE ||
+            pread(fd, packed, e->stored, e->offset) != (ssize_t)e->stored ||
+            uncompress(out, &len, packed, e->stored) != Z_OK || len != MESAFS_BLOCK_SIZE)
+            return -1;
+    }
+    return block_crc(e->block, out) == e->crc32 ? 0 : -1;
+}
+
+/*
+ * Escribe los bloques nuevos. El superbloque conserva la generación de la
+ * imagen: mesafs_epoch_exit la avanza al publicar el cambio.
+ */
+static int apply_blocks(mesafs_t *fs, int patch_fd, const mesafs_patch_entry_t *e, uint32_t count,
+                        uint8_t *buf) {
+    mesafs_superblock_t sb;
+    if (mesafs_read_block(fs, MESAFS_BLOCK_BITMAP_BLOCK, buf) != 0)
+        return -1;
+    memcpy(&sb, buf, sizeof(sb));
+
+    for (uint32_t i = 0; i < count; ) {
+        uint32_t run = run_length(e, i, count);
+        for (uint32_t k = 0; k < run; k++) {
+            if (patch_block(patch_fd, &e[i + k], buf + mesafs_block_offset(k)) != 0) {
+                printf("Patch data for block %u is damaged\n", e[i + k].block);
+                return -1;
+            }
+            if (e[i + k].block == MESAFS_BLOCK_BITMAP_BLOCK)
+                memcpy(buf + mesafs_block_offset(k) + offsetof(mesafs_superblock_t, generation),
+                       &sb.generation, sizeof(sb.generation));
+        }
+        if (mesafs_write_run(fs, e[i].block, run, buf) != 0) {
+            perror("write image");
+            return -1;
+        }
+        i += run;
+    }
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaFS Patch Applier v1.0\n\n");
+    printf("Usage: %s [options] <disk.img> <patch.mpt>\n\n", prog);
+    printf("Options:\n");
+    printf("  -n               Only check that the patch applies\n");
+    printf("  -h               Show this help\n");
+    printf("\nExample:\n");
+    printf("  %s disk.img update.mpt\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int dry_run = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "nh")) != -1) {
+        switch (opt) {
+            case 'n': dry_run = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 2 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *disk_path = argv[optind];
+    const char *patch_path = argv[optind + 1];
+
+    int pfd = open(patch_path, O_RDONLY);
+    if (pfd < 0) {
+        perror(patch_path);
+        return 1;
+    }
+    mesafs_patch_header_t h;
+    if (pread(pfd, &h, sizeof(h), 0) != sizeof(h) || h.magic != MESAFS_PATCH_MAGIC ||
+        h.version != MESAFS_PATCH_VERSION) {
+        printf("%s: not a MesaFS patch\n", patch_path);
+        close(pfd);
+        return 1;
+    }
+    size_t index_len = (size_t)h.num_blocks * sizeof(mesafs_patch_entry_t);
+    mesafs_patch_entry_t *entries = malloc(index_len ? index_len : 1);
+    if (!entries || pread(pfd, entries, index_len, h.index_offset) != (ssize_t)index_len ||
+        crc32(0, (const Bytef *)entries, index_len) != h.index_crc) {
+        printf("%s: block table is damaged\n", patch_path);
+        close(pfd);
+        return 1;
+    }
+    for (uint32_t i = 1; i < h.num_blocks; i++) {
+        if (entries[i].block <= entries[i - 1].block) {
+            printf("%s: block table is not sorted\n", patch_path);
+            close(pfd);
+            return 1;
+        }
+    }
+
+    mesafs_t fs;
+    if (mesafs_open(&fs, disk_path, dry_run ? O_RDONLY : O_RDWR) != 0) {
+        close(pfd);
+        return 1;
+    }
+
+    /*
+     * Mientras se aplica, nadie más escribe en el sistema de archivos, y los
+     * lectores sin bloqueos ven el cambio en curso y repiten
+     */
+    int in_epoch = !dry_run && mesafs_epoch_enter(&fs) == 0;
+    int locked = in_epoch && mesafs_lock(&fs, 0, fs.sb.total_blocks) == 0;
+    int ret = 1;
+    struct stat st;
+    uint32_t crc;
+    uint8_t *buf = mesafs_buffer_get(&fs);
+    if (!buf || (!dry_run && !locked) || fstat(fs.fd, &st) != 0 || metadata_crc(&fs, &crc) != 0) {
+        printf("Cannot prepare %s\n", disk_path);
+        goto out;
+    }
+    if ((uint64_t)st.st_size != h.image_size || fs.part_lba != h.part_lba) {
+        printf("%s does not have the layout of the patch base\n", disk_path);
+        goto out;
+    }
+    if (crc == h.target_crc && crc != h.base_crc) {
+        printf("Patch already applied to %s\n", disk_path);
+        ret = 0;
+        goto out;
+    }
+    if (crc != h.base_crc) {
+        printf("%s is not the patch base (superblock and bitmaps differ)\n", disk_path);
+        goto out;
+    }
+
+    printf("Checking %u blocks of %s...\n", h.num_blocks, disk_path);
+    if (verify_base(&fs, entries, h.num_blocks, buf) != 0)
+        goto out;
+    if (dry_run) {
+        printf("Patch applies cleanly\n");
+        ret = 0;
+        goto out;
+    }
+
+    printf("Applying %s...\n", patch_path);
+    if (apply_blocks(&fs, pfd, entries, h.num_blocks, buf) != 0 || fsync(fs.fd) != 0)
+        goto out;
+    if (metadata_crc(&fs, &crc) != 0 || crc != h.target_crc) {
+        printf("Result does not match the patch target\n");
+        goto out;
+    }
+
+    printf("\nPatch applied successfully!\n");
+    printf("  Blocks written: %u (%llu bytes)\n", h.num_blocks,
+           (unsigned long long)mesafs_block_offset(h.num_blocks));
+    ret = 0;
+out:
+    if (buf)
+        mesafs_buffer_put(&fs, buf);
+    if (locked)
+        mesafs_unlock(&fs, 0, fs.sb.total_blocks);
+    if (in_epoch && mesafs_epoch_exit(&fs) != 0)
+        ret = 1;
+    mesafs_close(&fs);
+    close(pfd);
+    free(entries);
+    return ret;
+}
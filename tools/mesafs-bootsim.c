@@ -0,0 +1,436 @@
+/**
+ * @file mesafs-bootsim.c
+ * @brief Simula las lecturas de arranque de MesaOS sobre una imagen MesaFS
+ *
+ * Compilar: gcc -O2 -o mesafs-bootsim mesafs-bootsim.c mesafs.c
+ * Uso: ./mesafs-bootsim [opciones] <disk.img> [traza]
+ *
+ * Reproduce una lista de aperturas y lecturas como lo hace el driver de
+ * MesaOS: el superbloque con disk_read_sector(partition_lba) y cada bloque
+ * con read_block, que pide 8 sectores desde partition_lba + bloque * 8, sin
+ * caché. Abrir un archivo lee el inodo raíz, los bloques del directorio
+ * hasta encontrar la entrada y el inodo del archivo; leer datos más allá de
+ * los punteros directos vuelve a leer el bloque indirecto. Se cuentan las
+ * peticiones, los sectores y los saltos de posición (seeks), y con un
+ * modelo de coste del disco se estima el tiempo de E/S del arranque.
+ *
+ * Traza: una operación por línea ('#' comenta)
+ *   open <ruta>                    abre el archivo
+ *   read <ruta> [offset [bytes]]   lee (por defecto, hasta el final)
+ *   <ruta>                         abre y lee el archivo entero
+ * Sin traza se leen enteros, en orden, todos los archivos del directorio raíz.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mesafs.h"
+
+#define SIM_MAX_FILES   256
+#define LINE_MAX_LEN    512
+
+/* ==================== Modelo de disco ==================== */
+
+typedef struct {
+    const char *name;
+    double seek_ms;             /* Coste de cada salto de posición */
+    double request_ms;          /* Coste fijo por petición (comando, interrupción) */
+    double mb_per_s;            /* Transferencia */
+} disk_model_t;
+
+static const disk_model_t models[] = {
+    { "hdd",  8.0,  0.10, 100.0 },
+    { "ssd",  0.0,  0.05, 500.0 },
+    { "pio",  8.0,  0.50,   3.3 },  /* ATA PIO modo 0, como en QEMU sin DMA */
+};
+
+/* ==================== Estado ==================== */
+
+typedef struct {
+    uint64_t requests;
+    uint64_t sectors;
+    uint64_t seeks;
+    uint64_t bytes;             /* Bytes de archivo entregados */
+} sim_stats_t;
+
+typedef struct {
+    char           name[MESAFS_MAX_FILENAME + 1];
+    mesafs_inode_t inode;
+    sim_stats_t    stats;
+} sim_file_t;
+
+typedef struct {
+    mesafs_t     fs;
+    disk_model_t model;
+    uint32_t     sectors_per_request;   /* Sectores por petición de read_block */
+    uint32_t     cache_blocks;          /* Caché LRU de bloques (0 = MesaOS) */
+    uint32_t    *cache;
+    uint64_t    *cache_used;
+    uint64_t     clock;
+    uint64_t     next_lba;              /* Sector siguiente a la última petición */
+    int          have_pos;
+    sim_stats_t  total;
+    sim_stats_t *cur;                   /* Estadísticas del archivo en curso */
+    sim_file_t   files[SIM_MAX_FILES];
+    int          num_files;
+    int          verbose;
+} sim_t;
+
+/* ==================== E/S simulada ==================== */
+
+static void add_stats(sim_t *s, uint32_t requests, uint32_t sectors, uint32_t seeks) {
+    s->total.requests += requests;
+    s->total.sectors += sectors;
+    s->total.seeks += seeks;
+    if (s->cur) {
+        s->cur->requests += requests;
+        s->cur->sectors += sectors;
+        s->cur->seeks += seeks;
+    }
+}
+
+/* Una petición de sectors sectores desde lba */
+static void sim_request(sim_t *s, uint64_t lba, uint32_t sectors) {
+    uint32_t seek = !s->have_pos || lba != s->next_lba;
+    s->have_pos = 1;
+    s->next_lba = lba + sectors;
+    add_stats(s, 1, sectors, seek);
+}
+
+/* Consulta la caché; retorna 1 si el bloque ya estaba */
+static int cache_lookup(sim_t *s, uint32_t block) {
+    if (s->cache_blocks == 0)
+        return 0;
+    uint32_t victim = 0;
+    for (uint32_t i = 0; i < s->cache_blocks; i++) {
+        if (s->cache_used[i] && s->cache[i] == block) {
+            s->cache_used[i] = ++s->clock;
+            return 1;
+        }
+        if (s->cache_used[i] < s->cache_used[victim])
+            victim = i;
+    }
+    s->cache[victim] = block;
+    s->cache_used[victim] = ++s->clock;
+    return 0;
+}
+
+/* read_block de MesaOS: 8 sectores desde partition_lba + bloque * 8 */
+static int sim_read_block(sim_t *s, uint32_t block, void *buf) {
+    if (!cache_lookup(s, block)) {
+        uint32_t per_block = MESAFS_BLOCK_SIZE / SECTOR_SIZE;
+        uint64_t lba = s->fs.part_lba + (uint64_t)block * per_block;
+        for (uint32_t done = 0; done < per_block; done += s->sectors_per_request) {
+            uint32_t n = per_block - done < s->sectors_per_request ? per_block - done
+                                                                   : s->sectors_per_request;
+            sim_request(s, lba + done, n);
+        }
+    }
+    return mesafs_read_block(&s->fs, block, buf);
+}
+
+static int sim_read_inode(sim_t *s, uint32_t ino, mesafs_inode_t *inode) {
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    if (ino >= s->fs.sb.total_inodes || sim_read_block(s, mesafs_inode_block(ino), block) != 0)
+        return -1;
+    memcpy(inode, block + mesafs_inode_slot(ino) * sizeof(mesafs_inode_t), sizeof(*inode));
+    return 0;
+}
+
+/* Puntero del bloque lógico n de un archivo (el indirecto se lee cada vez) */
+static int sim_bmap(sim_t *s, const mesafs_inode_t *inode, uint32_t n, uint32_t *block) {
+    if (n < MESAFS_DIRECT_BLOCKS) {
+        *block = inode->direct_blocks[n];
+        return 0;
+    }
+    if (n >= MESAFS_MAX_FILE_BLOCKS || inode->indirect_block == 0)
+        return -1;
+    uint32_t ptrs[MESAFS_PTRS_PER_BLOCK];
+    if (sim_read_block(s, inode->indirect_block, ptrs) != 0)
+        return -1;
+    *block = ptrs[n - MESAFS_DIRECT_BLOCKS];
+    return 0;
+}
+
+/* ==================== Operaciones ==================== */
+
+static sim_file_t *sim_open(sim_t *s, const char *path) {
+    const char *name = path[0] == '/' ? path + 1 : path;
+    for (int i = 0; i < s->num_files; i++) {
+        if (strcmp(s->files[i].name, name) == 0) {
+            s->cur = &s->files[i].stats;
+            return &s->files[i];
+        }
+    }
+    if (s->num_files >= SIM_MAX_FILES || strlen(name) > MESAFS_MAX_FILENAME) {
+        printf("Cannot open %s\n", path);
+        return NULL;
+    }
+
+    sim_file_t *f = &s->files[s->num_files];
+    memset(f, 0, sizeof(*f));
+    strcpy(f->name, name);
+    s->cur = &f->stats;
+
+    /* Inodo raíz y bloques del directorio hasta dar con la entrada */
+    mesafs_inode_t root;
+    if (sim_read_inode(s, s->fs.sb.root_inode, &root) != 0)
+        return NULL;
+    uint32_t ino = 0;
+    uint32_t nblocks = root.blocks_used < MESAFS_MAX_FILE_BLOCKS ? root.blocks_used
+                                                                 : MESAFS_MAX_FILE_BLOCKS;
+    for (uint32_t b = 0; b < nblocks && ino == 0; b++) {
+        uint32_t block;
+        uint8_t dir[MESAFS_BLOCK_SIZE];
+        if (sim_bmap(s, &root, b, &block) != 0 || block == 0 ||
+            sim_read_block(s, block, dir) != 0)
+            continue;
+        int slot = mesafs_dirent_find(dir, name, strlen(name));
+        if (slot >= 0)
+            ino = ((mesafs_dirent_t *)dir)[slot].inode;
+    }
+    if (ino == 0 || sim_read_inode(s, ino, &f->inode) != 0) {
+        printf("Not found: %s\n", path);
+        return NULL;
+    }
+    s->num_files++;
+    return f;
+}
+
+static int sim_read(sim_t *s, sim_file_t *f, uint64_t offset, uint64_t len) {
+    s->cur = &f->stats;
+    if (offset >= f->inode.size)
+        return 0;
+    if (len > f->inode.size - offset)
+        len = f->inode.size - offset;
+
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    uint64_t end = offset + len;
+    for (uint64_t n = offset >> MESAFS_BLOCK_SHIFT; mesafs_block_offset(n) < end; n++) {
+        uint32_t phys;
+        if (sim_bmap(s, &f->inode, n, &phys) != 0) {
+            printf("Bad block map in %s\n", f->name);
+            return -1;
+        }
+        if (phys != 0 && sim_read_block(s, phys, block) != 0)
+            return -1;
+    }
+    f->stats.bytes += len;
+    s->total.bytes += len;
+    return 0;
+}
+
+/* Una línea de la traza */
+static int sim_line(sim_t *s, char *line, int lineno) {
+    char *argv[4];
+    int argc = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && argc < 4; tok = strtok(NULL, " \t\r\n"))
+        argv[argc++] = tok;
+    if (argc == 0 || argv[0][0] == '#')
+        return 0;
+
+    sim_file_t *f;
+    if (strcmp(argv[0], "open") == 0 && argc == 2)
+        return sim_open(s, argv[1]) ? 0 : -1;
+    if (strcmp(argv[0], "read") == 0 && argc >= 2) {
+        if (!(f = sim_open(s, argv[1])))
+            return -1;
+        uint64_t offset = argc > 2 ? strtoull(argv[2], NULL, 0) : 0;
+        uint64_t len = argc > 3 ? strtoull(argv[3], NULL, 0) : UINT64_MAX;
+        return sim_read(s, f, offset, len);
+    }
+    if (argc == 1) {
+        if (!(f = sim_open(s, argv[0])))
+            return -1;
+        return sim_read(s, f, 0, UINT64_MAX);
+    }
+    printf("Trace line %d: unknown operation '%s'\n", lineno, argv[0]);
+    return -1;
+}
+
+/* Sin traza: todos los archivos del directorio raíz, en orden */
+static int sim_all_files(sim_t *s) {
+    mesafs_inode_t root;
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS];
+    int nblocks;
+    if (mesafs_read_inode(&s->fs, s->fs.sb.root_inode, &root) != 0 ||
+        (nblocks = mesafs_file_blocks(&s->fs, &root, blocks, MESAFS_MAX_FILE_BLOCKS)) < 0) {
+        printf("Failed to read root directory\n");
+        return -1;
+    }
+    for (int b = 0; b < nblocks; b++) {
+        uint8_t dir[MESAFS_BLOCK_SIZE];
+        if (blocks[b] == 0 || mesafs_read_block(&s->fs, blocks[b], dir) != 0)
+            continue;
+        mesafs_dirent_t *entries = (mesafs_dirent_t *)dir;
+        for (int i = mesafs_dirent_used(dir, 0); i >= 0; i = mesafs_dirent_used(dir, i + 1)) {
+            if (entries[i].type != MESAFS_TYPE_FILE)
+                continue;
+            char name[MESAFS_MAX_FILENAME + 1];
+            snprintf(name, sizeof(name), "%.*s", MESAFS_MAX_FILENAME, entries[i].name);
+            sim_file_t *f = sim_open(s, name);
+            if (!f || sim_read(s, f, 0, UINT64_MAX) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/* ==================== Informe ==================== */
+
+static double sim_time(const sim_t *s, const sim_stats_t *st, double *seek, double *req,
+                       double *xfer) {
+    *seek = st->seeks * s->model.seek_ms / 1000.0;
+    *req = st->requests * s->model.request_ms / 1000.0;
+    *xfer = st->sectors * (double)SECTOR_SIZE / (s->model.mb_per_s * 1e6);
+    return *seek + *req + *xfer;
+}
+
+static void sim_report(const sim_t *s) {
+    double seek, req, xfer;
+    if (s->verbose) {
+        printf("\n  %-40s %10s %8s %6s %9s\n", "File", "Bytes", "Requests", "Seeks", "Time (ms)");
+        for (int i = 0; i < s->num_files; i++) {
+            const sim_file_t *f = &s->files[i];
+            printf("  %-40s %10llu %8llu %6llu %9.2f\n", f->name,
+                   (unsigned long long)f->stats.bytes, (unsigned long long)f->stats.requests,
+                   (unsigned long long)f->stats.seeks,
+                   sim_time(s, &f->stats, &seek, &req, &xfer) * 1000.0);
+        }
+    }
+
+    double t = sim_time(s, &s->total, &seek, &req, &xfer);
+    printf("\nSimulation results:\n");
+    printf("  Files: %d opened, %llu bytes read\n", s->num_files,
+           (unsigned long long)s->total.bytes);
+    printf("  Requests: %llu (%llu sectors, %llu bytes from disk)\n",
+           (unsigned long long)s->total.requests, (unsigned long long)s->total.sectors,
+           (unsigned long long)s->total.sectors * SECTOR_SIZE);
+    printf("  Seeks: %llu\n", (unsigned long long)s->total.seeks);
+    if (s->total.bytes)
+        printf("  Read amplification: %.2fx\n",
+               (double)s->total.sectors * SECTOR_SIZE / s->total.bytes);
+    printf("  Estimated I/O time: %.3f s (seek %.3f, requests %.3f, transfer %.3f)\n",
+           t, seek, req, xfer);
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaFS Boot Read Simulator v1.0\n\n");
+    printf("Usage: %s [options] <disk.img> [trace]\n\n", prog);
+    printf("Options:\n");
+    printf("  -m <model>       Disk model: hdd (default), ssd or pio\n");
+    printf("  -S <ms>          Seek time\n");
+    printf("  -R <ms>          Cost per request\n");
+    printf("  -T <MB/s>        Transfer rate\n");
+    printf("  -s <sectors>     Sectors per request in read_block (default: %d)\n",
+           MESAFS_BLOCK_SIZE / SECTOR_SIZE);
+    printf("  -c <blocks>      Simulate an LRU block cache (default: none, as in MesaOS)\n");
+    printf("  -v               Per-file breakdown\n");
+    printf("  -h               Show this help\n");
+    printf("\nTrace lines: 'open <path>', 'read <path> [offset [bytes]]' or '<path>'.\n");
+    printf("Without a trace, every file in the root directory is read in order.\n");
+    printf("\nExample:\n");
+    printf("  %s -m ssd -v disk.img boot.trace\n", prog);
+}
+
+int main(int argc, char **argv) {
+    sim_t *s = calloc(1, sizeof(*s));
+    if (!s) {
+        perror("calloc");
+        return 1;
+    }
+    s->model = models[0];
+    s->sectors_per_request = MESAFS_BLOCK_SIZE / SECTOR_SIZE;
+    double seek_ms = -1, request_ms = -1, mb_per_s = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:S:R:T:s:c:vh")) != -1) {
+        switch (opt) {
+            case 'm': {
+                size_t i;
+                for (i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+                    if (strcmp(optarg, models[i].name) == 0)
+                        break;
+                }
+                if (i == sizeof(models) / sizeof(models[0])) {
+                    fprintf(stderr, "Error: unknown disk model %s\n", optarg);
+                    return 1;
+                }
+                s->model = models[i];
+                break;
+            }
+            case 'S': seek_ms = atof(optarg); break;
+            case 'R': request_ms = atof(optarg); break;
+            case 'T': mb_per_s = atof(optarg); break;
+            case 's': s->sectors_per_request = atoi(optarg); break;
+            case 'c': s->cache_blocks = atoi(optarg); break;
+            case 'v': s->verbose = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (seek_ms >= 0) s->model.seek_ms = seek_ms;
+    if (request_ms >= 0) s->model.request_ms = request_ms;
+    if (mb_per_s > 0) s->model.mb_per_s = mb_per_s;
+
+    if (optind + 1 != argc && optind + 2 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (s->sectors_per_request == 0 || s->sectors_per_request > MESAFS_BLOCK_SIZE / SECTOR_SIZE) {
+        fprintf(stderr, "Error: sectors per request must be 1-%d\n", MESAFS_BLOCK_SIZE / SECTOR_SIZE);
+        return 1;
+    }
+    if (s->cache_blocks) {
+        s->cache = calloc(s->cache_blocks, sizeof(uint32_t));
+        s->cache_used = calloc(s->cache_blocks, sizeof(uint64_t));
+        if (!s->cache || !s->cache_used) {
+            perror("calloc");
+            return 1;
+        }
+    }
+
+    const char *disk_path = argv[optind];
+    const char *trace_path = optind + 2 == argc ? argv[optind + 1] : NULL;
+    if (mesafs_open(&s->fs, disk_path, O_RDONLY) != 0)
+        return 1;
+
+    printf("Simulating boot reads on %s (%s: seek %.2f ms, %.2f ms/request, %.1f MB/s)\n",
+           disk_path, s->model.name, s->model.seek_ms, s->model.request_ms, s->model.mb_per_s);
+
+    /* Montaje: disk_read_sector(partition_lba) */
+    sim_request(s, s->fs.part_lba, 1);
+
+    int ret = 0;
+    if (trace_path) {
+        FILE *fp = fopen(trace_path, "r");
+        if (!fp) {
+            perror(trace_path);
+            mesafs_close(&s->fs);
+            return 1;
+        }
+        char line[LINE_MAX_LEN];
+        int lineno = 0;
+        while (ret == 0 && fgets(line, sizeof(line), fp))
+            ret = sim_line(s, line, ++lineno);
+        fclose(fp);
+    } else {
+        ret = sim_all_files(s);
+    }
+    mesafs_close(&s->fs);
+    if (ret != 0)
+        return 1;
+
+    sim_report(s);
+    free(s->cache);
+    free(s->cache_used);
+    free(s);
+    return 0;
+}
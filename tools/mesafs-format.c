@@ -1,6 +1,11 @@
 /**
  * @file mesafs-format.c
  * @brief Formatea una partición como MesaFS (compatible con MesaOS)
+ *
+ * Compilar: gcc -o mesafs-format mesafs-format.c mesafs.c
+ * Uso: ./mesafs-format <disk.img>
+ *
+ * La partición se busca en el MBR (tipo 0x77) o en la GPT (ver mesafs-part).
  */
 
 #include <stdio.h>
@@ -8,53 +13,7 @@
 #include <string.h>
 #include <stdint.h>
 
-#define SECTOR_SIZE             512
-#define MESAFS_MAGIC            0x4D455341  /* "MESA" - igual que MesaOS */
-#define MESAFS_VERSION          1
-#define MESAFS_BLOCK_SIZE       4096
-#define MESAFS_TYPE_DIR         2
-#define MESAFS_FLAG_USED        0x01
-
-/* Layout igual que mesafs.h */
-#define MESAFS_BLOCK_BITMAP_BLOCK   0
-#define MESAFS_INODE_BITMAP_BLOCK   1
-#define MESAFS_INODE_TABLE_START    2
-#define MESAFS_INODE_TABLE_BLOCKS   8
-#define MESAFS_DATA_START           10
-#define MESAFS_DIRECT_BLOCKS        10
-
-/* Superbloque (512 bytes, igual que MesaOS) */
-typedef struct {
-    uint32_t magic;
-    uint32_t version;
-    uint32_t block_size;
-    uint32_t total_blocks;
-    uint32_t free_blocks;
-    uint32_t total_inodes;
-    uint32_t free_inodes;
-    uint32_t root_inode;
-    uint32_t first_data_block;
-    uint8_t  reserved[476];
-} __attribute__((packed)) mesafs_superblock_t;
-
-/* Inodo (128 bytes, igual que MesaOS) */
-typedef struct {
-    uint32_t inode_num;
-    uint8_t  type;
-    uint8_t  flags;
-    uint16_t links;
-    uint32_t size;
-    uint32_t blocks_used;
-    uint32_t direct_blocks[MESAFS_DIRECT_BLOCKS];
-    uint32_t indirect_block;
-    uint64_t created;
-    uint64_t modified;
-    uint8_t  reserved[36];
-} __attribute__((packed)) mesafs_inode_t;
-
-static void bitmap_set(uint8_t *bitmap, uint32_t bit) {
-    bitmap[bit / 8] |= (1 << (bit % 8));
-}
+#include "mesafs.h"
 
 int main(int argc, char **argv) {
     if (argc != 2) {
@@ -68,36 +27,35 @@ int main(int argc, char **argv) {
         return 1;
     }
     
-    /* Leer MBR */
-    uint8_t mbr[512];
-    fread(mbr, 1, 512, fp);
-    
-    uint32_t part_lba = 0;
-    uint32_t part_sectors = 0;
-    
-    for (int i = 0; i < 4; i++) {
-        uint8_t *entry = &mbr[446 + i * 16];
-        uint8_t type = entry[4];
-        if (type == 0x77) {
-            part_lba = entry[8] | (entry[9] << 8) | (entry[10] << 16) | (entry[11] << 24);
-            part_sectors = entry[12] | (entry[13] << 8) | (entry[14] << 16) | (entry[15] << 24);
-            printf("Found MesaFS partition: LBA %u, %u sectors\n", part_lba, part_sectors);
-            break;
-        }
-    }
+    /* Buscar la partición (MBR o GPT) */
+    uint64_t part_lba = 0;
+    uint64_t part_sectors = 0;
     
-    if (part_lba == 0) {
-        printf("No MesaFS partition found (type 0x77)\n");
+    if (mesafs_find_partition(fileno(fp), &part_lba, &part_sectors) != 0) {
+        printf("No MesaFS partition found (MBR type 0x77 or GPT)\n");
         fclose(fp);
         return 1;
     }
-    
-    uint32_t part_offset = part_lba * SECTOR_SIZE;
-    uint32_t total_blocks = part_sectors / 8;  /* 8 sectores = 1 bloque */
-    uint32_t total_inodes = 256;
+    printf("Found MesaFS partition: LBA %llu, %llu sectors\n",
+           (unsigned long long)part_lba, (unsigned long long)part_sectors);
+    
+    off_t part_offset = (off_t)part_lba * SECTOR_SIZE;
+    if (part_offset % MESAFS_IO_ALIGN != 0)
+        printf("Warning: partition is not 4 KiB aligned; blocks straddle disk sectors "
+               "and O_DIRECT is unavailable (use mesafs-part)\n");
+    uint64_t part_blocks = part_sectors >> MESAFS_SECTORS_SHIFT;
+    /* 256 caben en la tabla con bloques de 4 KiB; con bloques menores, lo que quepa */
+    uint32_t total_inodes = MESAFS_MAX_INODES < 256 ? MESAFS_MAX_INODES : 256;
+    
+    uint32_t total_blocks = part_blocks;
+    if (part_blocks > MESAFS_BLOCK_BITMAP_BITS) {
+        printf("Warning: block bitmap covers %d blocks, using only those\n", MESAFS_BLOCK_BITMAP_BITS);
+        total_blocks = MESAFS_BLOCK_BITMAP_BITS;
+    }
     
     printf("Formatting MesaFS...\n");
-    printf("  Partition offset: %u bytes (LBA %u)\n", part_offset, part_lba);
+    printf("  Partition offset: %llu bytes (LBA %llu)\n", (unsigned long long)part_offset,
+           (unsigned long long)part_lba);
     printf("  Total blocks: %u\n", total_blocks);
     printf("  Block size: %d\n", MESAFS_BLOCK_SIZE);
     printf("  Data starts at block: %d\n", MESAFS_DATA_START);
@@ -119,9 +77,9 @@ int main(int argc, char **argv) {
     uint8_t sector[SECTOR_SIZE];
     memset(sector, 0, SECTOR_SIZE);
     memcpy(sector, &sb, sizeof(sb));
-    fseek(fp, part_offset, SEEK_SET);
+    fseeko(fp, part_offset, SEEK_SET);
     fwrite(sector, 1, SECTOR_SIZE, fp);
-    printf("  Superblock written at offset %u\n", part_offset);
+    printf("  Superblock written at offset %llu\n", (unsigned long long)part_offset);
     
     /* === Crear Block Bitmap (bloque 0, pero después del superblock sector) === */
     /* En MesaOS, read_block(0) lee desde partition_lba + 0*8 sectores */
@@ -142,27 +100,28 @@ int main(int argc, char **argv) {
     /* Bloque 0 = bitmap de bloques (empieza en partition_lba) */
     memset(block, 0, MESAFS_BLOCK_SIZE);
     
+    /* Pero espera - el superblock también está aquí! */
+    /* Copiamos el superblock al inicio del bloque y los bits van detrás */
+    memcpy(block, &sb, sizeof(sb));
+    uint8_t *block_bitmap = block + MESAFS_BLOCK_BITMAP_OFFSET;
+    
     /* Marcar bloques 0-9 como usados (metadatos) */
     for (int i = 0; i < MESAFS_DATA_START; i++) {
-        bitmap_set(block, i);
+        mesafs_bitmap_set(block_bitmap, i);
     }
     /* Marcar bloque 10 (primer bloque de datos) para root dir */
-    bitmap_set(block, MESAFS_DATA_START);
-    
-    /* Pero espera - el superblock también está aquí! */
-    /* Copiamos el superblock al inicio del bloque */
-    memcpy(block, &sb, sizeof(sb));
+    mesafs_bitmap_set(block_bitmap, MESAFS_DATA_START);
     
-    fseek(fp, part_offset + MESAFS_BLOCK_BITMAP_BLOCK * MESAFS_BLOCK_SIZE, SEEK_SET);
+    fseeko(fp, part_offset + MESAFS_BLOCK_BITMAP_BLOCK * MESAFS_BLOCK_SIZE, SEEK_SET);
     fwrite(block, 1, MESAFS_BLOCK_SIZE, fp);
     printf("  Block bitmap written (block 0)\n");
     
     /* === Crear Inode Bitmap (bloque 1) === */
     memset(block, 0, MESAFS_BLOCK_SIZE);
-    bitmap_set(block, 0);  /* Inodo 0 reservado */
-    bitmap_set(block, 1);  /* Inodo 1 = root */
+    mesafs_bitmap_set(block, 0);  /* Inodo 0 reservado */
+    mesafs_bitmap_set(block, 1);  /* Inodo 1 = root */
     
-    fseek(fp, part_offset + MESAFS_INODE_BITMAP_BLOCK * MESAFS_BLOCK_SIZE, SEEK_SET);
+    fseeko(fp, part_offset + MESAFS_INODE_BITMAP_BLOCK * MESAFS_BLOCK_SIZE, SEEK_SET);
     fwrite(block, 1, MESAFS_BLOCK_SIZE, fp);
     printf("  Inode bitmap written (block 1)\n");
     
@@ -185,20 +144,20 @@ int main(int argc, char **argv) {
     inodes[1].blocks_used = 1;
     inodes[1].direct_blocks[0] = MESAFS_DATA_START;  /* Bloque 10 */
     
-    fseek(fp, part_offset + MESAFS_INODE_TABLE_START * MESAFS_BLOCK_SIZE, SEEK_SET);
+    fseeko(fp, part_offset + MESAFS_INODE_TABLE_START * MESAFS_BLOCK_SIZE, SEEK_SET);
     fwrite(block, 1, MESAFS_BLOCK_SIZE, fp);
     printf("  Inode table written (block 2), root inode at index 1\n");
     
     /* Limpiar resto de bloques de inodos */
     memset(block, 0, MESAFS_BLOCK_SIZE);
     for (int b = 1; b < MESAFS_INODE_TABLE_BLOCKS; b++) {
-        fseek(fp, part_offset + (MESAFS_INODE_TABLE_START + b) * MESAFS_BLOCK_SIZE, SEEK_SET);
+        fseeko(fp, part_offset + (MESAFS_INODE_TABLE_START + b) * MESAFS_BLOCK_SIZE, SEEK_SET);
         fwrite(block, 1, MESAFS_BLOCK_SIZE, fp);
     }
     
     /* === Crear Root Directory (bloque 10) === */
     memset(block, 0, MESAFS_BLOCK_SIZE);
-    fseek(fp, part_offset + MESAFS_DATA_START * MESAFS_BLOCK_SIZE, SEEK_SET);
+    fseeko(fp, part_offset + MESAFS_DATA_START * MESAFS_BLOCK_SIZE, SEEK_SET);
     fwrite(block, 1, MESAFS_BLOCK_SIZE, fp);
     printf("  Root directory written (block %d)\n", MESAFS_DATA_START);
     
@@ -0,0 +1,229 @@
+/**
+ * @file mesafs-mkpatch.c
+ * @brief Genera un parche de bloques entre dos imágenes MesaFS
+ *
+ * Compilar: gcc -O2 -o mesafs-mkpatch mesafs-mkpatch.c mesafs.c -lz
+ * Uso: ./mesafs-mkpatch [-1..-9] <base.img> <nueva.img> <parche.mpt>
+ *
+ * Las dos imágenes tienen que compartir disposición (tabla de particiones y
+ * tamaño del sistema de archivos). Se recorren en tramos los bloques en uso
+ * en la imagen nueva, según su bitmap, y se guardan los que difieren de la
+ * base; el espacio libre no se lee. mesafs-applypatch lo aplica.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "mesafs.h"
+
+static mesafs_patch_entry_t *entries = NULL;
+static uint32_t num_entries = 0;
+static uint32_t entry_cap = 0;
+
+static int is_zero(const uint8_t *p, size_t len) {
+    return p[0] == 0 && memcmp(p, p + 1, len - 1) == 0;
+}
+
+/* CRC32 de un bloque; sb.generation es propia de cada imagen y cuenta como 0 */
+static uint32_t block_crc(uint32_t block, const uint8_t *data) {
+    if (block != MESAFS_BLOCK_BITMAP_BLOCK)
+        return crc32(0, data, MESAFS_BLOCK_SIZE);
+    uint8_t copy[MESAFS_BLOCK_SIZE];
+    memcpy(copy, data, MESAFS_BLOCK_SIZE);
+    memset(copy + offsetof(mesafs_superblock_t, generation), 0, sizeof(uint32_t));
+    return crc32(0, copy, MESAFS_BLOCK_SIZE);
+}
+
+/* CRC32 de los bloques 0-1: superbloque y bitmaps */
+static int metadata_crc(mesafs_t *fs, uint32_t *crc) {
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    *crc = 0;
+    for (uint32_t b = MESAFS_BLOCK_BITMAP_BLOCK; b <= MESAFS_INODE_BITMAP_BLOCK; b++) {
+        if (mesafs_read_block(fs, b, block) != 0)
+            return -1;
+        *crc = crc32_combine(*crc, block_crc(b, block), MESAFS_BLOCK_SIZE);
+    }
+    return 0;
+}
+
+/* Añade el bloque nuevo data y escribe sus datos en offset; retorna los bytes escritos */
+static int64_t add_block(int out, uint64_t offset, uint32_t block, const uint8_t *base,
+                         const uint8_t *data, int level) {
+    if (num_entries == entry_cap) {
+        uint32_t cap = entry_cap ? entry_cap * 2 : 1024;
+        mesafs_patch_entry_t *e = realloc(entries, cap * sizeof(*e));
+        if (!e) {
+            perror("realloc");
+            return -1;
+        }
+        entries = e;
+        entry_cap = cap;
+    }
+    mesafs_patch_entry_t *e = &entries[num_entries++];
+    memset(e, 0, sizeof(*e));
+    e->block = block;
+    e->base_crc = block_crc(block, base);
+    e->crc32 = block_crc(block, data);
+    e->offset = offset;
+    if (is_zero(data, MESAFS_BLOCK_SIZE))
+        return 0;
+
+    uint8_t packed[MESAFS_BLOCK_SIZE];
+    uLongf len = sizeof(packed);
+    const uint8_t *src = data;
+    e->stored = MESAFS_BLOCK_SIZE;
+    if (compress2(packed, &len, data, MESAFS_BLOCK_SIZE, level) == Z_OK && len < MESAFS_BLOCK_SIZE) {
+        src = packed;
+        e->stored = len;
+    }
+    if (pwrite(out, src, e->stored, offset) != (ssize_t)e->stored) {
+        perror("write patch");
+        return -1;
+    }
+    return e->stored;
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaFS Patch Generator v1.0\n\n");
+    printf("Usage: %s [options] <base.img> <new.img> <patch.mpt>\n\n", prog);
+    printf("Options:\n");
+    printf("  -1 .. -9         zlib compression level\n");
+    printf("  -h               Show this help\n");
+    printf("\nExample:\n");
+    printf("  %s disk-1.0.img disk-1.1.img update.mpt\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int level = Z_DEFAULT_COMPRESSION;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "123456789h")) != -1) {
+        if (opt >= '1' && opt <= '9') {
+            level = opt - '0';
+            continue;
+        }
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+    if (optind + 3 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *base_path = argv[optind];
+    const char *target_path = argv[optind + 1];
+    const char *patch_path = argv[optind + 2];
+
+    mesafs_t base, target;
+    if (mesafs_open(&base, base_path, O_RDONLY) != 0)
+        return 1;
+    if (mesafs_open(&target, target_path, O_RDONLY) != 0) {
+        mesafs_close(&base);
+        return 1;
+    }
+
+    struct stat st_base, st_target;
+    if (fstat(base.fd, &st_base) != 0 || fstat(target.fd, &st_target) != 0 ||
+        target.sb.version <= MESAFS_VERSION_V1 ||
+        st_base.st_size != st_target.st_size || base.part_lba != target.part_lba ||
+        base.part_sectors != target.part_sectors || base.sb.total_blocks != target.sb.total_blocks) {
+        printf("Images must share the disk size, partition and file system size, and the "
+               "new one needs a version %d block bitmap\n", MESAFS_VERSION);
+        mesafs_close(&base);
+        mesafs_close(&target);
+        return 1;
+    }
+
+    mesafs_patch_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = MESAFS_PATCH_MAGIC;
+    h.version = MESAFS_PATCH_VERSION;
+    h.image_size = st_target.st_size;
+    h.part_lba = target.part_lba;
+
+    uint8_t block0[MESAFS_BLOCK_SIZE];
+    uint32_t base_crc, target_crc;
+    uint8_t *base_buf = mesafs_buffer_get(&base);
+    uint8_t *target_buf = mesafs_buffer_get(&target);
+    int out = open(patch_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (!base_buf || !target_buf || out < 0 ||
+        metadata_crc(&base, &base_crc) != 0 || metadata_crc(&target, &target_crc) != 0 ||
+        mesafs_read_block(&target, MESAFS_BLOCK_BITMAP_BLOCK, block0) != 0) {
+        perror(out < 0 ? patch_path : "read images");
+        mesafs_close(&base);
+        mesafs_close(&target);
+        return 1;
+    }
+
+    h.base_crc = base_crc;
+    h.target_crc = target_crc;
+    printf("Comparing %s -> %s\n", base_path, target_path);
+
+    /* Bloques en uso en la imagen nueva, en tramos contiguos */
+    const uint8_t *bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+    uint32_t limit = target.sb.total_blocks < MESAFS_BLOCK_BITMAP_BITS ? target.sb.total_blocks
+                                                                       : MESAFS_BLOCK_BITMAP_BITS;
+    uint64_t offset = sizeof(h), scanned = 0;
+    int ret = 0;
+    for (uint32_t b = 0; b < limit && ret == 0; ) {
+        if (!mesafs_bitmap_test(bitmap, b)) {
+            b++;
+            continue;
+        }
+        uint32_t run = 1;
+        while (b + run < limit && run < MESAFS_RUN_BLOCKS && mesafs_bitmap_test(bitmap, b + run))
+            run++;
+        if (mesafs_read_run(&base, b, run, base_buf) != 0 ||
+            mesafs_read_run(&target, b, run, target_buf) != 0) {
+            printf("Failed to read blocks %u-%u\n", b, b + run - 1);
+            ret = 1;
+            break;
+        }
+        for (uint32_t i = 0; i < run; i++) {
+            const uint8_t *old = base_buf + mesafs_block_offset(i);
+            const uint8_t *new = target_buf + mesafs_block_offset(i);
+            if (memcmp(old, new, MESAFS_BLOCK_SIZE) == 0)
+                continue;
+            int64_t n = add_block(out, offset, b + i, old, new, level);
+            if (n < 0) {
+                ret = 1;
+                break;
+            }
+            offset += n;
+        }
+        scanned += run;
+        b += run;
+    }
+    mesafs_buffer_put(&base, base_buf);
+    mesafs_buffer_put(&target, target_buf);
+    mesafs_close(&base);
+    mesafs_close(&target);
+
+    size_t index_len = (size_t)num_entries * sizeof(mesafs_patch_entry_t);
+    h.index_offset = offset;
+    h.num_blocks = num_entries;
+    h.index_crc = crc32(0, (const Bytef *)entries, index_len);
+    if (ret != 0 || pwrite(out, entries, index_len, offset) != (ssize_t)index_len ||
+        pwrite(out, &h, sizeof(h), 0) != sizeof(h) || fsync(out) != 0) {
+        if (ret == 0)
+            perror("write patch");
+        close(out);
+        unlink(patch_path);
+        return 1;
+    }
+    close(out);
+
+    printf("\nPatch created successfully!\n");
+    printf("  Blocks scanned: %llu in use (of %u)\n", (unsigned long long)scanned,
+           target.sb.total_blocks);
+    printf("  Blocks changed: %u (%llu bytes)\n", num_entries,
+           (unsigned long long)mesafs_block_offset(num_entries));
+    printf("  Patch size: %llu bytes\n", (unsigned long long)(offset + index_len));
+    return 0;
+}
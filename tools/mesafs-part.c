@@ -0,0 +1,114 @@
+/**
+ * @file mesafs-part.c
+ * @brief Crea la tabla de particiones de un disco para MesaFS
+ *
+ * Compilar: gcc -o mesafs-part mesafs-part.c mesafs.c
+ * Uso: ./mesafs-part [-m] [-s <tamaño>] <disk.img>
+ *
+ * Escribe una GPT con una única partición MesaFS alineada a 1 MiB que ocupa
+ * todo el disco (o un MBR clásico con tipo 0x77 con -m). Con -s crea o
+ * redimensiona la imagen, sin escribir datos: los discos de varios TiB son
+ * archivos dispersos. Sustituye al paso de fdisk; después va mesafs-format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mesafs.h"
+
+/* Tamaño con sufijo K/M/G/T (potencias de 1024); 0 si no es válido */
+static uint64_t parse_size(const char *s) {
+    char *end;
+    uint64_t size = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'T': case 't': size <<= 10; /* fall through */
+        case 'G': case 'g': size <<= 10; /* fall through */
+        case 'M': case 'm': size <<= 10; /* fall through */
+        case 'K': case 'k': size <<= 10; end++; break;
+        case '\0': break;
+        default: return 0;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaFS Partitioner v1.0\n\n");
+    printf("Usage: %s [options] <disk.img>\n\n", prog);
+    printf("Options:\n");
+    printf("  -s <size>        Create or resize the image (suffix K, M, G or T)\n");
+    printf("  -m               Write an MBR (type 0x77) instead of GPT, up to 2 TiB\n");
+    printf("  -h               Show this help\n");
+    printf("\nExample:\n");
+    printf("  %s -s 4T disk.img && ./mesafs-format disk.img\n", prog);
+}
+
+int main(int argc, char **argv) {
+    uint64_t size = 0;
+    int use_mbr = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:mh")) != -1) {
+        switch (opt) {
+            case 's':
+                size = parse_size(optarg);
+                if (size == 0 || size % SECTOR_SIZE != 0) {
+                    fprintf(stderr, "Error: invalid size %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'm': use_mbr = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *disk_path = argv[optind];
+
+    int fd = open(disk_path, O_RDWR | (size ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        perror("Cannot open disk");
+        return 1;
+    }
+    if (size && ftruncate(fd, size) != 0) {
+        perror("Cannot resize disk");
+        close(fd);
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        close(fd);
+        return 1;
+    }
+    uint64_t disk_sectors = (uint64_t)st.st_size / SECTOR_SIZE;
+
+    uint64_t lba, sectors;
+    int ret = use_mbr ? mesafs_write_mbr(fd, disk_sectors, &lba, &sectors)
+                      : mesafs_write_gpt(fd, disk_sectors, &lba, &sectors);
+    if (ret != 0 || fsync(fd) != 0) {
+        printf("Failed to write partition table\n");
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    printf("Partition table written to %s (%s)\n", disk_path, use_mbr ? "MBR" : "GPT");
+    printf("  Disk: %llu sectors (%llu MiB)\n", (unsigned long long)disk_sectors,
+           (unsigned long long)(disk_sectors / 2048));
+    printf("  MesaFS partition: LBA %llu, %llu sectors (%llu MiB)\n", (unsigned long long)lba,
+           (unsigned long long)sectors, (unsigned long long)(sectors / 2048));
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file mesafs-snap.c
+ * @brief Snapshots dentro de una imagen MesaFS
+ *
+ * Compilar: gcc -o mesafs-snap mesafs-snap.c mesafs.c
+ * Uso: ./mesafs-snap <disk.img>
+ *      ./mesafs-snap -c <nombre> <disk.img>
+ *      ./mesafs-snap -r <nombre> <disk.img>
+ *      ./mesafs-snap -d <nombre> <disk.img>
+ *
+ * Un snapshot guarda la tabla de inodos y comparte los bloques de datos con
+ * la imagen, así que crearlo no depende del tamaño de los archivos. Las
+ * herramientas copian un bloque compartido antes de escribir en él; volver
+ * a un snapshot restaura su tabla de inodos. MesaOS no conoce los
+ * snapshots: hay que borrarlos antes de arrancar una imagen que se vaya a
+ * modificar desde el sistema.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "mesafs.h"
+
+static void list_snapshots(const mesafs_t *fs, const char *path) {
+    const mesafs_superblock_t *sb = &fs->sb;
+    if (!(sb->features & MESAFS_FEATURE_SNAPSHOTS) || sb->num_snapshots == 0) {
+        printf("No snapshots in %s\n", path);
+        return;
+    }
+    printf("%-16s  %-19s  %10s  %s\n", "NAME", "CREATED", "TABLE", "ROOT");
+    for (uint32_t i = 0; i < sb->num_snapshots && i < MESAFS_MAX_SNAPSHOTS; i++) {
+        const mesafs_snapshot_t *s = &sb->snapshots[i];
+        char name[MESAFS_SNAPSHOT_NAME + 1] = "";
+        char when[32] = "?";
+        time_t t = s->created;
+        struct tm tm;
+        memcpy(name, s->name, MESAFS_SNAPSHOT_NAME);
+        if (localtime_r(&t, &tm))
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+        printf("%-16s  %-19s  %10u  %u\n", name, when, s->table_block, s->root_inode);
+    }
+    printf("\n%u of %d snapshots, %u blocks free\n", sb->num_snapshots, MESAFS_MAX_SNAPSHOTS,
+           sb->free_blocks);
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaFS Snapshot Tool v1.0\n\n");
+    printf("Usage: %s [options] <disk.img>\n\n", prog);
+    printf("Options:\n");
+    printf("  -c <name>        Create a snapshot of the current state\n");
+    printf("  -r <name>        Roll back to a snapshot (it is kept)\n");
+    printf("  -d <name>        Delete a snapshot and free the blocks only it uses\n");
+    printf("  -h               Show this help\n");
+    printf("\nWithout options, list the snapshots.\n");
+    printf("\nExample:\n");
+    printf("  %s -c before disk.img && ./inject-file disk.img new.msa /pkgs/new.msa\n", prog);
+    printf("  %s -r before disk.img\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *name = NULL;
+    char action = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:d:h")) != -1) {
+        switch (opt) {
+            case 'c':
+            case 'r':
+            case 'd':
+                if (action) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                action = opt;
+                name = optarg;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *disk_path = argv[optind];
+
+    mesafs_t fs;
+    if (mesafs_open(&fs, disk_path, action ? O_RDWR : O_RDONLY) != 0)
+        return 1;
+
+    int ret = 0;
+    switch (action) {
+        case 'c':
+            ret = mesafs_snapshot_create(&fs, name);
+            if (ret == 0)
+                printf("Snapshot %s created (%u blocks free)\n", name, fs.sb.free_blocks);
+            break;
+        case 'r':
+            ret = mesafs_snapshot_rollback(&fs, name);
+            if (ret == 0)
+                printf("Rolled back to %s (%u blocks free)\n", name, fs.sb.free_blocks);
+            break;
+        case 'd':
+            ret = mesafs_snapshot_delete(&fs, name);
+            if (ret == 0)
+                printf("Snapshot %s deleted (%u blocks free)\n", name, fs.sb.free_blocks);
+            break;
+        default:
+            list_snapshots(&fs, disk_path);
+            break;
+    }
+    if (ret == 0 && action && fsync(fs.fd) != 0) {
+        perror("fsync");
+        ret = -1;
+    }
+    mesafs_close(&fs);
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,389 @@
+/**
+ * @file mesafs-unpack.c
+ * @brief Reconstruye una imagen empaquetada con mesafs-pack, o lee partes de ella
+ *
+ * Compilar: gcc -O2 -o mesafs-unpack mesafs-unpack.c mesafs.c pool.c -lz -lpthread
+ * Uso: ./mesafs-unpack [-j <hilos>] <imagen.mpk> <disk.img>
+ *      ./mesafs-unpack -b <bloque> <imagen.mpk> <salida>
+ *      ./mesafs-unpack -f <ruta> <imagen.mpk> <salida>
+ *      ./mesafs-unpack -l <imagen.mpk>
+ *
+ * La imagen se crea dispersa con su tamaño original y cada tramo del índice
+ * es una tarea del pool de hilos (pool.h), que lo descomprime y lo escribe
+ * en su sitio, sin orden entre ellos. Con -b
+ * o -f solo se descomprimen los tramos que contienen el bloque de la
+ * partición o el archivo del directorio raíz pedidos.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "mesafs.h"
+#include "pool.h"
+
+/* ==================== Paquete ==================== */
+
+typedef struct {
+    int                   fd;
+    mesafs_pack_header_t  h;
+    mesafs_pack_chunk_t  *chunks;
+    uint64_t              part_offset;
+    /* Último tramo descomprimido, para lecturas pequeñas seguidas */
+    int64_t               cached;
+    uint8_t              *cache;
+} pack_t;
+
+static int pack_open(pack_t *pk, const char *path) {
+    memset(pk, 0, sizeof(*pk));
+    pk->cached = -1;
+    pk->fd = open(path, O_RDONLY);
+    if (pk->fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (pread(pk->fd, &pk->h, sizeof(pk->h), 0) != sizeof(pk->h) ||
+        pk->h.magic != MESAFS_PACK_MAGIC || pk->h.version != MESAFS_PACK_VERSION ||
+        pk->h.chunk_size == 0) {
+        printf("%s: not a MesaFS pack\n", path);
+        close(pk->fd);
+        return -1;
+    }
+
+    size_t index_len = (size_t)pk->h.num_chunks * sizeof(mesafs_pack_chunk_t);
+    pk->chunks = malloc(index_len ? index_len : 1);
+    pk->cache = malloc(pk->h.chunk_size);
+    if (!pk->chunks || !pk->cache) {
+        perror("malloc");
+        close(pk->fd);
+        return -1;
+    }
+    if (pread(pk->fd, pk->chunks, index_len, pk->h.index_offset) != (ssize_t)index_len ||
+        crc32(0, (const Bytef *)pk->chunks, index_len) != pk->h.index_crc) {
+        printf("%s: chunk index is damaged\n", path);
+        close(pk->fd);
+        return -1;
+    }
+    for (uint32_t i = 0; i < pk->h.num_chunks; i++) {
+        if (pk->chunks[i].length > pk->h.chunk_size || pk->chunks[i].stored > pk->chunks[i].length ||
+            (i > 0 && pk->chunks[i].image_offset <
+                      pk->chunks[i - 1].image_offset + pk->chunks[i - 1].length)) {
+            printf("%s: chunk %u is invalid\n", path, i);
+            close(pk->fd);
+            return -1;
+        }
+    }
+    pk->part_offset = pk->h.part_lba * SECTOR_SIZE;
+    return 0;
+}
+
+static void pack_close(pack_t *pk) {
+    close(pk->fd);
+    free(pk->chunks);
+    free(pk->cache);
+}
+
+/* Descomprime el tramo i en out (chunk_size bytes); stored es un buffer igual */
+static int pack_chunk(const pack_t *pk, uint32_t i, uint8_t *out, uint8_t *stored) {
+    const mesafs_pack_chunk_t *c = &pk->chunks[i];
+    uint8_t *dst = c->stored == c->length ? out : stored;
+    if (pread(pk->fd, dst, c->stored, c->pack_offset) != (ssize_t)c->stored)
+        return -1;
+    if (dst != out) {
+        uLongf len = c->length;
+        if (uncompress(out, &len, stored, c->stored) != Z_OK || len != c->length)
+            return -1;
+    }
+    return crc32(0, out, c->length) == c->crc32 ? 0 : -1;
+}
+
+/* Lee len bytes de la imagen desde offset; lo que no está en el índice son ceros */
+static int pack_read(pack_t *pk, uint64_t offset, void *buf, size_t len) {
+    uint8_t *dst = buf;
+    memset(dst, 0, len);
+
+    /* Primer tramo que acaba después de offset */
+    uint32_t lo = 0, hi = pk->h.num_chunks;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (pk->chunks[mid].image_offset + pk->chunks[mid].length <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    uint8_t *stored = NULL;
+    for (uint32_t i = lo; i < pk->h.num_chunks && pk->chunks[i].image_offset < offset + len; i++) {
+        const mesafs_pack_chunk_t *c = &pk->chunks[i];
+        if (pk->cached != i) {
+            if (!stored && !(stored = malloc(pk->h.chunk_size)))
+                return -1;
+            pk->cached = -1;
+            if (pack_chunk(pk, i, pk->cache, stored) != 0) {
+                printf("Chunk %u is damaged\n", i);
+                free(stored);
+                return -1;
+            }
+            pk->cached = i;
+        }
+        uint64_t from = offset > c->image_offset ? offset : c->image_offset;
+        uint64_t to = offset + len < c->image_offset + c->length ? offset + len
+                                                                 : c->image_offset + c->length;
+        memcpy(dst + (from - offset), pk->cache + (from - c->image_offset), to - from);
+    }
+    free(stored);
+    return 0;
+}
+
+static int pack_block(pack_t *pk, uint32_t block, void *buf) {
+    return pack_read(pk, pk->part_offset + mesafs_block_offset(block), buf, MESAFS_BLOCK_SIZE);
+}
+
+static int pack_inode(pack_t *pk, uint32_t ino, mesafs_inode_t *inode) {
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    if (pack_block(pk, mesafs_inode_block(ino), block) != 0)
+        return -1;
+    memcpy(inode, block + mesafs_inode_slot(ino) * sizeof(mesafs_inode_t), sizeof(*inode));
+    return 0;
+}
+
+/* Bloques de un inodo en orden lógico (0 = hueco); retorna cuántos, o -1 */
+static int pack_file_blocks(pack_t *pk, const mesafs_inode_t *inode, uint32_t *blocks) {
+    uint32_t count = inode->blocks_used;
+    if (count > MESAFS_MAX_FILE_BLOCKS)
+        return -1;
+    for (uint32_t i = 0; i < count && i < MESAFS_DIRECT_BLOCKS; i++)
+        blocks[i] = inode->direct_blocks[i];
+    if (count > MESAFS_DIRECT_BLOCKS) {
+        uint32_t ptrs[MESAFS_PTRS_PER_BLOCK];
+        if (inode->indirect_block == 0 || pack_block(pk, inode->indirect_block, ptrs) != 0)
+            return -1;
+        memcpy(blocks + MESAFS_DIRECT_BLOCKS, ptrs,
+               (count - MESAFS_DIRECT_BLOCKS) * sizeof(uint32_t));
+    }
+    return count;
+}
+
+/* ==================== Desempaquetado completo ==================== */
+
+/* Buffers de cada hilo del pool, creados al ejecutar su primera tarea */
+typedef struct {
+    uint8_t *out;
+    uint8_t *stored;
+} unpack_worker_t;
+
+static pack_t *job_pack;
+static int job_out;
+static unpack_worker_t *job_workers;
+static int failed = 0;
+
+static void chunk_task(void *arg, int worker) {
+    uint32_t i = (uint32_t)(uintptr_t)arg;
+    unpack_worker_t *w = &job_workers[worker];
+    const mesafs_pack_chunk_t *c = &job_pack->chunks[i];
+
+    if (!w->out) {
+        w->out = malloc(job_pack->h.chunk_size);
+        w->stored = malloc(job_pack->h.chunk_size);
+    }
+    if (!w->out || !w->stored || pack_chunk(job_pack, i, w->out, w->stored) != 0) {
+        printf("  Chunk %u at offset %llu is damaged\n", i, (unsigned long long)c->image_offset);
+        __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (pwrite(job_out, w->out, c->length, c->image_offset) != (ssize_t)c->length) {
+        perror("write image");
+        __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int unpack_all(pack_t *pk, const char *out_path, pool_t *pool) {
+    int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0 || ftruncate(out, pk->h.image_size) != 0) {
+        perror(out_path);
+        return 1;
+    }
+    int threads = pool_width(pool);
+    job_workers = calloc(threads, sizeof(*job_workers));
+    if (!job_workers) {
+        perror("calloc");
+        close(out);
+        return 1;
+    }
+
+    printf("Unpacking %u chunks with %d threads...\n", pk->h.num_chunks, threads);
+    job_pack = pk;
+    job_out = out;
+
+    for (uint32_t i = 0; i < pk->h.num_chunks; i++) {
+        if (pool_submit(pool, chunk_task, (void *)(uintptr_t)i) != 0)
+            chunk_task((void *)(uintptr_t)i, 0);
+    }
+    pool_wait(pool);
+    for (int t = 0; t < threads; t++) {
+        free(job_workers[t].out);
+        free(job_workers[t].stored);
+    }
+    free(job_workers);
+
+    if (failed || fsync(out) != 0) {
+        close(out);
+        unlink(out_path);
+        printf("Unpack failed\n");
+        return 1;
+    }
+    close(out);
+    printf("\nImage unpacked successfully!\n");
+    printf("  %s: %llu bytes\n", out_path, (unsigned long long)pk->h.image_size);
+    return 0;
+}
+
+/* ==================== Lecturas sueltas ==================== */
+
+static int write_out(const char *path, const void *buf, size_t len) {
+    FILE *fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (!fp || fwrite(buf, 1, len, fp) != len) {
+        perror(path);
+        return -1;
+    }
+    return fp == stdout ? fflush(fp) : fclose(fp);
+}
+
+static int extract_file(pack_t *pk, const char *path, const char *out_path) {
+    const char *name = path[0] == '/' ? path + 1 : path;
+
+    mesafs_superblock_t sb;
+    if (pack_read(pk, pk->part_offset, &sb, sizeof(sb)) != 0 || sb.magic != MESAFS_MAGIC ||
+        sb.block_size != MESAFS_BLOCK_SIZE) {
+        printf("No MesaFS file system in the pack\n");
+        return 1;
+    }
+
+    /* Directorio raíz */
+    mesafs_inode_t root, inode;
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS];
+    int nblocks;
+    if (pack_inode(pk, sb.root_inode, &root) != 0 || (nblocks = pack_file_blocks(pk, &root, blocks)) < 0) {
+        printf("Failed to read root directory\n");
+        return 1;
+    }
+    uint32_t ino = 0;
+    for (int b = 0; b < nblocks && ino == 0; b++) {
+        uint8_t dir[MESAFS_BLOCK_SIZE];
+        if (blocks[b] == 0 || pack_block(pk, blocks[b], dir) != 0)
+            continue;
+        int slot = mesafs_dirent_find(dir, name, strlen(name));
+        if (slot >= 0)
+            ino = ((mesafs_dirent_t *)dir)[slot].inode;
+    }
+    if (ino == 0 || ino >= sb.total_inodes || pack_inode(pk, ino, &inode) != 0) {
+        printf("Not found: %s\n", path);
+        return 1;
+    }
+    if (inode.type != MESAFS_TYPE_FILE || (nblocks = pack_file_blocks(pk, &inode, blocks)) < 0) {
+        printf("%s is not a regular file\n", path);
+        return 1;
+    }
+
+    uint8_t *data = calloc(1, (size_t)nblocks * MESAFS_BLOCK_SIZE + 1);
+    if (!data) {
+        perror("calloc");
+        return 1;
+    }
+    for (int b = 0; b < nblocks; b++) {
+        if (blocks[b] != 0 && pack_block(pk, blocks[b], data + mesafs_block_offset(b)) != 0) {
+            free(data);
+            return 1;
+        }
+    }
+    int ret = write_out(out_path, data, inode.size);
+    free(data);
+    if (ret != 0)
+        return 1;
+    if (strcmp(out_path, "-") != 0)
+        printf("Extracted %s (%u bytes, inode %u) to %s\n", path, inode.size, ino, out_path);
+    return 0;
+}
+
+static void list_pack(const pack_t *pk, const char *path) {
+    uint64_t data = 0, stored = 0;
+    for (uint32_t i = 0; i < pk->h.num_chunks; i++) {
+        data += pk->chunks[i].length;
+        stored += pk->chunks[i].stored;
+    }
+    printf("%s:\n", path);
+    printf("  Image size: %llu bytes\n", (unsigned long long)pk->h.image_size);
+    printf("  MesaFS partition: LBA %llu\n", (unsigned long long)pk->h.part_lba);
+    printf("  Chunks: %u of up to %u KiB\n", pk->h.num_chunks, pk->h.chunk_size / 1024);
+    printf("  Data: %llu bytes, stored in %llu (%.1f%%)\n", (unsigned long long)data,
+           (unsigned long long)stored, data ? 100.0 * stored / data : 0.0);
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaFS Image Unpacker v1.0\n\n");
+    printf("Usage: %s [-j <threads>] <image.mpk> <disk.img>\n", prog);
+    printf("       %s -b <block> <image.mpk> <output>\n", prog);
+    printf("       %s -f <path> <image.mpk> <output>\n", prog);
+    printf("       %s -l <image.mpk>\n\n", prog);
+    printf("Options:\n");
+    printf("  -j <threads>     Decompression threads (default: $MESA_JOBS or online CPUs)\n");
+    printf("  -b <block>       Extract one block of the MesaFS partition\n");
+    printf("  -f <path>        Extract a file of the root directory\n");
+    printf("  -l               Show the pack contents\n");
+    printf("  -h               Show this help\n");
+    printf("\nOutput '-' writes to stdout.\n");
+    printf("\nExample:\n");
+    printf("  %s -f /pkgs/hello.msa disk.mpk hello.msa\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *file = NULL;
+    int64_t block = -1;
+    int list = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:b:f:lh")) != -1) {
+        switch (opt) {
+            case 'j': pool_set_width(atol(optarg)); break;
+            case 'b': block = atoll(optarg); break;
+            case 'f': file = optarg; break;
+            case 'l': list = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind + (list ? 1 : 2) != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    pack_t pk;
+    if (pack_open(&pk, argv[optind]) != 0)
+        return 1;
+
+    int ret;
+    if (list) {
+        list_pack(&pk, argv[optind]);
+        ret = 0;
+    } else if (file) {
+        ret = extract_file(&pk, file, argv[optind + 1]);
+    } else if (block >= 0) {
+        uint8_t buf[MESAFS_BLOCK_SIZE];
+        ret = pack_block(&pk, block, buf) != 0 || write_out(argv[optind + 1], buf, sizeof(buf)) != 0;
+    } else if (!pool_get()) {
+        fprintf(stderr, "Error: cannot create worker threads\n");
+        ret = 1;
+    } else {
+        ret = unpack_all(&pk, argv[optind + 1], pool_get());
+    }
+    pack_close(&pk);
+    return ret;
+}
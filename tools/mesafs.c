@@ -0,0 +1,1715 @@
+/**
+ * @file mesafs.c
+ * @brief Acceso a imágenes MesaFS (ver mesafs.h)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "mesafs.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* ==================== Tabla de particiones ==================== */
+
+static const uint8_t gpt_type_guid[16] = MESAFS_GPT_TYPE_GUID;
+
+/* CRC32 de los headers y entradas GPT (mismo polinomio que .msa) */
+static uint32_t gpt_crc32(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/*
+ * Lee la GPT cuyo header está en header_lba. Retorna 0 si encuentra la
+ * partición MesaFS, 1 si la GPT es válida pero no la tiene, -1 si no es válida.
+ */
+static int gpt_find(int fd, uint64_t header_lba, uint64_t *lba, uint64_t *sectors) {
+    uint8_t sector[SECTOR_SIZE];
+    if (pread(fd, sector, SECTOR_SIZE, header_lba * SECTOR_SIZE) != SECTOR_SIZE)
+        return -1;
+
+    gpt_header_t h;
+    memcpy(&h, sector, sizeof(h));
+    if (memcmp(h.signature, GPT_SIGNATURE, 8) != 0 || h.header_size < sizeof(h) ||
+        h.header_size > SECTOR_SIZE || h.my_lba != header_lba)
+        return -1;
+    memset(sector + offsetof(gpt_header_t, header_crc32), 0, sizeof(uint32_t));
+    if (gpt_crc32(sector, h.header_size) != h.header_crc32)
+        return -1;
+
+    if (h.entry_size < sizeof(gpt_entry_t) || h.entry_size % 8 != 0 || h.num_entries == 0 ||
+        (uint64_t)h.num_entries * h.entry_size > 1024 * 1024)
+        return -1;
+    size_t len = (size_t)h.num_entries * h.entry_size;
+    uint8_t *entries = malloc(len);
+    if (!entries)
+        return -1;
+    if (pread(fd, entries, len, h.entries_lba * SECTOR_SIZE) != (ssize_t)len ||
+        gpt_crc32(entries, len) != h.entries_crc32) {
+        free(entries);
+        return -1;
+    }
+
+    int ret = 1;
+    for (uint32_t i = 0; i < h.num_entries; i++) {
+        gpt_entry_t e;
+        memcpy(&e, entries + (size_t)i * h.entry_size, sizeof(e));
+        if (memcmp(e.type_guid, gpt_type_guid, 16) == 0 && e.first_lba != 0 &&
+            e.last_lba >= e.first_lba) {
+            *lba = e.first_lba;
+            *sectors = e.last_lba - e.first_lba + 1;
+            ret = 0;
+            break;
+        }
+    }
+    free(entries);
+    return ret;
+}
+
+int mesafs_find_partition(int fd, uint64_t *lba, uint64_t *sectors) {
+    uint8_t mbr[SECTOR_SIZE];
+    if (pread(fd, mbr, SECTOR_SIZE, 0) != SECTOR_SIZE)
+        return -1;
+
+    int protective = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t *entry = &mbr[446 + i * 16];
+        if (entry[4] == MESAFS_PART_TYPE) {
+            *lba = entry[8] | (entry[9] << 8) | (entry[10] << 16) | ((uint32_t)entry[11] << 24);
+            *sectors = entry[12] | (entry[13] << 8) | (entry[14] << 16) | ((uint32_t)entry[15] << 24);
+            return *lba ? 0 : -1;
+        }
+        if (entry[4] == MESAFS_MBR_PROTECTIVE)
+            protective = 1;
+    }
+    if (!protective)
+        return -1;
+
+    int ret = gpt_find(fd, 1, lba, sectors);
+    if (ret < 0) {
+        /* GPT principal dañada: la copia está en el último sector */
+        off_t end = lseek(fd, 0, SEEK_END);
+        if (end >= 2 * SECTOR_SIZE)
+            ret = gpt_find(fd, end / SECTOR_SIZE - 1, lba, sectors);
+    }
+    return ret == 0 ? 0 : -1;
+}
+
+/* GUID aleatorio (versión 4) */
+static void random_guid(uint8_t *guid) {
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0 || read(fd, guid, 16) != 16) {
+        for (int i = 0; i < 16; i++)
+            guid[i] = rand();
+    }
+    if (fd >= 0)
+        close(fd);
+    guid[7] = (guid[7] & 0x0F) | 0x40;
+    guid[8] = (guid[8] & 0x3F) | 0x80;
+}
+
+/* Entrada MBR con LBA de 32 bits (CHS sin usar, como hacen fdisk y parted) */
+static void mbr_entry(uint8_t *entry, uint8_t type, uint32_t lba, uint32_t sectors) {
+    static const uint8_t chs_max[3] = { 0xFE, 0xFF, 0xFF };
+    memset(entry, 0, 16);
+    entry[1] = 0x00; entry[2] = 0x02; entry[3] = 0x00;  /* CHS 0/0/2 */
+    entry[4] = type;
+    memcpy(entry + 5, chs_max, 3);
+    for (int i = 0; i < 4; i++) {
+        entry[8 + i] = lba >> (8 * i);
+        entry[12 + i] = sectors >> (8 * i);
+    }
+}
+
+/* Reescribe la tabla del MBR conservando el código de arranque */
+static int write_mbr_table(int fd, uint8_t type, uint32_t lba, uint32_t sectors) {
+    uint8_t mbr[SECTOR_SIZE];
+    if (pread(fd, mbr, SECTOR_SIZE, 0) != SECTOR_SIZE)
+        memset(mbr, 0, SECTOR_SIZE);
+    memset(mbr + 446, 0, 64);
+    mbr_entry(mbr + 446, type, lba, sectors);
+    mbr[510] = 0x55;
+    mbr[511] = 0xAA;
+    return pwrite(fd, mbr, SECTOR_SIZE, 0) == SECTOR_SIZE ? 0 : -1;
+}
+
+int mesafs_write_mbr(int fd, uint64_t disk_sectors, uint64_t *lba, uint64_t *sectors) {
+    uint64_t end = disk_sectors / MESAFS_ALIGN_SECTORS * MESAFS_ALIGN_SECTORS;
+    if (end > 0xFFFFFFFFULL) {
+        printf("Disk too large for MBR (max 2 TiB), use GPT\n");
+        return -1;
+    }
+    if (end <= MESAFS_ALIGN_SECTORS) {
+        printf("Disk too small\n");
+        return -1;
+    }
+    *lba = MESAFS_ALIGN_SECTORS;
+    *sectors = end - MESAFS_ALIGN_SECTORS;
+    return write_mbr_table(fd, MESAFS_PART_TYPE, *lba, *sectors);
+}
+
+static int write_gpt_header(int fd, gpt_header_t *h, uint64_t my_lba, uint64_t alternate_lba,
+                            uint64_t entries_lba) {
+    uint8_t sector[SECTOR_SIZE];
+    h->my_lba = my_lba;
+    h->alternate_lba = alternate_lba;
+    h->entries_lba = entries_lba;
+    h->header_crc32 = 0;
+    h->header_crc32 = gpt_crc32(h, sizeof(*h));
+    memset(sector, 0, SECTOR_SIZE);
+    memcpy(sector, h, sizeof(*h));
+    return pwrite(fd, sector, SECTOR_SIZE, my_lba * SECTOR_SIZE) == SECTOR_SIZE ? 0 : -1;
+}
+
+int mesafs_write_gpt(int fd, uint64_t disk_sectors, uint64_t *lba, uint64_t *sectors) {
+    uint64_t last_lba = disk_sectors - 1;
+    uint64_t first_usable = 2 + GPT_ENTRIES_SECTORS;
+    uint64_t last_usable = last_lba - 1 - GPT_ENTRIES_SECTORS;
+    uint64_t end = (last_usable + 1) / MESAFS_ALIGN_SECTORS * MESAFS_ALIGN_SECTORS;
+    if (disk_sectors < 2 * MESAFS_ALIGN_SECTORS + 2 * first_usable || end <= MESAFS_ALIGN_SECTORS) {
+        printf("Disk too small\n");
+        return -1;
+    }
+
+    static uint8_t entries[GPT_ENTRIES * GPT_ENTRY_SIZE];
+    memset(entries, 0, sizeof(entries));
+    gpt_entry_t *e = (gpt_entry_t *)entries;
+    memcpy(e->type_guid, gpt_type_guid, 16);
+    random_guid(e->unique_guid);
+    e->first_lba = MESAFS_ALIGN_SECTORS;
+    e->last_lba = end - 1;
+    const char *name = "MesaFS";
+    for (int i = 0; name[i]; i++)
+        e->name[i] = name[i];
+
+    gpt_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.signature, GPT_SIGNATURE, 8);
+    h.revision = GPT_REVISION;
+    h.header_size = sizeof(h);
+    h.first_usable_lba = first_usable;
+    h.last_usable_lba = last_usable;
+    random_guid(h.disk_guid);
+    h.num_entries = GPT_ENTRIES;
+    h.entry_size = GPT_ENTRY_SIZE;
+    h.entries_crc32 = gpt_crc32(entries, sizeof(entries));
+
+    /* Copia primero: si algo falla a medias, la principal vieja sigue siendo válida */
+    uint64_t backup_entries = last_lba - GPT_ENTRIES_SECTORS;
+    if (pwrite(fd, entries, sizeof(entries), backup_entries * SECTOR_SIZE) != sizeof(entries) ||
+        write_gpt_header(fd, &h, last_lba, 1, backup_entries) != 0 ||
+        pwrite(fd, entries, sizeof(entries), 2 * SECTOR_SIZE) != sizeof(entries) ||
+        write_gpt_header(fd, &h, 1, last_lba, 2) != 0)
+        return -1;
+
+    /* MBR protector: cubre todo el disco hasta donde llegan 32 bits */
+    uint64_t covered = disk_sectors - 1;
+    if (write_mbr_table(fd, MESAFS_MBR_PROTECTIVE, 1,
+                        covered > 0xFFFFFFFFULL ? 0xFFFFFFFF : (uint32_t)covered) != 0)
+        return -1;
+
+    *lba = e->first_lba;
+    *sectors = e->last_lba - e->first_lba + 1;
+    return 0;
+}
+
+int mesafs_open(mesafs_t *fs, const char *path, int flags) {
+    memset(fs, 0, sizeof(*fs));
+
+    /* La tabla de particiones y el superbloque se leen con la page cache */
+    int direct = (flags & O_DIRECT) != 0;
+    fs->fd = open(path, flags & ~O_DIRECT);
+    if (fs->fd < 0) {
+        perror("Cannot open disk");
+        return -1;
+    }
+
+    if (mesafs_find_partition(fs->fd, &fs->part_lba, &fs->part_sectors) != 0) {
+        printf("No MesaFS partition found\n");
+        close(fs->fd);
+        return -1;
+    }
+    fs->part_offset = (uint64_t)fs->part_lba * SECTOR_SIZE;
+
+    if (pread(fs->fd, &fs->sb, sizeof(fs->sb), fs->part_offset) != sizeof(fs->sb)) {
+        printf("Failed to read superblock\n");
+        close(fs->fd);
+        return -1;
+    }
+
+    if (fs->sb.magic != MESAFS_MAGIC) {
+        printf("Invalid MesaFS magic: 0x%08X (expected 0x%08X)\n", fs->sb.magic, MESAFS_MAGIC);
+        close(fs->fd);
+        return -1;
+    }
+
+    /* Sin un bitmap de bloques fiable (versión 1) la imagen solo se lee */
+    if (fs->sb.version > MESAFS_VERSION ||
+        (fs->sb.version <= MESAFS_VERSION_V1 && (flags & O_ACCMODE) != O_RDONLY)) {
+        printf("Unsupported MesaFS version %u (tools handle version %d; version 1 images "
+               "are read-only, reformat them with mesafs-format)\n",
+               fs->sb.version, MESAFS_VERSION);
+        close(fs->fd);
+        return -1;
+    }
+
+    /* La geometría se fija al compilar: la imagen tiene que coincidir */
+    if (fs->sb.block_size != MESAFS_BLOCK_SIZE || fs->sb.total_inodes > MESAFS_MAX_INODES) {
+        printf("Unsupported geometry: %u-byte blocks, %u inodes (tools built for %d-byte "
+               "blocks, rebuild with -DMESAFS_BLOCK_SHIFT=n)\n", fs->sb.block_size,
+               fs->sb.total_inodes, MESAFS_BLOCK_SIZE);
+        close(fs->fd);
+        return -1;
+    }
+
+    if (direct) {
+        if (fs->part_offset % MESAFS_IO_ALIGN != 0) {
+            printf("Partition at LBA %llu is not 4 KiB aligned; O_DIRECT needs it "
+                   "(recreate it with mesafs-part)\n", (unsigned long long)fs->part_lba);
+            close(fs->fd);
+            return -1;
+        }
+        if (posix_memalign((void **)&fs->bounce, MESAFS_IO_ALIGN, MESAFS_BLOCK_SIZE) != 0) {
+            printf("Cannot allocate I/O buffer\n");
+            close(fs->fd);
+            return -1;
+        }
+        if (fcntl(fs->fd, F_SETFL, fcntl(fs->fd, F_GETFL) | O_DIRECT) == 0)
+            fs->direct = 1;
+        else
+            printf("Warning: O_DIRECT not supported on %s, using the page cache\n", path);
+    }
+
+    return 0;
+}
+
+void mesafs_close(mesafs_t *fs) {
+    if (fs->fd >= 0)
+        close(fs->fd);
+    fs->fd = -1;
+    free(fs->bounce);
+    fs->bounce = NULL;
+    while (fs->pool_count > 0)
+        free(fs->pool[--fs->pool_count]);
+}
+
+/* pread/pwrite completos (O_DIRECT puede devolver escrituras parciales) */
+static int io_full(int fd, void *buf, size_t len, uint64_t off, int write) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write ? pwrite(fd, p, len, off) : pread(fd, p, len, off);
+        if (n <= 0)
+            return -1;
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int is_aligned(const void *buf) {
+    return ((uintptr_t)buf & (MESAFS_IO_ALIGN - 1)) == 0;
+}
+
+int mesafs_read_block(mesafs_t *fs, uint32_t block_num, void *buf) {
+    uint64_t off = fs->part_offset + mesafs_block_offset(block_num);
+    if (!fs->direct || is_aligned(buf))
+        return io_full(fs->fd, buf, MESAFS_BLOCK_SIZE, off, 0);
+    if (io_full(fs->fd, fs->bounce, MESAFS_BLOCK_SIZE, off, 0) != 0)
+        return -1;
+    memcpy(buf, fs->bounce, MESAFS_BLOCK_SIZE);
+    return 0;
+}
+
+int mesafs_write_block(mesafs_t *fs, uint32_t block_num, const void *buf) {
+    uint64_t off = fs->part_offset + mesafs_block_offset(block_num);
+    if (!fs->direct || is_aligned(buf))
+        return io_full(fs->fd, (void *)buf, MESAFS_BLOCK_SIZE, off, 1);
+    memcpy(fs->bounce, buf, MESAFS_BLOCK_SIZE);
+    return io_full(fs->fd, fs->bounce, MESAFS_BLOCK_SIZE, off, 1);
+}
+
+void *mesafs_buffer_get(mesafs_t *fs) {
+    if (fs->pool_count > 0)
+        return fs->pool[--fs->pool_count];
+    void *buf;
+    if (posix_memalign(&buf, MESAFS_IO_ALIGN, (size_t)MESAFS_RUN_BLOCKS * MESAFS_BLOCK_SIZE) != 0)
+        return NULL;
+    return buf;
+}
+
+void mesafs_buffer_put(mesafs_t *fs, void *buf) {
+    if (!buf)
+        return;
+    if (fs->pool_count < MESAFS_POOL_BUFFERS)
+        fs->pool[fs->pool_count++] = buf;
+    else
+        free(buf);
+}
+
+/* Un tramo desde un buffer sin alinear va bloque a bloque por el bounce */
+static int io_run(mesafs_t *fs, uint32_t first, uint32_t count, void *buf, int write) {
+    if (count > MESAFS_RUN_BLOCKS)
+        return -1;
+    if (fs->direct && !is_aligned(buf)) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t *b = (uint8_t *)buf + (size_t)i * MESAFS_BLOCK_SIZE;
+            if ((write ? mesafs_write_block(fs, first + i, b) : mesafs_read_block(fs, first + i, b)) != 0)
+                return -1;
+        }
+        return 0;
+    }
+    uint64_t off = fs->part_offset + mesafs_block_offset(first);
+    return io_full(fs->fd, buf, (size_t)count * MESAFS_BLOCK_SIZE, off, write);
+}
+
+int mesafs_read_run(mesafs_t *fs, uint32_t first, uint32_t count, void *buf) {
+    return io_run(fs, first, count, buf, 0);
+}
+
+int mesafs_write_run(mesafs_t *fs, uint32_t first, uint32_t count, const void *buf) {
+    return io_run(fs, first, count, (void *)buf, 1);
+}
+
+/* ==================== Bloqueos ==================== */
+
+static int lock_range(mesafs_t *fs, uint32_t block, uint32_t count, short type) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = fs->part_offset + mesafs_block_offset(block);
+    fl.l_len = (off_t)count << MESAFS_BLOCK_SHIFT;
+#ifdef F_OFD_SETLKW
+    int cmd = F_OFD_SETLKW;
+#else
+    int cmd = F_SETLKW;
+#endif
+    while (fcntl(fs->fd, cmd, &fl) != 0) {
+        if (errno == EINTR)
+            continue;
+        if (errno == EINVAL && cmd != F_SETLKW) {
+            cmd = F_SETLKW;     /* Kernel sin bloqueos OFD */
+            continue;
+        }
+        perror("fcntl lock");
+        return -1;
+    }
+    return 0;
+}
+
+int mesafs_lock(mesafs_t *fs, uint32_t block, uint32_t count) {
+    return lock_range(fs, block, count, F_WRLCK);
+}
+
+void mesafs_unlock(mesafs_t *fs, uint32_t block, uint32_t count) {
+    lock_range(fs, block, count, F_UNLCK);
+}
+
+/* ==================== Generaciones ==================== */
+
+/* Bloque (fuera del sistema de archivos) que marcan los cambios en curso */
+static uint32_t epoch_block(const mesafs_t *fs) {
+    return fs->sb.total_blocks;
+}
+
+/* 1 si otro proceso está a mitad de un cambio de metadatos */
+static int epoch_busy(mesafs_t *fs) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = fs->part_offset + mesafs_block_offset(epoch_block(fs));
+    fl.l_len = MESAFS_BLOCK_SIZE;
+#ifdef F_OFD_GETLK
+    if (fcntl(fs->fd, F_OFD_GETLK, &fl) == 0)
+        return fl.l_type != F_UNLCK;
+    fl.l_type = F_WRLCK;
+    fl.l_pid = 0;
+#endif
+    if (fcntl(fs->fd, F_GETLK, &fl) != 0)
+        return 1;
+    return fl.l_type != F_UNLCK;
+}
+
+/* Superbloque recién leído en fs->sb (bloque 0 entero: no cabe leer medio superbloque) */
+static int read_superblock(mesafs_t *fs) {
+    uint8_t block0[MESAFS_BLOCK_SIZE];
+    if (mesafs_read_block(fs, MESAFS_BLOCK_BITMAP_BLOCK, block0) != 0)
+        return -1;
+    memcpy(&fs->sb, block0, sizeof(fs->sb));
+    return 0;
+}
+
+int mesafs_epoch_enter(mesafs_t *fs) {
+    if (fs->epoch_depth++ > 0)
+        return 0;
+    if (lock_range(fs, epoch_block(fs), 1, F_RDLCK) != 0) {
+        fs->epoch_depth--;
+        return -1;
+    }
+    return 0;
+}
+
+int mesafs_epoch_exit(mesafs_t *fs) {
+    if (fs->epoch_depth == 0 || --fs->epoch_depth > 0)
+        return 0;
+
+    /* La generación cambia después de la última escritura y antes de soltar la marca */
+    uint8_t block0[MESAFS_BLOCK_SIZE];
+    int ret = -1;
+    if (mesafs_lock(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS) == 0) {
+        if (mesafs_read_block(fs, MESAFS_BLOCK_BITMAP_BLOCK, block0) == 0) {
+            memcpy(&fs->sb, block0, sizeof(fs->sb));
+            fs->sb.generation++;
+            memcpy(block0, &fs->sb, sizeof(fs->sb));
+            ret = mesafs_write_block(fs, MESAFS_BLOCK_BITMAP_BLOCK, block0);
+        }
+        mesafs_unlock(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS);
+    }
+    if (ret != 0)
+        printf("Failed to publish metadata change\n");
+    lock_range(fs, epoch_block(fs), 1, F_UNLCK);
+    return ret;
+}
+
+/*
+ * Primero la generación y luego la marca: un cambio que empiece después ya
+ * la encuentra leída, así que al terminar la mueve o sigue marcado.
+ */
+int mesafs_epoch_pin(mesafs_t *fs, uint32_t *epoch) {
+    for (int waited = 0; ; waited++) {
+        if (read_superblock(fs) != 0) {
+            printf("Failed to read superblock\n");
+            return -1;
+        }
+        if (!epoch_busy(fs))
+            break;
+        if (waited == MESAFS_EPOCH_WAIT_MS) {
+            printf("Metadata update still in progress after %d ms\n", MESAFS_EPOCH_WAIT_MS);
+            return -1;
+        }
+        struct timespec ms = { 0, 1000000 };
+        nanosleep(&ms, NULL);
+    }
+    *epoch = fs->sb.generation;
+    return 0;
+}
+
+int mesafs_epoch_check(mesafs_t *fs, uint32_t epoch) {
+    mesafs_superblock_t sb = fs->sb;
+    if (epoch_busy(fs) || read_superblock(fs) != 0)
+        return -1;
+    int changed = fs->sb.generation != epoch;
+    fs->sb = sb;
+    return changed ? -1 : 0;
+}
+
+/* Un cambio que cabe bajo un solo bloqueo: la marca, y el bloqueo de los bloques */
+static int begin_change(mesafs_t *fs, uint32_t block, uint32_t count) {
+    if (mesafs_epoch_enter(fs) != 0)
+        return -1;
+    if (mesafs_lock(fs, block, count) != 0) {
+        mesafs_epoch_exit(fs);
+        return -1;
+    }
+    return 0;
+}
+
+static void end_change(mesafs_t *fs, uint32_t block, uint32_t count) {
+    mesafs_unlock(fs, block, count);
+    mesafs_epoch_exit(fs);
+}
+
+int mesafs_read_inode(mesafs_t *fs, uint32_t inode_num, mesafs_inode_t *inode) {
+    if (inode_num >= fs->sb.total_inodes)
+        return -1;
+
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    if (mesafs_read_block(fs, mesafs_inode_block(inode_num), block) != 0)
+        return -1;
+
+    memcpy(inode, block + mesafs_inode_slot(inode_num) * sizeof(mesafs_inode_t), sizeof(*inode));
+    return 0;
+}
+
+/* Escribe un inodo; el llamador tiene el bloqueo de su bloque de la tabla */
+static int write_inode_locked(mesafs_t *fs, const mesafs_inode_t *inode) {
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    uint32_t block_num = mesafs_inode_block(inode->inode_num);
+    if (mesafs_read_block(fs, block_num, block) != 0)
+        return -1;
+
+    memcpy(block + mesafs_inode_slot(inode->inode_num) * sizeof(mesafs_inode_t), inode, sizeof(*inode));
+    return mesafs_write_block(fs, block_num, block);
+}
+
+int mesafs_write_inode(mesafs_t *fs, const mesafs_inode_t *inode) {
+    if (inode->inode_num >= fs->sb.total_inodes)
+        return -1;
+
+    /* El bloque de la tabla se comparte con otros inodos */
+    uint32_t block_num = mesafs_inode_block(inode->inode_num);
+    if (begin_change(fs, block_num, 1) != 0)
+        return -1;
+    int ret = write_inode_locked(fs, inode);
+    end_change(fs, block_num, 1);
+    return ret;
+}
+
+int mesafs_file_blocks(mesafs_t *fs, const mesafs_inode_t *inode,
+                       uint32_t *blocks, uint32_t max_blocks) {
+    uint32_t count = inode->blocks_used;
+    if (count > MESAFS_MAX_FILE_BLOCKS || count > max_blocks)
+        return -1;
+
+    uint32_t direct = count < MESAFS_DIRECT_BLOCKS ? count : MESAFS_DIRECT_BLOCKS;
+    memcpy(blocks, inode->direct_blocks, direct * sizeof(uint32_t));
+
+    if (count > MESAFS_DIRECT_BLOCKS) {
+        /* Sin bloque indirecto, todo lo que sigue a los directos es hueco */
+        uint32_t ptrs[MESAFS_PTRS_PER_BLOCK] = {0};
+        if (inode->indirect_block != 0 &&
+            (inode->indirect_block >= fs->sb.total_blocks ||
+             mesafs_read_block(fs, inode->indirect_block, ptrs) != 0))
+            return -1;
+        memcpy(blocks + MESAFS_DIRECT_BLOCKS, ptrs,
+               (count - MESAFS_DIRECT_BLOCKS) * sizeof(uint32_t));
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (blocks[i] != 0 && (blocks[i] < MESAFS_DATA_START || blocks[i] >= fs->sb.total_blocks))
+            return -1;
+    }
+
+    return count;
+}
+
+int mesafs_read_symlink(mesafs_t *fs, const mesafs_inode_t *inode, char *buf, uint32_t buf_len) {
+    if (inode->type != MESAFS_TYPE_SYMLINK || inode->size == 0 ||
+        inode->size >= buf_len || inode->size > MESAFS_BLOCK_SIZE)
+        return -1;
+
+    if (inode->blocks_used == 0) {
+        if (inode->size > MESAFS_FAST_SYMLINK_MAX)
+            return -1;
+        memcpy(buf, inode->direct_blocks, inode->size);
+    } else {
+        uint8_t block[MESAFS_BLOCK_SIZE];
+        uint32_t b = inode->direct_blocks[0];
+        if (b < MESAFS_DATA_START || b >= fs->sb.total_blocks || mesafs_read_block(fs, b, block) != 0)
+            return -1;
+        memcpy(buf, block, inode->size);
+    }
+    buf[inode->size] = '\0';
+    return inode->size;
+}
+
+int mesafs_read_file(mesafs_t *fs, const mesafs_inode_t *inode, uint64_t offset,
+                     void *buf, uint32_t len) {
+    if (offset >= inode->size)
+        return 0;
+    if (offset + len > inode->size)
+        len = inode->size - offset;
+
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS];
+    int nblocks = mesafs_file_blocks(fs, inode, blocks, MESAFS_MAX_FILE_BLOCKS);
+    if (nblocks < 0)
+        return -1;
+
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    uint8_t *out = buf;
+    uint32_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        uint32_t index = pos >> MESAFS_BLOCK_SHIFT;
+        uint32_t in_block = pos & (MESAFS_BLOCK_SIZE - 1);
+        uint32_t chunk = MESAFS_BLOCK_SIZE - in_block;
+        if (chunk > len - done)
+            chunk = len - done;
+
+        if (index >= (uint32_t)nblocks)
+            return -1;
+        if (blocks[index] == 0)
+            memset(out + done, 0, chunk);
+        else if (mesafs_read_block(fs, blocks[index], block) != 0)
+            return -1;
+        else
+            memcpy(out + done, block + in_block, chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+/* ==================== Entradas de directorio ==================== */
+
+/*
+ * Los recorridos de un bloque de directorio comparan a la vez un campo de
+ * 32 bits de varias entradas (a 64 bytes de distancia): AVX2 las recoge de
+ * 8 en 8 con un gather, SSE2 de 4 en 4. El resultado es una máscara con un
+ * bit por entrada, así que buscar un hueco o un nombre es un ctz sobre ella.
+ */
+#define DIRENT_GROUP    64      /* Entradas por máscara */
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*
+ * Máscara de las n entradas desde p (n múltiplo de 8, como mucho
+ * DIRENT_GROUP) cuyo campo en off, con los bits de mask, vale key.
+ */
+static uint64_t dirent_mask(const uint8_t *p, uint32_t n, size_t off, uint32_t mask, uint32_t key) {
+    uint64_t bits = 0;
+    p += off;
+#if defined(__AVX2__)
+    const __m256i idx = _mm256_setr_epi32(0, 64, 128, 192, 256, 320, 384, 448);
+    const __m256i vmask = _mm256_set1_epi32(mask), vkey = _mm256_set1_epi32(key);
+    for (uint32_t i = 0; i < n; i += 8, p += 8 * sizeof(mesafs_dirent_t)) {
+        __m256i v = _mm256_i32gather_epi32((const int *)p, idx, 1);
+        v = _mm256_cmpeq_epi32(_mm256_and_si256(v, vmask), vkey);
+        bits |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(v)) << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i vmask = _mm_set1_epi32(mask), vkey = _mm_set1_epi32(key);
+    for (uint32_t i = 0; i < n; i += 4, p += 4 * sizeof(mesafs_dirent_t)) {
+        __m128i v = _mm_setr_epi32(load32(p), load32(p + 64), load32(p + 128), load32(p + 192));
+        v = _mm_cmpeq_epi32(_mm_and_si128(v, vmask), vkey);
+        bits |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(v)) << i;
+    }
+#else
+    for (uint32_t i = 0; i < n; i++, p += sizeof(mesafs_dirent_t))
+        bits |= (uint64_t)((load32(p) & mask) == key) << i;
+#endif
+    return bits;
+}
+
+/* Primera entrada desde start con el campo inode a 0 (free) o no (!free) */
+static int dirent_scan(const uint8_t *block, int start, int free) {
+    for (uint32_t g = start & ~(DIRENT_GROUP - 1); g < MESAFS_DIRENTS_PER_BLOCK; g += DIRENT_GROUP) {
+        uint32_t n = MESAFS_DIRENTS_PER_BLOCK - g < DIRENT_GROUP ? MESAFS_DIRENTS_PER_BLOCK - g
+                                                                 : DIRENT_GROUP;
+        uint64_t bits = dirent_mask(block + g * sizeof(mesafs_dirent_t), n,
+                                    offsetof(mesafs_dirent_t, inode), 0xFFFFFFFF, 0);
+        if (!free)
+            bits = ~bits & (n == 64 ? ~0ull : (1ull << n) - 1);
+        if (g < (uint32_t)start)
+            bits &= ~0ull << (start - g);
+        if (bits)
+            return g + __builtin_ctzll(bits);
+    }
+    return -1;
+}
+
+int mesafs_dirent_free(const void *dir_block, int start) {
+    return dirent_scan(dir_block, start, 1);
+}
+
+int mesafs_dirent_used(const void *dir_block, int start) {
+    return dirent_scan(dir_block, start, 0);
+}
+
+int mesafs_dirent_find(const void *dir_block, const char *name, size_t name_len) {
+    if (name_len == 0 || name_len > MESAFS_MAX_FILENAME)
+        return -1;
+    const uint8_t *block = dir_block;
+
+    /*
+     * Filtro: los 4 primeros bytes del nombre, con el '\0' si es más corto
+     * (lo que sigue al terminador no tiene por qué estar a cero). name_len
+     * del disco no se usa: el nombre vale hasta el primer '\0'.
+     */
+    uint8_t prefix[4] = {0};
+    size_t cmp = name_len < 4 ? name_len + 1 : 4;
+    memcpy(prefix, name, cmp < name_len ? cmp : name_len);
+    uint32_t key = load32(prefix);
+    uint32_t mask = cmp == 4 ? 0xFFFFFFFF : (1u << (cmp * 8)) - 1;
+
+    for (uint32_t g = 0; g < MESAFS_DIRENTS_PER_BLOCK; g += DIRENT_GROUP) {
+        uint32_t n = MESAFS_DIRENTS_PER_BLOCK - g < DIRENT_GROUP ? MESAFS_DIRENTS_PER_BLOCK - g
+                                                                 : DIRENT_GROUP;
+        const uint8_t *p = block + g * sizeof(mesafs_dirent_t);
+        uint64_t bits = dirent_mask(p, n, offsetof(mesafs_dirent_t, name), mask, key) &
+                        ~dirent_mask(p, n, offsetof(mesafs_dirent_t, inode), 0xFFFFFFFF, 0);
+        while (bits) {
+            int i = __builtin_ctzll(bits);
+            const mesafs_dirent_t *de = (const mesafs_dirent_t *)p + i;
+            if (memcmp(de->name, name, name_len) == 0 && de->name[name_len] == '\0')
+                return g + i;
+            bits &= bits - 1;
+        }
+    }
+    return -1;
+}
+
+/* ==================== Directorio raíz y asignación ==================== */
+
+/*
+ * Busca en el directorio raíz la entrada name (o, con name NULL, un hueco
+ * libre). Deja en dir_block el bloque leído, su número en block_num y su
+ * bloque lógico dentro del directorio en index.
+ * Retorna el índice de la entrada, o -1.
+ */
+static int find_dirent(mesafs_t *fs, const char *name, uint8_t *dir_block, uint32_t *block_num,
+                       uint32_t *index) {
+    mesafs_inode_t root;
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS];
+    int nblocks;
+    if (mesafs_read_inode(fs, fs->sb.root_inode, &root) != 0 ||
+        (nblocks = mesafs_file_blocks(fs, &root, blocks, MESAFS_MAX_FILE_BLOCKS)) < 0)
+        return -1;
+
+    size_t name_len = name ? strlen(name) : 0;
+    for (int b = 0; b < nblocks; b++) {
+        if (blocks[b] == 0 || mesafs_read_block(fs, blocks[b], dir_block) != 0)
+            continue;
+        int i = name ? mesafs_dirent_find(dir_block, name, name_len)
+                     : mesafs_dirent_free(dir_block, 0);
+        if (i >= 0) {
+            *block_num = blocks[b];
+            *index = b;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Relee superbloque y bitmaps con el bloqueo de asignación tomado: otro
+ * proceso puede haberlos cambiado desde mesafs_open.
+ */
+static int read_bitmaps(mesafs_t *fs, uint8_t *block0, uint8_t *inode_bitmap) {
+    if (mesafs_read_block(fs, MESAFS_BLOCK_BITMAP_BLOCK, block0) != 0 ||
+        mesafs_read_block(fs, MESAFS_INODE_BITMAP_BLOCK, inode_bitmap) != 0) {
+        printf("Failed to read bitmaps\n");
+        return -1;
+    }
+    memcpy(&fs->sb, block0, sizeof(fs->sb));
+    return 0;
+}
+
+/* Escribe bitmap de inodos y bloque 0 (superbloque de fs->sb y bitmap de bloques) */
+static int write_bitmaps(mesafs_t *fs, uint8_t *block0, const uint8_t *inode_bitmap) {
+    memcpy(block0, &fs->sb, sizeof(fs->sb));
+    if (mesafs_write_block(fs, MESAFS_INODE_BITMAP_BLOCK, inode_bitmap) != 0 ||
+        mesafs_write_block(fs, MESAFS_BLOCK_BITMAP_BLOCK, block0) != 0) {
+        printf("Failed to write bitmaps\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Bloques que cubre el bitmap de bloques */
+static uint32_t block_limit(const mesafs_t *fs) {
+    return fs->sb.total_blocks < MESAFS_BLOCK_BITMAP_BITS ? fs->sb.total_blocks
+                                                          : MESAFS_BLOCK_BITMAP_BITS;
+}
+
+/*
+ * Tabla de referencias, con el bloqueo de asignación (o el de la partición)
+ * tomado y fs->sb recién leído. Sin snapshots no existe y *rc queda NULL.
+ */
+static int read_refcounts(mesafs_t *fs, uint8_t **rc) {
+    *rc = NULL;
+    if (!(fs->sb.features & MESAFS_FEATURE_SNAPSHOTS))
+        return 0;
+    *rc = mesafs_buffer_get(fs);
+    if (!*rc || mesafs_read_run(fs, fs->sb.refcount_block, MESAFS_REFCOUNT_BLOCKS, *rc) != 0) {
+        printf("Failed to read block reference counts\n");
+        mesafs_buffer_put(fs, *rc);
+        *rc = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int write_refcounts(mesafs_t *fs, const uint8_t *rc) {
+    if (mesafs_write_run(fs, fs->sb.refcount_block, MESAFS_REFCOUNT_BLOCKS, rc) != 0) {
+        printf("Failed to write block reference counts\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Quita una referencia a block; sin ninguna, vuelve al bitmap */
+static void drop_ref(mesafs_t *fs, uint8_t *rc, uint8_t *block_bitmap, uint32_t block) {
+    if (block == 0 || block >= block_limit(fs) || !mesafs_bitmap_test(block_bitmap, block))
+        return;
+    if (rc && rc[block] > 1) {
+        rc[block]--;
+        return;
+    }
+    if (rc)
+        rc[block] = 0;
+    mesafs_bitmap_clear(block_bitmap, block);
+    fs->sb.free_blocks++;
+}
+
+/* Primer tramo de count bloques libres seguidos, o 0 */
+static uint32_t find_free_run(const mesafs_t *fs, const uint8_t *block_bitmap, uint32_t count) {
+    uint32_t run = 0;
+    for (uint32_t i = MESAFS_DATA_START + 1; i < block_limit(fs); i++) {
+        run = mesafs_bitmap_test(block_bitmap, i) ? 0 : run + 1;
+        if (run == count)
+            return i + 1 - count;
+    }
+    return 0;
+}
+
+/* Marca count bloques seguidos desde first como usados, con una referencia */
+static void take_run(mesafs_t *fs, uint8_t *rc, uint8_t *block_bitmap, uint32_t first, uint32_t count) {
+    for (uint32_t b = first; b < first + count; b++) {
+        mesafs_bitmap_set(block_bitmap, b);
+        if (rc)
+            rc[b] = 1;
+    }
+    fs->sb.free_blocks -= count;
+}
+
+int mesafs_alloc(mesafs_t *fs, uint32_t count, uint32_t *blocks) {
+    uint8_t block0[MESAFS_BLOCK_SIZE], inode_bitmap[MESAFS_BLOCK_SIZE];
+    if (begin_change(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS) != 0)
+        return -1;
+    int ret = -1;
+    if (read_bitmaps(fs, block0, inode_bitmap) != 0)
+        goto out;
+    uint8_t *block_bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+
+    uint32_t ino = 0;
+    for (uint32_t i = 2; i < fs->sb.total_inodes; i++) {
+        if (!mesafs_bitmap_test(inode_bitmap, i)) {
+            ino = i;
+            break;
+        }
+    }
+    if (ino == 0) {
+        printf("No free inodes\n");
+        goto out;
+    }
+
+    uint32_t found = 0;
+    for (uint32_t i = MESAFS_DATA_START + 1; i < block_limit(fs) && found < count; i++) {
+        if (!mesafs_bitmap_test(block_bitmap, i))
+            blocks[found++] = i;
+    }
+    if (found < count) {
+        printf("Not enough free blocks (need %u, got %u)\n", count, found);
+        goto out;
+    }
+
+    uint8_t *rc;
+    if (read_refcounts(fs, &rc) != 0)
+        goto out;
+    for (uint32_t i = 0; i < count; i++) {
+        mesafs_bitmap_set(block_bitmap, blocks[i]);
+        if (rc)
+            rc[blocks[i]] = 1;
+    }
+    mesafs_bitmap_set(inode_bitmap, ino);
+    fs->sb.free_blocks -= count;
+    fs->sb.free_inodes--;
+    if ((!rc || write_refcounts(fs, rc) == 0) && write_bitmaps(fs, block0, inode_bitmap) == 0)
+        ret = ino;
+    mesafs_buffer_put(fs, rc);
+out:
+    end_change(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS);
+    return ret;
+}
+
+int mesafs_free(mesafs_t *fs, uint32_t ino, const uint32_t *blocks, uint32_t count) {
+    uint8_t block0[MESAFS_BLOCK_SIZE], inode_bitmap[MESAFS_BLOCK_SIZE];
+    if (begin_change(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS) != 0)
+        return -1;
+    int ret = -1;
+    uint8_t *rc;
+    if (read_bitmaps(fs, block0, inode_bitmap) == 0 && read_refcounts(fs, &rc) == 0) {
+        /* Los bloques que siguen en un snapshot solo pierden una referencia */
+        uint8_t *block_bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+        for (uint32_t i = 0; i < count; i++)
+            drop_ref(fs, rc, block_bitmap, blocks[i]);
+        if (ino != 0 && mesafs_bitmap_test(inode_bitmap, ino)) {
+            mesafs_bitmap_clear(inode_bitmap, ino);
+            fs->sb.free_inodes++;
+        }
+        if (!rc || write_refcounts(fs, rc) == 0)
+            ret = write_bitmaps(fs, block0, inode_bitmap);
+        mesafs_buffer_put(fs, rc);
+    }
+    end_change(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS);
+    return ret;
+}
+
+int mesafs_reserve(mesafs_t *fs, uint32_t goal, uint32_t count, uint32_t *first) {
+    uint8_t block0[MESAFS_BLOCK_SIZE], inode_bitmap[MESAFS_BLOCK_SIZE];
+    if (count == 0 || begin_change(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS) != 0)
+        return -1;
+    int ret = -1;
+    if (read_bitmaps(fs, block0, inode_bitmap) != 0)
+        goto out;
+    uint8_t *block_bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+    uint32_t limit = block_limit(fs);
+
+    /* Detrás de goal vale cualquier longitud: el archivo sigue sin cortes */
+    uint32_t start = 0, len = 0;
+    if (goal > MESAFS_DATA_START && goal < limit && !mesafs_bitmap_test(block_bitmap, goal)) {
+        start = goal;
+        while (len < count && start + len < limit && !mesafs_bitmap_test(block_bitmap, start + len))
+            len++;
+    } else {
+        uint32_t run = 0;
+        for (uint32_t i = MESAFS_DATA_START + 1; i < limit && len < count; i++) {
+            run = mesafs_bitmap_test(block_bitmap, i) ? 0 : run + 1;
+            if (run > len) {
+                len = run;
+                start = i + 1 - run;
+            }
+        }
+    }
+    if (len == 0) {
+        printf("No free blocks\n");
+        goto out;
+    }
+
+    uint8_t *rc;
+    if (read_refcounts(fs, &rc) != 0)
+        goto out;
+    take_run(fs, rc, block_bitmap, start, len);
+    if ((!rc || write_refcounts(fs, rc) == 0) && write_bitmaps(fs, block0, inode_bitmap) == 0) {
+        *first = start;
+        ret = len;
+    }
+    mesafs_buffer_put(fs, rc);
+out:
+    end_change(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS);
+    return ret;
+}
+
+/* Bloque donde escribir el bloque lógico index del directorio raíz */
+static uint32_t root_write_block(mesafs_t *fs, uint32_t index) {
+    mesafs_inode_t root;
+    if (mesafs_read_inode(fs, fs->sb.root_inode, &root) != 0)
+        return 0;
+    root.inode_num = fs->sb.root_inode;
+    return mesafs_cow_block(fs, &root, index);
+}
+
+/* Añade la entrada name -> ino; el llamador tiene el bloqueo del directorio */
+static int add_dirent(mesafs_t *fs, const char *name, uint32_t ino, uint8_t type) {
+    size_t name_len = strlen(name);
+    uint8_t dir_block[MESAFS_BLOCK_SIZE];
+    uint32_t dir_block_num, index;
+    int slot = find_dirent(fs, NULL, dir_block, &dir_block_num, &index);
+    if (slot < 0) {
+        printf("Root directory full\n");
+        return -1;
+    }
+    if ((dir_block_num = root_write_block(fs, index)) == 0)
+        return -1;
+    mesafs_dirent_t *de = (mesafs_dirent_t *)dir_block + slot;
+    memset(de, 0, sizeof(*de));
+    de->inode = ino;
+    de->type = type;
+    de->name_len = name_len;
+    memcpy(de->name, name, name_len);
+    return mesafs_write_block(fs, dir_block_num, dir_block);
+}
+
+static int valid_name(const char *name) {
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > MESAFS_MAX_FILENAME) {
+        printf("Invalid file name: %s\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+int mesafs_link(mesafs_t *fs, const char *name, uint32_t ino, uint8_t type) {
+    if (!valid_name(name) || begin_change(fs, MESAFS_LOCK_DIR, 1) != 0)
+        return -1;
+    int ret = add_dirent(fs, name, ino, type);
+    end_change(fs, MESAFS_LOCK_DIR, 1);
+    return ret;
+}
+
+/* Suma delta a los enlaces de ino bajo el bloqueo de su bloque de la tabla */
+static int adjust_links(mesafs_t *fs, uint32_t ino, int delta) {
+    uint32_t inode_block = mesafs_inode_block(ino);
+    mesafs_inode_t inode;
+    if (mesafs_lock(fs, inode_block, 1) != 0)
+        return -1;
+    int ret = -1;
+    if (mesafs_read_inode(fs, ino, &inode) != 0 || !(inode.flags & MESAFS_FLAG_USED)) {
+        printf("Inode %u is not in use\n", ino);
+    } else if (delta > 0 && inode.links >= UINT16_MAX) {
+        printf("Too many links to inode %u\n", ino);
+    } else {
+        inode.inode_num = ino;
+        inode.links += delta;
+        ret = write_inode_locked(fs, &inode);
+    }
+    mesafs_unlock(fs, inode_block, 1);
+    return ret;
+}
+
+int mesafs_hardlink(mesafs_t *fs, const char *target, const char *name) {
+    if (!valid_name(name) || begin_change(fs, MESAFS_LOCK_DIR, 1) != 0)
+        return -1;
+
+    /* Con el directorio bloqueado nadie puede borrar target entre medias */
+    uint8_t dir_block[MESAFS_BLOCK_SIZE];
+    uint32_t block_num, index;
+    int ret = -1;
+    int slot = find_dirent(fs, target, dir_block, &block_num, &index);
+    mesafs_dirent_t de;
+    if (slot >= 0)
+        memcpy(&de, dir_block + slot * sizeof(mesafs_dirent_t), sizeof(de));
+    if (slot < 0) {
+        printf("%s: no such file\n", target);
+    } else if (de.type == MESAFS_TYPE_DIR) {
+        printf("%s: cannot hard-link a directory\n", target);
+    } else if (find_dirent(fs, name, dir_block, &block_num, &index) >= 0) {
+        printf("%s: file exists\n", name);
+    } else if (adjust_links(fs, de.inode, 1) == 0) {
+        /* El enlace se cuenta antes de que exista la entrada: si falla algo, sobra uno */
+        ret = add_dirent(fs, name, de.inode, de.type);
+        if (ret != 0)
+            adjust_links(fs, de.inode, -1);
+    }
+    end_change(fs, MESAFS_LOCK_DIR, 1);
+    return ret;
+}
+
+int mesafs_lookup(mesafs_t *fs, const char *name, mesafs_dirent_t *de) {
+    uint8_t dir_block[MESAFS_BLOCK_SIZE];
+    uint32_t block_num, index;
+    int slot = find_dirent(fs, name, dir_block, &block_num, &index);
+    if (slot < 0)
+        return -1;
+    memcpy(de, dir_block + slot * sizeof(mesafs_dirent_t), sizeof(*de));
+    return 0;
+}
+
+static int create_file(mesafs_t *fs, const char *name, uint32_t size) {
+    uint32_t nblocks = mesafs_blocks_for(size);
+    if (nblocks == 0) nblocks = 1;
+    if (nblocks > MESAFS_MAX_FILE_BLOCKS) {
+        printf("File too large (max %u blocks)\n", (unsigned)MESAFS_MAX_FILE_BLOCKS);
+        return -1;
+    }
+    uint32_t needs_indirect = nblocks > MESAFS_DIRECT_BLOCKS;
+
+    /* Inodo y bloques quedan reservados en disco; lo demás va sin bloqueo */
+    uint32_t allocated[MESAFS_MAX_FILE_BLOCKS + 1];
+    uint32_t to_allocate = nblocks + needs_indirect;
+    int ino = mesafs_alloc(fs, to_allocate, allocated);
+    if (ino < 0)
+        return -1;
+
+    /* Bloques a cero; el indirecto (si hay) va primero */
+    static const uint8_t zero_block[MESAFS_BLOCK_SIZE];
+    const uint32_t *data = allocated + needs_indirect;
+    int failed = 0;
+    for (uint32_t i = 0; i < nblocks && !failed; i++)
+        failed = mesafs_write_block(fs, data[i], zero_block) != 0;
+
+    mesafs_inode_t inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.inode_num = ino;
+    inode.type = MESAFS_TYPE_FILE;
+    inode.flags = MESAFS_FLAG_USED;
+    inode.links = 1;
+    inode.size = size;
+    inode.blocks_used = nblocks;
+    for (uint32_t i = 0; i < nblocks && i < MESAFS_DIRECT_BLOCKS; i++)
+        inode.direct_blocks[i] = data[i];
+    if (!failed && needs_indirect) {
+        uint32_t ptrs[MESAFS_PTRS_PER_BLOCK] = {0};
+        memcpy(ptrs, data + MESAFS_DIRECT_BLOCKS, (nblocks - MESAFS_DIRECT_BLOCKS) * sizeof(uint32_t));
+        inode.indirect_block = allocated[0];
+        failed = mesafs_write_block(fs, allocated[0], ptrs) != 0;
+    }
+
+    /* La entrada al final: hasta entonces el archivo no es visible */
+    if (failed || mesafs_write_inode(fs, &inode) != 0 ||
+        mesafs_link(fs, name, ino, MESAFS_TYPE_FILE) != 0) {
+        mesafs_free(fs, ino, allocated, to_allocate);
+        return -1;
+    }
+    return ino;
+}
+
+int mesafs_create_file(mesafs_t *fs, const char *name, uint32_t size) {
+    if (mesafs_epoch_enter(fs) != 0)
+        return -1;
+    int ino = create_file(fs, name, size);
+    mesafs_epoch_exit(fs);
+    return ino;
+}
+
+/* ==================== Escritura en flujo ==================== */
+
+/*
+ * Cada reserva pide al menos lo ya escrito, así que un archivo de n bloques
+ * queda en O(log n) tramos aunque compita con otros escritores; detrás de
+ * la reserva anterior, si sigue libre, no hay ni corte.
+ */
+static int stream_reserve(mesafs_stream_t *s, uint32_t need) {
+    uint32_t want = need > MESAFS_STREAM_WINDOW ? need : MESAFS_STREAM_WINDOW;
+    if (want < s->nblocks)
+        want = s->nblocks;
+    if (want > MESAFS_MAX_FILE_BLOCKS + 1 - s->nblocks)
+        want = MESAFS_MAX_FILE_BLOCKS + 1 - s->nblocks;
+    int got = mesafs_reserve(s->fs, s->next, want, &s->next);
+    if (got < 0)
+        return -1;
+    s->left = got;
+    return 0;
+}
+
+/* Escribe la ventana (bloques completos) en la reserva, ampliándola si se acaba */
+static int stream_flush(mesafs_stream_t *s) {
+    uint32_t count = mesafs_blocks_for(s->buffered);
+    for (uint32_t done = 0; done < count; ) {
+        if (s->left == 0 && stream_reserve(s, count - done) != 0)
+            return -1;
+        uint32_t n = count - done < s->left ? count - done : s->left;
+        if (mesafs_write_run(s->fs, s->next, n, s->buf + mesafs_block_offset(done)) != 0) {
+            printf("Failed to write blocks %u-%u\n", s->next, s->next + n - 1);
+            return -1;
+        }
+        for (uint32_t i = 0; i < n; i++)
+            s->blocks[s->nblocks++] = s->next + i;
+        s->next += n;
+        s->left -= n;
+        done += n;
+    }
+    s->buffered = 0;
+    return 0;
+}
+
+/* Devuelve al bitmap lo reservado que no se ha usado */
+static int stream_trim(mesafs_stream_t *s) {
+    uint32_t unused[MESAFS_MAX_FILE_BLOCKS + 1];
+    uint32_t count = s->left;
+    if (count == 0)
+        return 0;
+    for (uint32_t i = 0; i < count; i++)
+        unused[i] = s->next + i;
+    s->left = 0;
+    return mesafs_free(s->fs, 0, unused, count);
+}
+
+int mesafs_stream_open(mesafs_t *fs, mesafs_stream_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->fs = fs;
+    s->ino = -1;
+    if (!(s->buf = mesafs_buffer_get(fs))) {
+        printf("Out of memory\n");
+        return -1;
+    }
+    if ((s->ino = mesafs_alloc(fs, 0, NULL)) < 0) {
+        mesafs_stream_abort(s);
+        return -1;
+    }
+    return 0;
+}
+
+int mesafs_stream_write(mesafs_stream_t *s, const void *data, size_t len) {
+    const uint32_t window = mesafs_block_offset(MESAFS_STREAM_WINDOW);
+    if (s->size + len > mesafs_block_offset(MESAFS_MAX_FILE_BLOCKS)) {
+        printf("File too large (max %u blocks)\n", (unsigned)MESAFS_MAX_FILE_BLOCKS);
+        return -1;
+    }
+    const uint8_t *p = data;
+    while (len > 0) {
+        size_t n = len < window - s->buffered ? len : window - s->buffered;
+        memcpy(s->buf + s->buffered, p, n);
+        s->buffered += n;
+        s->size += n;
+        p += n;
+        len -= n;
+        if (s->buffered == window && stream_flush(s) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int mesafs_stream_close(mesafs_stream_t *s, const char *name) {
+    /* Cola a cero hasta fin de bloque; vacío ocupa un bloque, como en mesafs_create_file */
+    uint32_t padded = s->nblocks == 0 && s->buffered == 0
+        ? MESAFS_BLOCK_SIZE : mesafs_block_offset(mesafs_blocks_for(s->buffered));
+    memset(s->buf + s->buffered, 0, padded - s->buffered);
+    s->buffered = padded;
+
+    /* Los lectores ven el archivo entero o nada */
+    if (mesafs_epoch_enter(s->fs) != 0) {
+        mesafs_stream_abort(s);
+        return -1;
+    }
+    uint32_t indirect = 0;
+    if (stream_flush(s) != 0)
+        goto fail;
+    if (s->nblocks > MESAFS_DIRECT_BLOCKS) {
+        if (s->left == 0 && stream_reserve(s, 1) != 0)
+            goto fail;
+        indirect = s->next++;
+        s->left--;
+        uint32_t *ptrs = (uint32_t *)s->buf;
+        memset(ptrs, 0, MESAFS_BLOCK_SIZE);
+        memcpy(ptrs, s->blocks + MESAFS_DIRECT_BLOCKS,
+               (s->nblocks - MESAFS_DIRECT_BLOCKS) * sizeof(uint32_t));
+        if (mesafs_write_block(s->fs, indirect, ptrs) != 0)
+            goto fail;
+    }
+    if (stream_trim(s) != 0)
+        goto fail;
+
+    mesafs_inode_t inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.inode_num = s->ino;
+    inode.type = MESAFS_TYPE_FILE;
+    inode.flags = MESAFS_FLAG_USED;
+    inode.links = 1;
+    inode.size = s->size;
+    inode.blocks_used = s->nblocks;
+    for (uint32_t i = 0; i < s->nblocks && i < MESAFS_DIRECT_BLOCKS; i++)
+        inode.direct_blocks[i] = s->blocks[i];
+    inode.indirect_block = indirect;
+
+    /* La entrada al final: hasta entonces el archivo no es visible */
+    if (mesafs_write_inode(s->fs, &inode) != 0 ||
+        mesafs_link(s->fs, name, s->ino, MESAFS_TYPE_FILE) != 0)
+        goto fail;
+    int ino = s->ino;
+    mesafs_epoch_exit(s->fs);
+    mesafs_buffer_put(s->fs, s->buf);
+    s->buf = NULL;
+    s->ino = -1;
+    return ino;
+fail:
+    if (indirect)
+        mesafs_free(s->fs, 0, &indirect, 1);
+    mesafs_stream_abort(s);
+    mesafs_epoch_exit(s->fs);
+    return -1;
+}
+
+void mesafs_stream_abort(mesafs_stream_t *s) {
+    stream_trim(s);
+    if (s->ino >= 0 || s->nblocks > 0)
+        mesafs_free(s->fs, s->ino >= 0 ? s->ino : 0, s->blocks, s->nblocks);
+    mesafs_buffer_put(s->fs, s->buf);
+    s->buf = NULL;
+    s->ino = -1;
+    s->nblocks = 0;
+}
+
+/* Bloques de un inodo con el indirecto al final (los symlinks rápidos no tienen) */
+static int inode_blocks(mesafs_t *fs, const mesafs_inode_t *inode, uint32_t *blocks) {
+    if (inode->type == MESAFS_TYPE_SYMLINK && inode->blocks_used == 0)
+        return 0;
+    int nblocks = mesafs_file_blocks(fs, inode, blocks, MESAFS_MAX_FILE_BLOCKS);
+    if (nblocks > MESAFS_DIRECT_BLOCKS && inode->indirect_block != 0)
+        blocks[nblocks++] = inode->indirect_block;
+    return nblocks;
+}
+
+static int unlink_entry(mesafs_t *fs, const char *name) {
+    if (mesafs_lock(fs, MESAFS_LOCK_DIR, 1) != 0)
+        return -1;
+    uint8_t dir_block[MESAFS_BLOCK_SIZE];
+    uint32_t dir_block_num, index;
+    int slot = find_dirent(fs, name, dir_block, &dir_block_num, &index);
+    uint32_t ino = 0;
+    if (slot >= 0 && (dir_block_num = root_write_block(fs, index)) != 0) {
+        mesafs_dirent_t *de = (mesafs_dirent_t *)dir_block + slot;
+        ino = de->inode;
+        memset(de, 0, sizeof(*de));
+        if (mesafs_write_block(fs, dir_block_num, dir_block) != 0)
+            ino = 0;
+    }
+    mesafs_unlock(fs, MESAFS_LOCK_DIR, 1);
+    if (ino == 0)
+        return -1;
+
+    /* Otros nombres siguen apuntando al inodo */
+    uint32_t inode_block = mesafs_inode_block(ino);
+    mesafs_inode_t inode;
+    if (mesafs_lock(fs, inode_block, 1) != 0)
+        return -1;
+    if (mesafs_read_inode(fs, ino, &inode) != 0) {
+        mesafs_unlock(fs, inode_block, 1);
+        return -1;
+    }
+    inode.inode_num = ino;
+    if (inode.links > 1) {
+        inode.links--;
+        int ret = write_inode_locked(fs, &inode);
+        mesafs_unlock(fs, inode_block, 1);
+        return ret;
+    }
+
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS + 1];
+    int nblocks = inode_blocks(fs, &inode, blocks);
+    if (nblocks < 0) {
+        mesafs_unlock(fs, inode_block, 1);
+        return -1;
+    }
+
+    memset(&inode, 0, sizeof(inode));
+    inode.inode_num = ino;
+    int ret = write_inode_locked(fs, &inode);
+    mesafs_unlock(fs, inode_block, 1);
+    if (ret != 0)
+        return -1;
+    return mesafs_free(fs, ino, blocks, nblocks);
+}
+
+int mesafs_unlink(mesafs_t *fs, const char *name) {
+    if (mesafs_epoch_enter(fs) != 0)
+        return -1;
+    int ret = unlink_entry(fs, name);
+    mesafs_epoch_exit(fs);
+    return ret;
+}
+
+/* ==================== Snapshots ==================== */
+
+/*
+ * Copia block a un bloque nuevo si tiene más de una referencia. Retorna el
+ * bloque donde escribir (block si no está compartido), o 0. La referencia
+ * del original se quita después, con mesafs_free, cuando el puntero ya va a
+ * la copia: si el proceso muere entre medias sobra una referencia, pero
+ * ningún snapshot ve el cambio.
+ */
+static uint32_t unshare_block(mesafs_t *fs, uint32_t block) {
+    uint8_t block0[MESAFS_BLOCK_SIZE], inode_bitmap[MESAFS_BLOCK_SIZE], data[MESAFS_BLOCK_SIZE];
+    if (mesafs_lock(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS) != 0)
+        return 0;
+    uint32_t ret = 0;
+    uint8_t *rc = NULL;
+    if (read_bitmaps(fs, block0, inode_bitmap) != 0 || read_refcounts(fs, &rc) != 0)
+        goto out;
+    if (!rc || block >= block_limit(fs) || rc[block] <= 1) {
+        ret = block;
+        goto out;
+    }
+
+    uint8_t *block_bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+    uint32_t copy = find_free_run(fs, block_bitmap, 1);
+    if (copy == 0) {
+        printf("No free block to copy shared block %u\n", block);
+        goto out;
+    }
+    if (mesafs_read_block(fs, block, data) != 0 || mesafs_write_block(fs, copy, data) != 0) {
+        printf("Failed to copy shared block %u\n", block);
+        goto out;
+    }
+    mesafs_bitmap_set(block_bitmap, copy);
+    rc[copy] = 1;
+    fs->sb.free_blocks--;
+    if (write_refcounts(fs, rc) == 0 && write_bitmaps(fs, block0, inode_bitmap) == 0)
+        ret = copy;
+out:
+    mesafs_buffer_put(fs, rc);
+    mesafs_unlock(fs, MESAFS_LOCK_ALLOC, MESAFS_LOCK_ALLOC_BLOCKS);
+    return ret;
+}
+
+static uint32_t cow_block(mesafs_t *fs, mesafs_inode_t *inode, uint32_t index) {
+    if (index >= MESAFS_MAX_FILE_BLOCKS)
+        return 0;
+
+    if (index < MESAFS_DIRECT_BLOCKS) {
+        uint32_t old = inode->direct_blocks[index];
+        uint32_t copy = old ? unshare_block(fs, old) : 0;
+        if (copy == 0 || copy == old)
+            return copy;
+        inode->direct_blocks[index] = copy;
+        if (mesafs_write_inode(fs, inode) != 0) {
+            inode->direct_blocks[index] = old;
+            mesafs_free(fs, 0, &copy, 1);
+            return 0;
+        }
+        mesafs_free(fs, 0, &old, 1);
+        return copy;
+    }
+
+    /* El puntero está en el bloque indirecto, que también puede estar compartido */
+    uint32_t old_ind = inode->indirect_block;
+    uint32_t ind = old_ind ? unshare_block(fs, old_ind) : 0;
+    if (ind == 0)
+        return 0;
+    if (ind != old_ind) {
+        inode->indirect_block = ind;
+        if (mesafs_write_inode(fs, inode) != 0) {
+            inode->indirect_block = old_ind;
+            mesafs_free(fs, 0, &ind, 1);
+            return 0;
+        }
+        mesafs_free(fs, 0, &old_ind, 1);
+    }
+
+    uint32_t ptrs[MESAFS_PTRS_PER_BLOCK];
+    if (mesafs_read_block(fs, ind, ptrs) != 0)
+        return 0;
+    uint32_t old = ptrs[index - MESAFS_DIRECT_BLOCKS];
+    uint32_t copy = old ? unshare_block(fs, old) : 0;
+    if (copy == 0 || copy == old)
+        return copy;
+    ptrs[index - MESAFS_DIRECT_BLOCKS] = copy;
+    if (mesafs_write_block(fs, ind, ptrs) != 0) {
+        mesafs_free(fs, 0, &copy, 1);
+        return 0;
+    }
+    mesafs_free(fs, 0, &old, 1);
+    return copy;
+}
+
+uint32_t mesafs_cow_block(mesafs_t *fs, mesafs_inode_t *inode, uint32_t index) {
+    if (mesafs_epoch_enter(fs) != 0)
+        return 0;
+    uint32_t block = cow_block(fs, inode, index);
+    mesafs_epoch_exit(fs);
+    return block;
+}
+
+/*
+ * Suma (delta 1) o quita (delta -1) una referencia a cada bloque de los
+ * inodos en uso de table, que tiene la forma de los bloques 1-9: bitmap de
+ * inodos y tabla de inodos.
+ */
+static int ref_table(mesafs_t *fs, const uint8_t *table, uint8_t *rc, uint8_t *block_bitmap,
+                     int delta) {
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS + 1];
+    for (uint32_t ino = 1; ino < fs->sb.total_inodes; ino++) {
+        const uint8_t *block = table + mesafs_block_offset(mesafs_inode_block(ino) -
+                                                           MESAFS_INODE_BITMAP_BLOCK);
+        const mesafs_inode_t *inode = (const mesafs_inode_t *)block + mesafs_inode_slot(ino);
+        if (!mesafs_bitmap_test(table, ino) || !(inode->flags & MESAFS_FLAG_USED))
+            continue;
+
+        int nblocks = inode_blocks(fs, inode, blocks);
+        if (nblocks < 0) {
+            printf("Inode %u is damaged\n", ino);
+            return -1;
+        }
+        for (int i = 0; i < nblocks; i++) {
+            uint32_t b = blocks[i];
+            if (b == 0 || b >= block_limit(fs))
+                continue;
+            if (delta < 0) {
+                drop_ref(fs, rc, block_bitmap, b);
+            } else if (rc[b] == UINT8_MAX) {
+                printf("Block %u has too many references\n", b);
+                return -1;
+            } else {
+                rc[b]++;
+            }
+        }
+    }
+    return 0;
+}
+
+static int find_snapshot(const mesafs_t *fs, const char *name) {
+    for (uint32_t i = 0; i < fs->sb.num_snapshots && i < MESAFS_MAX_SNAPSHOTS; i++) {
+        if (strncmp(fs->sb.snapshots[i].name, name, MESAFS_SNAPSHOT_NAME) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int mesafs_snapshot_create(mesafs_t *fs, const char *name) {
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len >= MESAFS_SNAPSHOT_NAME) {
+        printf("Invalid snapshot name: %s\n", name);
+        return -1;
+    }
+
+    uint8_t block0[MESAFS_BLOCK_SIZE], inode_bitmap[MESAFS_BLOCK_SIZE];
+    uint32_t total = fs->sb.total_blocks;
+    if (begin_change(fs, 0, total) != 0)
+        return -1;
+    int ret = -1;
+    uint8_t *rc = NULL, *table = mesafs_buffer_get(fs);
+    if (!table || read_bitmaps(fs, block0, inode_bitmap) != 0 || read_refcounts(fs, &rc) != 0)
+        goto out;
+    uint8_t *block_bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+    if (find_snapshot(fs, name) >= 0) {
+        printf("Snapshot %s already exists\n", name);
+        goto out;
+    }
+    if (fs->sb.num_snapshots >= MESAFS_MAX_SNAPSHOTS) {
+        printf("Too many snapshots (max %d)\n", MESAFS_MAX_SNAPSHOTS);
+        goto out;
+    }
+
+    /* Con el primer snapshot nace la tabla: cada bloque en uso es del sistema vivo */
+    if (!rc) {
+        uint32_t first = find_free_run(fs, block_bitmap, MESAFS_REFCOUNT_BLOCKS);
+        rc = first ? mesafs_buffer_get(fs) : NULL;
+        if (!rc) {
+            printf("No room for the block reference counts\n");
+            goto out;
+        }
+        memset(rc, 0, mesafs_block_offset(MESAFS_REFCOUNT_BLOCKS));
+        take_run(fs, rc, block_bitmap, first, MESAFS_REFCOUNT_BLOCKS);
+        for (uint32_t b = 0; b < block_limit(fs); b++)
+            rc[b] = mesafs_bitmap_test(block_bitmap, b);
+        fs->sb.refcount_block = first;
+        fs->sb.features |= MESAFS_FEATURE_SNAPSHOTS;
+    }
+
+    uint32_t copy = find_free_run(fs, block_bitmap, MESAFS_SNAPSHOT_BLOCKS);
+    if (copy == 0) {
+        printf("No room for the snapshot inode table\n");
+        goto out;
+    }
+    take_run(fs, rc, block_bitmap, copy, MESAFS_SNAPSHOT_BLOCKS);
+
+    /* Copia de bitmap y tabla de inodos, y una referencia más a cada bloque vivo */
+    if (mesafs_read_run(fs, MESAFS_INODE_BITMAP_BLOCK, MESAFS_SNAPSHOT_BLOCKS, table) != 0 ||
+        mesafs_write_run(fs, copy, MESAFS_SNAPSHOT_BLOCKS, table) != 0) {
+        printf("Failed to copy the inode table\n");
+        goto out;
+    }
+    if (ref_table(fs, table, rc, block_bitmap, 1) != 0 || write_refcounts(fs, rc) != 0)
+        goto out;
+
+    mesafs_snapshot_t *snap = &fs->sb.snapshots[fs->sb.num_snapshots++];
+    memset(snap, 0, sizeof(*snap));
+    memcpy(snap->name, name, name_len);
+    snap->created = time(NULL);
+    snap->table_block = copy;
+    snap->root_inode = fs->sb.root_inode;
+
+    /* El superbloque va al final: hasta que se escribe, el snapshot no existe */
+    ret = write_bitmaps(fs, block0, inode_bitmap);
+out:
+    mesafs_buffer_put(fs, rc);
+    mesafs_buffer_put(fs, table);
+    end_change(fs, 0, total);
+    return ret;
+}
+
+int mesafs_snapshot_delete(mesafs_t *fs, const char *name) {
+    uint8_t block0[MESAFS_BLOCK_SIZE], inode_bitmap[MESAFS_BLOCK_SIZE];
+    uint32_t total = fs->sb.total_blocks;
+    if (begin_change(fs, 0, total) != 0)
+        return -1;
+    int ret = -1;
+    uint8_t *rc = NULL, *table = mesafs_buffer_get(fs);
+    if (!table || read_bitmaps(fs, block0, inode_bitmap) != 0 || read_refcounts(fs, &rc) != 0)
+        goto out;
+    uint8_t *block_bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+    int i = find_snapshot(fs, name);
+    if (i < 0) {
+        printf("No snapshot named %s\n", name);
+        goto out;
+    }
+    if (!rc) {
+        printf("Block reference counts are missing\n");
+        goto out;
+    }
+
+    mesafs_snapshot_t *snap = &fs->sb.snapshots[i];
+    if (mesafs_read_run(fs, snap->table_block, MESAFS_SNAPSHOT_BLOCKS, table) != 0) {
+        printf("Failed to read the snapshot inode table\n");
+        goto out;
+    }
+    if (ref_table(fs, table, rc, block_bitmap, -1) != 0)
+        goto out;
+    for (uint32_t b = snap->table_block; b < snap->table_block + MESAFS_SNAPSHOT_BLOCKS; b++)
+        drop_ref(fs, rc, block_bitmap, b);
+
+    uint32_t n = --fs->sb.num_snapshots;
+    memmove(snap, snap + 1, (n - i) * sizeof(*snap));
+    memset(&fs->sb.snapshots[n], 0, sizeof(*snap));
+
+    /* Sin snapshots, todos los bloques tienen una referencia: la tabla sobra */
+    if (n == 0) {
+        for (uint32_t b = fs->sb.refcount_block; b < fs->sb.refcount_block + MESAFS_REFCOUNT_BLOCKS; b++)
+            drop_ref(fs, NULL, block_bitmap, b);
+        fs->sb.features &= ~MESAFS_FEATURE_SNAPSHOTS;
+        fs->sb.refcount_block = 0;
+    } else if (write_refcounts(fs, rc) != 0) {
+        goto out;
+    }
+    ret = write_bitmaps(fs, block0, inode_bitmap);
+out:
+    mesafs_buffer_put(fs, rc);
+    mesafs_buffer_put(fs, table);
+    end_change(fs, 0, total);
+    return ret;
+}
+
+int mesafs_snapshot_rollback(mesafs_t *fs, const char *name) {
+    uint8_t block0[MESAFS_BLOCK_SIZE], inode_bitmap[MESAFS_BLOCK_SIZE];
+    uint32_t total = fs->sb.total_blocks;
+    if (begin_change(fs, 0, total) != 0)
+        return -1;
+    int ret = -1;
+    uint8_t *rc = NULL, *table = mesafs_buffer_get(fs), *live = mesafs_buffer_get(fs);
+    if (!table || !live || read_bitmaps(fs, block0, inode_bitmap) != 0 ||
+        read_refcounts(fs, &rc) != 0)
+        goto out;
+    uint8_t *block_bitmap = block0 + MESAFS_BLOCK_BITMAP_OFFSET;
+    int i = find_snapshot(fs, name);
+    if (i < 0) {
+        printf("No snapshot named %s\n", name);
+        goto out;
+    }
+    if (!rc) {
+        printf("Block reference counts are missing\n");
+        goto out;
+    }
+
+    mesafs_snapshot_t *snap = &fs->sb.snapshots[i];
+    if (mesafs_read_run(fs, snap->table_block, MESAFS_SNAPSHOT_BLOCKS, table) != 0 ||
+        mesafs_read_run(fs, MESAFS_INODE_BITMAP_BLOCK, MESAFS_SNAPSHOT_BLOCKS, live) != 0) {
+        printf("Failed to read the inode tables\n");
+        goto out;
+    }
+
+    /* Primero se suman las del snapshot: lo que comparte con el estado vivo no llega a 0 */
+    if (ref_table(fs, table, rc, block_bitmap, 1) != 0 ||
+        ref_table(fs, live, rc, block_bitmap, -1) != 0)
+        goto out;
+    if (write_refcounts(fs, rc) != 0 ||
+        mesafs_write_run(fs, MESAFS_INODE_BITMAP_BLOCK, MESAFS_SNAPSHOT_BLOCKS, table) != 0) {
+        printf("Failed to restore the inode table\n");
+        goto out;
+    }
+
+    fs->sb.root_inode = snap->root_inode;
+    fs->sb.free_inodes = 0;
+    for (uint32_t ino = 0; ino < fs->sb.total_inodes; ino++)
+        fs->sb.free_inodes += !mesafs_bitmap_test(table, ino);
+    ret = write_bitmaps(fs, block0, table);
+out:
+    mesafs_buffer_put(fs, rc);
+    mesafs_buffer_put(fs, table);
+    mesafs_buffer_put(fs, live);
+    end_change(fs, 0, total);
+    return ret;
+}
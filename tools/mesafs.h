@@ -0,0 +1,574 @@
+/**
+ * @file mesafs.h
+ * @brief Acceso a imágenes MesaFS desde las herramientas de host
+ *
+ * Layout igual que mesafs.h de MesaOS. Las funciones viven en mesafs.c, que
+ * se compila junto a cada herramienta:
+ *   gcc -o msa-verify msa-verify.c msa.c mesafs.c -lpthread
+ */
+
+#ifndef MESAFS_H
+#define MESAFS_H
+
+#include <stdint.h>
+
+/* ==================== Constantes ==================== */
+
+#define SECTOR_SIZE             512
+#define MESAFS_MAGIC            0x4D455341  /* "MESA" - igual que MesaOS */
+/*
+ * Versiones del formato (superblock.version):
+ *   1  el bitmap de bloques empezaba en el byte 0 del bloque 0, encima del
+ *      superblock, y al escribir uno se pisaban los bits del otro
+ *   2  el bitmap de bloques empieza en el byte 512 del bloque 0, detrás del
+ *      superblock
+ * Inodos y directorios no cambian: de una imagen v1 se pueden leer archivos.
+ */
+#define MESAFS_VERSION          2
+#define MESAFS_VERSION_V1       1
+#ifndef MESAFS_BLOCK_SHIFT
+#define MESAFS_BLOCK_SHIFT      12          /* Bloques de 4 KiB, como MesaOS */
+#endif
+#define MESAFS_BLOCK_SIZE       (1 << MESAFS_BLOCK_SHIFT)
+#define MESAFS_PART_TYPE        0x77        /* Tipo de partición MBR */
+#define MESAFS_MBR_PROTECTIVE   0xEE        /* MBR protector de un disco GPT */
+#define MESAFS_TYPE_FILE        1
+#define MESAFS_TYPE_DIR         2
+#define MESAFS_TYPE_SYMLINK     3
+#define MESAFS_FLAG_USED        0x01
+#define MESAFS_MAX_FILENAME     56
+#define MESAFS_DIRECT_BLOCKS    10
+
+/* Layout */
+#define MESAFS_BLOCK_BITMAP_BLOCK   0
+#define MESAFS_INODE_BITMAP_BLOCK   1
+#define MESAFS_INODE_TABLE_START    2
+#define MESAFS_INODE_TABLE_BLOCKS   8
+#define MESAFS_DATA_START           10
+
+/* El bitmap de bloques sigue al superblock dentro del bloque 0 */
+#define MESAFS_BLOCK_BITMAP_OFFSET  512
+#define MESAFS_BLOCK_BITMAP_BITS    ((MESAFS_BLOCK_SIZE - MESAFS_BLOCK_BITMAP_OFFSET) * 8)
+
+/*
+ * Geometría: todo se deriva de MESAFS_BLOCK_SHIFT al compilar (con
+ * -DMESAFS_BLOCK_SHIFT=11 las herramientas usan bloques de 2 KiB), así que
+ * indexar bitmaps, bloques y punteros son desplazamientos y máscaras.
+ * La tabla de inodos tiene, como MesaOS, uno por cada 128 bytes de bloque
+ * (32 por bloque de 4 KiB), guardados seguidos cada sizeof(mesafs_inode_t)
+ * bytes: bloque y posición también salen con desplazamiento y máscara.
+ * mesafs_open rechaza las imágenes con otro block_size.
+ */
+#define MESAFS_DIRENT_SHIFT         6       /* sizeof(mesafs_dirent_t) */
+#define MESAFS_PTR_SHIFT            2       /* sizeof(uint32_t) */
+#define MESAFS_SECTOR_SHIFT         9
+#define MESAFS_SECTORS_SHIFT        (MESAFS_BLOCK_SHIFT - MESAFS_SECTOR_SHIFT)
+#define MESAFS_INODES_SHIFT         (MESAFS_BLOCK_SHIFT - 7)
+#define MESAFS_INODES_PER_BLOCK     (1u << MESAFS_INODES_SHIFT)
+#define MESAFS_DIRENTS_PER_BLOCK    (1u << (MESAFS_BLOCK_SHIFT - MESAFS_DIRENT_SHIFT))
+#define MESAFS_PTRS_PER_BLOCK       (1u << (MESAFS_BLOCK_SHIFT - MESAFS_PTR_SHIFT))
+#define MESAFS_MAX_FILE_BLOCKS      (MESAFS_DIRECT_BLOCKS + MESAFS_PTRS_PER_BLOCK)
+#define MESAFS_MAX_INODES           (MESAFS_INODE_TABLE_BLOCKS * MESAFS_INODES_PER_BLOCK)
+
+/*
+ * E/S directa: con O_DIRECT en mesafs_open los datos no pasan por la page
+ * cache. Las lecturas y escrituras de bloques sueltos usan un bloque
+ * alineado interno; las de tramos contiguos van en una sola petición de
+ * hasta MESAFS_RUN_BLOCKS bloques desde buffers del pool de la imagen.
+ */
+#define MESAFS_IO_ALIGN             4096
+#define MESAFS_RUN_BLOCKS           1024    /* 4 MiB por petición */
+#define MESAFS_POOL_BUFFERS         8
+
+/*
+ * Symlinks: el inodo tiene size = longitud del destino. Si cabe en los
+ * punteros de bloque (direct_blocks + indirect_block) se guarda ahí y
+ * blocks_used es 0; si no, ocupa un bloque de datos.
+ */
+#define MESAFS_FAST_SYMLINK_MAX     ((MESAFS_DIRECT_BLOCKS + 1) * sizeof(uint32_t))
+
+/*
+ * GPT: la partición MesaFS tiene como tipo el GUID
+ * dc64bf58-de6a-48f2-9fef-88898adf0ec9. Se crea alineada a 1 MiB con la
+ * tabla estándar de 128 entradas de 128 bytes (32 sectores) y su copia al
+ * final del disco.
+ */
+#define MESAFS_GPT_TYPE_GUID    { 0x58, 0xBF, 0x64, 0xDC, 0x6A, 0xDE, 0xF2, 0x48, \
+                                  0x9F, 0xEF, 0x88, 0x89, 0x8A, 0xDF, 0x0E, 0xC9 }
+#define GPT_SIGNATURE           "EFI PART"
+#define GPT_REVISION            0x00010000
+#define GPT_ENTRIES             128
+#define GPT_ENTRY_SIZE          128
+#define GPT_ENTRIES_SECTORS     (GPT_ENTRIES * GPT_ENTRY_SIZE / SECTOR_SIZE)
+#define MESAFS_ALIGN_SECTORS    2048        /* 1 MiB */
+
+/*
+ * Snapshots (solo herramientas de host, ver mesafs_snapshot_create): cada
+ * uno guarda una copia del bitmap de inodos y de la tabla de inodos, que
+ * son bloques seguidos (1-9), y comparte con el sistema vivo los bloques de
+ * datos. Una tabla de un byte por bloque cuenta cuántos árboles usan cada
+ * bloque; un bloque con más de una referencia se copia antes de escribirlo.
+ */
+#define MESAFS_FEATURE_SNAPSHOTS    0x01
+#define MESAFS_MAX_SNAPSHOTS        8
+#define MESAFS_SNAPSHOT_NAME        16
+#define MESAFS_SNAPSHOT_BLOCKS      (1 + MESAFS_INODE_TABLE_BLOCKS)
+#define MESAFS_REFCOUNT_BLOCKS      ((MESAFS_BLOCK_BITMAP_BITS + MESAFS_BLOCK_SIZE - 1) / MESAFS_BLOCK_SIZE)
+
+/* ==================== Estructuras (igual que MesaOS) ==================== */
+
+/* Snapshot (32 bytes, en el superbloque) */
+typedef struct {
+    char     name[MESAFS_SNAPSHOT_NAME];    /* Terminado en '\0' */
+    uint64_t created;
+    uint32_t table_block;                   /* Copia de los bloques 1-9 */
+    uint32_t root_inode;
+} __attribute__((packed)) mesafs_snapshot_t;
+
+/*
+ * Superbloque (512 bytes). Los campos desde features ocupan lo que MesaOS
+ * tiene como reservado y solo los usan las herramientas de host.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t total_blocks;
+    uint32_t free_blocks;
+    uint32_t total_inodes;
+    uint32_t free_inodes;
+    uint32_t root_inode;
+    uint32_t first_data_block;
+    uint32_t features;                      /* MESAFS_FEATURE_* */
+    uint32_t refcount_block;                /* Tabla de referencias (con snapshots) */
+    uint32_t num_snapshots;
+    mesafs_snapshot_t snapshots[MESAFS_MAX_SNAPSHOTS];
+    uint32_t generation;                    /* Cambios de metadatos publicados */
+    uint8_t  reserved[204];
+} __attribute__((packed)) mesafs_superblock_t;
+
+/* Inodo (128 bytes) */
+typedef struct {
+    uint32_t inode_num;
+    uint8_t  type;
+    uint8_t  flags;
+    uint16_t links;
+    uint32_t size;
+    uint32_t blocks_used;
+    uint32_t direct_blocks[MESAFS_DIRECT_BLOCKS];
+    uint32_t indirect_block;
+    uint64_t created;
+    uint64_t modified;
+    uint8_t  reserved[36];
+} __attribute__((packed)) mesafs_inode_t;
+
+/* Entrada de directorio (64 bytes) */
+typedef struct {
+    uint32_t inode;
+    uint8_t  type;
+    uint8_t  name_len;
+    char     name[58];
+} __attribute__((packed)) mesafs_dirent_t;
+
+_Static_assert(MESAFS_BLOCK_SHIFT >= 10 && MESAFS_BLOCK_SHIFT <= 16, "unsupported block size");
+_Static_assert(sizeof(mesafs_superblock_t) == MESAFS_BLOCK_BITMAP_OFFSET, "superblock size");
+_Static_assert(sizeof(mesafs_inode_t) == 112, "inode size");
+_Static_assert(MESAFS_INODES_PER_BLOCK * sizeof(mesafs_inode_t) <= MESAFS_BLOCK_SIZE, "inode table");
+_Static_assert(sizeof(mesafs_dirent_t) == 1 << MESAFS_DIRENT_SHIFT, "dirent size");
+
+/* ==================== Geometría ==================== */
+
+/* Bloque de la tabla de inodos que contiene ino, y su posición dentro */
+static inline uint32_t mesafs_inode_block(uint32_t ino) {
+    return MESAFS_INODE_TABLE_START + (ino >> MESAFS_INODES_SHIFT);
+}
+
+static inline uint32_t mesafs_inode_slot(uint32_t ino) {
+    return ino & (MESAFS_INODES_PER_BLOCK - 1);
+}
+
+/* Bloques necesarios para bytes bytes */
+static inline uint32_t mesafs_blocks_for(uint64_t bytes) {
+    return (bytes + MESAFS_BLOCK_SIZE - 1) >> MESAFS_BLOCK_SHIFT;
+}
+
+static inline uint64_t mesafs_block_offset(uint64_t block) {
+    return block << MESAFS_BLOCK_SHIFT;
+}
+
+static inline void mesafs_bitmap_set(uint8_t *bitmap, uint32_t bit) {
+    bitmap[bit >> 3] |= 1 << (bit & 7);
+}
+
+static inline void mesafs_bitmap_clear(uint8_t *bitmap, uint32_t bit) {
+    bitmap[bit >> 3] &= ~(1 << (bit & 7));
+}
+
+static inline int mesafs_bitmap_test(const uint8_t *bitmap, uint32_t bit) {
+    return (bitmap[bit >> 3] >> (bit & 7)) & 1;
+}
+
+/* Header GPT (LBA 1 y, la copia, último LBA del disco) */
+typedef struct {
+    char     signature[8];                  /* GPT_SIGNATURE */
+    uint32_t revision;
+    uint32_t header_size;                   /* 92 */
+    uint32_t header_crc32;                  /* CRC32 del header con este campo a 0 */
+    uint32_t reserved;
+    uint64_t my_lba;
+    uint64_t alternate_lba;
+    uint64_t first_usable_lba;
+    uint64_t last_usable_lba;
+    uint8_t  disk_guid[16];
+    uint64_t entries_lba;
+    uint32_t num_entries;
+    uint32_t entry_size;
+    uint32_t entries_crc32;
+} __attribute__((packed)) gpt_header_t;
+
+/* Entrada de partición GPT (128 bytes) */
+typedef struct {
+    uint8_t  type_guid[16];
+    uint8_t  unique_guid[16];
+    uint64_t first_lba;
+    uint64_t last_lba;                      /* Inclusive */
+    uint64_t attributes;
+    uint16_t name[36];                      /* UTF-16LE */
+} __attribute__((packed)) gpt_entry_t;
+
+/*
+ * Imagen empaquetada (mesafs-pack / mesafs-unpack): header, los tramos
+ * comprimidos con zlib uno a uno y, al final, el índice de tramos ordenado
+ * por offset en la imagen. Solo se guardan los rangos con datos: los
+ * bloques marcados en el bitmap y, fuera del sistema de archivos, lo que no
+ * es hueco; lo demás se lee como ceros. Cada tramo se descomprime por
+ * separado, así que se puede leer un bloque o un archivo sin desempaquetar
+ * la imagen, y desempaquetarla en paralelo.
+ */
+#define MESAFS_PACK_MAGIC       0x4B41504D  /* "MPAK" */
+#define MESAFS_PACK_VERSION     1
+#define MESAFS_PACK_CHUNK       (1024 * 1024)   /* Tamaño de tramo por defecto */
+
+typedef struct {
+    uint32_t magic;                         /* MESAFS_PACK_MAGIC */
+    uint32_t version;
+    uint64_t image_size;                    /* Tamaño de la imagen original */
+    uint64_t part_lba;                      /* Partición MesaFS */
+    uint64_t index_offset;                  /* Índice de tramos */
+    uint32_t num_chunks;
+    uint32_t chunk_size;                    /* Tamaño máximo de un tramo */
+    uint32_t index_crc;                     /* CRC32 del índice */
+    uint32_t reserved[5];
+} __attribute__((packed)) mesafs_pack_header_t;
+
+typedef struct {
+    uint64_t image_offset;                  /* Posición en la imagen */
+    uint64_t pack_offset;                   /* Datos guardados */
+    uint32_t length;                        /* Bytes en la imagen */
+    uint32_t stored;                        /* Bytes guardados (igual a length: sin comprimir) */
+    uint32_t crc32;                         /* CRC32 de los bytes de la imagen */
+    uint32_t reserved;
+} __attribute__((packed)) mesafs_pack_chunk_t;
+
+/*
+ * Parche entre dos imágenes con la misma disposición (mesafs-mkpatch /
+ * mesafs-applypatch): header, los bloques nuevos de la partición (zlib si
+ * compensa) y al final la tabla de bloques, ordenada por número de bloque.
+ * Solo entran los bloques en uso en la imagen nueva que han cambiado; los
+ * bloques 0-1 (superbloque y bitmaps) identifican la base y el resultado.
+ * sb.generation no cuenta en ningún CRC: cada imagen lleva la suya.
+ */
+#define MESAFS_PATCH_MAGIC      0x5441504D  /* "MPAT" */
+#define MESAFS_PATCH_VERSION    1
+
+typedef struct {
+    uint32_t magic;                         /* MESAFS_PATCH_MAGIC */
+    uint32_t version;
+    uint64_t image_size;                    /* Tamaño de las dos imágenes */
+    uint64_t part_lba;                      /* Partición MesaFS */
+    uint64_t index_offset;                  /* Tabla de bloques */
+    uint32_t num_blocks;
+    uint32_t base_crc;                      /* CRC32 de los bloques 0-1 de la base */
+    uint32_t target_crc;                    /* Y de la imagen nueva */
+    uint32_t index_crc;                     /* CRC32 de la tabla */
+    uint32_t reserved[4];
+} __attribute__((packed)) mesafs_patch_header_t;
+
+typedef struct {
+    uint32_t block;                         /* Bloque de la partición */
+    uint32_t base_crc;                      /* CRC32 del bloque en la base */
+    uint32_t crc32;                         /* CRC32 del bloque nuevo */
+    uint32_t stored;                        /* Bytes en el parche (0: ceros; MESAFS_BLOCK_SIZE: tal cual) */
+    uint64_t offset;                        /* Datos en el parche */
+} __attribute__((packed)) mesafs_patch_entry_t;
+
+/*
+ * Archivos de tamaño desconocido (desde una tubería): los datos se acumulan
+ * en una ventana de MESAFS_STREAM_WINDOW bloques y solo al vaciarla se
+ * asignan, de reservas contiguas que crecen con el archivo. Al cerrar se
+ * devuelve lo reservado sin usar.
+ */
+#define MESAFS_STREAM_WINDOW        256     /* 1 MiB con bloques de 4 KiB */
+
+_Static_assert(MESAFS_STREAM_WINDOW <= MESAFS_RUN_BLOCKS, "stream window");
+
+/* Imagen abierta */
+typedef struct {
+    int      fd;
+    uint64_t part_lba;
+    uint64_t part_sectors;
+    uint64_t part_offset;               /* Offset en bytes de la partición */
+    mesafs_superblock_t sb;
+    int      direct;                    /* O_DIRECT activo */
+    uint8_t *bounce;                    /* Bloque alineado para buffers que no lo están */
+    void    *pool[MESAFS_POOL_BUFFERS]; /* Buffers de tramo libres */
+    int      pool_count;
+    int      epoch_depth;               /* Anidamiento de mesafs_epoch_enter */
+} mesafs_t;
+
+/* Archivo en escritura con mesafs_stream_* */
+typedef struct {
+    mesafs_t *fs;
+    int       ino;
+    uint64_t  size;
+    uint32_t  nblocks;                      /* Bloques ya escritos */
+    uint32_t  blocks[MESAFS_MAX_FILE_BLOCKS + 1];   /* + el indirecto */
+    uint32_t  next;                         /* Reserva en curso: primer bloque libre */
+    uint32_t  left;                         /* y cuántos le quedan */
+    uint8_t  *buf;                          /* Ventana (buffer de tramo del pool) */
+    uint32_t  buffered;                     /* Bytes en la ventana */
+} mesafs_stream_t;
+
+/*
+ * Varios procesos pueden escribir a la vez en una imagen. Los metadatos se
+ * protegen con bloqueos de rango fcntl sobre sus bloques, que se toman solo
+ * el tiempo de confirmar un cambio:
+ *   - bloques 0-1 (superbloque y bitmaps): mesafs_alloc marca inodo y
+ *     bloques en disco y suelta; desde ahí son del proceso, que escribe sus
+ *     datos sin bloqueo, en paralelo con los demás.
+ *   - el bloque de la tabla de inodos al escribir un inodo.
+ *   - el primer bloque de datos (el del directorio raíz) al añadir o
+ *     quitar entradas.
+ * Con snapshots, escribir en el directorio puede copiar su bloque: bajo el
+ * bloqueo del directorio se toman el de asignación y el del inodo raíz, uno
+ * tras otro y siempre en ese orden. Las operaciones de snapshot bloquean la
+ * partición entera. Si un proceso muere a medias, lo reservado queda
+ * marcado pero sin usar: se pierde espacio, no datos.
+ */
+#define MESAFS_LOCK_ALLOC           MESAFS_BLOCK_BITMAP_BLOCK
+#define MESAFS_LOCK_ALLOC_BLOCKS    2
+#define MESAFS_LOCK_DIR             MESAFS_DATA_START
+
+/*
+ * Lectores sin bloqueos (mesafs-list, msa-verify -i) mientras otros
+ * escriben. Cada cambio de metadatos (una función de escritura de abajo, o
+ * lo que un programa encierre entre mesafs_epoch_enter y mesafs_epoch_exit)
+ * se publica al terminar sumando uno a sb.generation. Mientras dura, el
+ * escritor tiene un bloqueo compartido sobre el bloque siguiente al último
+ * del sistema de archivos, que no frena a los demás escritores. El lector
+ * fija una generación con mesafs_epoch_pin, lee el árbol sin tomar nada y
+ * con mesafs_epoch_check sabe si lo leído es un estado publicado; si no,
+ * repite (hasta MESAFS_EPOCH_RETRIES veces). Si un escritor muere a medias,
+ * el kernel suelta su bloqueo y los lectores no se quedan esperando.
+ */
+#define MESAFS_EPOCH_RETRIES        8
+#define MESAFS_EPOCH_WAIT_MS        10000   /* Espera máxima de mesafs_epoch_pin */
+
+/* ==================== Funciones ==================== */
+
+/**
+ * Busca la partición MesaFS: una entrada de tipo 0x77 en el MBR o, si el MBR
+ * es protector, la entrada con MESAFS_GPT_TYPE_GUID en la GPT (si la
+ * principal está dañada se usa la copia del final del disco).
+ * Retorna 0 y rellena lba/sectors, o -1 si no existe.
+ */
+int mesafs_find_partition(int fd, uint64_t *lba, uint64_t *sectors);
+
+/**
+ * Escribe un MBR protector y una GPT (principal y copia) con una única
+ * partición MesaFS alineada a 1 MiB que ocupa el resto del disco.
+ * Conserva el código de arranque del MBR. Retorna 0 y rellena lba/sectors.
+ */
+int mesafs_write_gpt(int fd, uint64_t disk_sectors, uint64_t *lba, uint64_t *sectors);
+
+/* Igual, con un MBR clásico (tipo 0x77); el disco no puede pasar de 2 TiB */
+int mesafs_write_mbr(int fd, uint64_t disk_sectors, uint64_t *lba, uint64_t *sectors);
+
+/**
+ * Abre una imagen de disco, localiza la partición y lee el superbloque.
+ * flags son los de open(2) (O_RDONLY / O_RDWR, y O_DIRECT opcional: exige
+ * la partición alineada a 4 KiB; si el sistema de archivos no lo soporta
+ * se avisa y se sigue con la page cache).
+ * Retorna 0, o -1 con un mensaje ya impreso.
+ */
+int mesafs_open(mesafs_t *fs, const char *path, int flags);
+void mesafs_close(mesafs_t *fs);
+
+int mesafs_read_block(mesafs_t *fs, uint32_t block_num, void *buf);
+int mesafs_write_block(mesafs_t *fs, uint32_t block_num, const void *buf);
+
+/**
+ * Buffer alineado de MESAFS_RUN_BLOCKS bloques, del pool de la imagen.
+ * El pool no tiene locks: los hilos reciben sus buffers antes de arrancar.
+ */
+void *mesafs_buffer_get(mesafs_t *fs);
+void mesafs_buffer_put(mesafs_t *fs, void *buf);
+
+/**
+ * Lee o escribe count bloques contiguos desde first en una sola petición
+ * (count <= MESAFS_RUN_BLOCKS; con O_DIRECT, buf alineado a MESAFS_IO_ALIGN).
+ */
+int mesafs_read_run(mesafs_t *fs, uint32_t first, uint32_t count, void *buf);
+int mesafs_write_run(mesafs_t *fs, uint32_t first, uint32_t count, const void *buf);
+
+/* Bloqueo exclusivo de count bloques desde block (espera si lo tiene otro) */
+int mesafs_lock(mesafs_t *fs, uint32_t block, uint32_t count);
+void mesafs_unlock(mesafs_t *fs, uint32_t block, uint32_t count);
+
+/**
+ * Agrupa cambios de metadatos en uno solo para los lectores. Se anidan: las
+ * funciones que escriben ya lo hacen, y solo el exit más externo publica.
+ * Se llaman sin ningún otro bloqueo tomado. Retornan 0, o -1.
+ */
+int mesafs_epoch_enter(mesafs_t *fs);
+int mesafs_epoch_exit(mesafs_t *fs);
+
+/**
+ * Fija la generación actual para leer sin bloqueos: espera a que no haya
+ * cambios en curso y relee el superbloque en fs->sb.
+ * Retorna 0, o -1 con un mensaje ya impreso.
+ */
+int mesafs_epoch_pin(mesafs_t *fs, uint32_t *epoch);
+
+/* 0 si desde mesafs_epoch_pin no se ha publicado ni empezado ningún cambio; si no, -1 */
+int mesafs_epoch_check(mesafs_t *fs, uint32_t epoch);
+
+int mesafs_read_inode(mesafs_t *fs, uint32_t inode_num, mesafs_inode_t *inode);
+
+/* Escribe un inodo con el bloqueo de su bloque de la tabla */
+int mesafs_write_inode(mesafs_t *fs, const mesafs_inode_t *inode);
+
+/**
+ * Lista los bloques de datos de un inodo en orden lógico (directos y luego
+ * el bloque indirecto). Un 0 es un hueco: el bloque se lee como ceros.
+ * Retorna el número de bloques, o -1 en error.
+ */
+int mesafs_file_blocks(mesafs_t *fs, const mesafs_inode_t *inode,
+                       uint32_t *blocks, uint32_t max_blocks);
+
+/**
+ * Lee el destino de un symlink en buf (terminado en '\0').
+ * Retorna su longitud, o -1 si el inodo no es un symlink válido.
+ */
+int mesafs_read_symlink(mesafs_t *fs, const mesafs_inode_t *inode, char *buf, uint32_t buf_len);
+
+/**
+ * Lee len bytes de un archivo desde offset (los huecos se leen como ceros).
+ * Retorna los bytes leídos, menos si se llega al final, o -1 en error.
+ */
+int mesafs_read_file(mesafs_t *fs, const mesafs_inode_t *inode, uint64_t offset,
+                     void *buf, uint32_t len);
+
+/*
+ * Búsquedas en un bloque de directorio, comparando varias entradas por
+ * instrucción (8 con -mavx2, 4 con SSE2). Retornan el índice de la entrada,
+ * o -1 si no hay ninguna.
+ */
+
+/* Primera entrada libre (inode 0) a partir de start */
+int mesafs_dirent_free(const void *dir_block, int start);
+
+/* Primera entrada ocupada a partir de start, para recorrer el bloque */
+int mesafs_dirent_used(const void *dir_block, int start);
+
+/* Entrada ocupada con el nombre name de name_len bytes */
+int mesafs_dirent_find(const void *dir_block, const char *name, size_t name_len);
+
+/**
+ * Busca una entrada del directorio raíz por nombre (inject-file guarda
+ * /pkgs/x.msa como "pkgs/x.msa"). Retorna 0 y rellena de, o -1 si no existe.
+ */
+int mesafs_lookup(mesafs_t *fs, const char *name, mesafs_dirent_t *de);
+
+/**
+ * Crea en el directorio raíz un archivo de size bytes con todos sus bloques
+ * asignados y a cero. Actualiza bitmaps y superbloque en disco.
+ * Retorna el número de inodo, o -1 con un mensaje ya impreso.
+ */
+int mesafs_create_file(mesafs_t *fs, const char *name, uint32_t size);
+
+/**
+ * Reserva un inodo libre y count bloques libres: los marca en los bitmaps
+ * y actualiza el superbloque en disco bajo el bloqueo de asignación.
+ * Retorna el número de inodo, o -1 con un mensaje ya impreso.
+ */
+int mesafs_alloc(mesafs_t *fs, uint32_t count, uint32_t *blocks);
+
+/**
+ * Reserva, al estilo de fallocate, hasta count bloques libres seguidos:
+ * a continuación de goal si está libre (para alargar un archivo sin
+ * cortes), si no el primer tramo donde quepan y, si no lo hay, el más
+ * largo. Retorna los bloques reservados desde *first, o -1. Lo que no se
+ * llegue a usar se devuelve con mesafs_free.
+ */
+int mesafs_reserve(mesafs_t *fs, uint32_t goal, uint32_t count, uint32_t *first);
+
+/* Devuelve a los bitmaps un inodo (0 = ninguno) y count bloques (se ignoran los 0) */
+int mesafs_free(mesafs_t *fs, uint32_t ino, const uint32_t *blocks, uint32_t count);
+
+/* Añade al directorio raíz la entrada name -> ino, bajo el bloqueo del directorio */
+int mesafs_link(mesafs_t *fs, const char *name, uint32_t ino, uint8_t type);
+
+/**
+ * Escritura con asignación diferida: open reserva el inodo, write acumula
+ * en la ventana y asigna al llenarla, close escribe lo que falta, el
+ * bloque indirecto detrás de los datos, el inodo y la entrada name, y
+ * devuelve la reserva sobrante. Retornan 0 (close, el inodo), o -1 con un
+ * mensaje ya impreso; tras un error, abort libera todo.
+ */
+int mesafs_stream_open(mesafs_t *fs, mesafs_stream_t *s);
+int mesafs_stream_write(mesafs_stream_t *s, const void *data, size_t len);
+int mesafs_stream_close(mesafs_stream_t *s, const char *name);
+void mesafs_stream_abort(mesafs_stream_t *s);
+
+/**
+ * Añade al directorio raíz name como otro nombre del archivo target (no un
+ * directorio): suma un enlace al inodo, sin copiar bloques ni inodo.
+ * Retorna 0, o -1 con un mensaje ya impreso.
+ */
+int mesafs_hardlink(mesafs_t *fs, const char *target, const char *name);
+
+/*
+ * Borra una entrada del directorio raíz. Si el inodo tiene más nombres
+ * solo resta un enlace; si no, libera el inodo y sus bloques.
+ */
+int mesafs_unlink(mesafs_t *fs, const char *name);
+
+/**
+ * Prepara el bloque lógico index de inode (que no puede ser un hueco) para
+ * escribir en él. Si lo comparte con un snapshot, lo copia a un bloque
+ * nuevo y cambia el puntero en el inodo (que se escribe) o en su bloque
+ * indirecto. El llamador tiene el archivo para él (el bloqueo del
+ * directorio, para la raíz). Retorna el bloque donde escribir, o 0.
+ */
+uint32_t mesafs_cow_block(mesafs_t *fs, mesafs_inode_t *inode, uint32_t index);
+
+/**
+ * Crea el snapshot name del estado actual: copia bitmap y tabla de inodos
+ * y suma una referencia a cada bloque de los archivos vivos. No copia
+ * datos, así que el coste es el de los metadatos, no el de la imagen.
+ * Retorna 0, o -1 con un mensaje ya impreso.
+ */
+int mesafs_snapshot_create(mesafs_t *fs, const char *name);
+
+/* Borra un snapshot; libera los bloques que solo usaba él */
+int mesafs_snapshot_delete(mesafs_t *fs, const char *name);
+
+/**
+ * Vuelve al estado del snapshot name, que se conserva: su tabla de inodos
+ * y su inodo raíz pasan a ser los vivos y los bloques que solo usaba el
+ * estado anterior se liberan.
+ */
+int mesafs_snapshot_rollback(mesafs_t *fs, const char *name);
+
+#endif /* MESAFS_H */
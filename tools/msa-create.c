@@ -2,55 +2,62 @@
  * @file msa-create.c
  * @brief Herramienta para crear paquetes .msa para MesaOS
  * 
- * Compilar: gcc -o msa-create msa-create.c
+ * Compilar: gcc -o msa-create msa-create.c msa.c pool.c -lz -lpthread
  * Uso: ./msa-create <nombre> <version> <directorio> <salida.msa>
+ *
+ * Con -g los ejecutables ELF se separan: la información de depuración va a
+ * un paquete <nombre>-dbg.msa (en /usr/lib/debug/.build-id/xx/yyyy.debug) y
+ * el paquete principal lleva el binario sin secciones .debug_*. Se usa
+ * objcopy (o el definido en $OBJCOPY, p.ej. i686-elf-objcopy).
+ *
+ * La sección de datos se ordena según -L (dir, size o scan) y, con -M, por
+ * un manifiesto de orden de acceso: las rutas listadas van primero, en ese
+ * orden, para que instalar o arrancar lea el paquete solo hacia delante.
+ *
+ * Con -s los archivos con huecos (SEEK_DATA/SEEK_HOLE) se guardan como
+ * entradas dispersas: solo se leen y almacenan los extents con datos. Sin -s
+ * se guardan completos, que es lo que entiende el instalador v1 de MesaOS.
+ * Los enlaces simbólicos se guardan como tales (tipo 2, con el destino como
+ * datos).
+ *
+ * Con -z los archivos se comprimen con deflate cuando así ocupan menos; con
+ * -Z <dict.msa> además se usa el diccionario compartido de msa-dict; cada
+ * paquete con alguna entrada comprimida pasa a depender del paquete del
+ * diccionario (también el -dbg).
+ *
+ * La compresión y el CRC de cada entrada son tareas del pool de hilos
+ * (pool.h, ancho con -j); el paquete sale igual con cualquier ancho. El
+ * recorrido del árbol sigue en un hilo: son syscalls de metadatos, fija el
+ * orden de escaneo y -g comparte los temporales de objcopy.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <dirent.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <zlib.h>
+#include "msa.h"
+#include "pool.h"
 
 /* ==================== Constantes ==================== */
 
-#define MSA_MAGIC           0x4153454D  /* "MESA" */
-#define MSA_VERSION         1
-#define MSA_NAME_MAX        64
-#define MSA_PATH_MAX        256
-#define MSA_DESC_MAX        256
-#define MSA_MAX_FILES       256
-#define MSA_MAX_DEPS        16
+#define MSA_DEBUG_DIR       "/usr/lib/debug"
+#define BUILD_ID_MAX        64
 
-/* ==================== Estructuras (deben coincidir con MesaOS) ==================== */
-
-typedef struct {
-    uint32_t magic;                         /* MSA_MAGIC */
-    uint32_t version;                       /* Versión del formato */
-    char     name[MSA_NAME_MAX];            /* Nombre del paquete */
-    char     pkg_version[16];               /* Versión del paquete */
-    char     author[MSA_NAME_MAX];          /* Autor */
-    char     description[MSA_DESC_MAX];     /* Descripción */
-    uint32_t num_files;                     /* Cantidad de archivos */
-    uint32_t total_size;                    /* Tamaño total descomprimido */
-    uint32_t header_size;                   /* Tamaño del header + file table */
-    uint16_t num_deps;                      /* Número de dependencias */
-    char     deps[MSA_MAX_DEPS][MSA_NAME_MAX]; /* Dependencias */
-    uint32_t checksum;                      /* CRC32 simple */
-    uint8_t  reserved[128];                 /* Reservado */
-} __attribute__((packed)) msa_header_t;
-
-typedef struct {
-    char     path[MSA_PATH_MAX];            /* Ruta de instalación */
-    uint32_t size;                          /* Tamaño del archivo */
-    uint32_t offset;                        /* Offset en el archivo .msa */
-    uint32_t mode;                          /* Permisos (estilo UNIX) */
-    uint8_t  type;                          /* 0=archivo, 1=directorio, 2=symlink */
-    uint8_t  executable;                    /* 1 si es ejecutable */
-    uint8_t  reserved[54];                  /* Padding a 320 bytes */
-} __attribute__((packed)) msa_file_entry_t;
+/* Políticas de orden de la sección de datos (-L) */
+#define LAYOUT_SCAN         0   /* Orden de readdir() */
+#define LAYOUT_DIR          1   /* Agrupado por directorio, por nombre */
+#define LAYOUT_SIZE         2   /* De menor a mayor tamaño */
 
 /* ==================== Variables Globales ==================== */
 
@@ -58,115 +65,996 @@ static msa_file_entry_t files[MSA_MAX_FILES];
 static int file_count = 0;
 static char *file_data[MSA_MAX_FILES];
 static uint32_t total_data_size = 0;
+static int sparse_files = 0;        /* -s: el instalador v1 de MesaOS no las entiende */
+static int sparse_count = 0;
+static int symlink_count = 0;
+
+/* Compresión (-z / -Z) */
+static int compress_files = 0;
+static uint8_t dict[MSA_DICT_MAX];
+static uint32_t dict_len = 0;
+static uint32_t dict_id = 0;
+static char dict_package[MSA_NAME_MAX];
+static int compressed_count = 0;
+static uint64_t compressed_in = 0, compressed_out = 0;
+static uint64_t hole_bytes = 0;
 static char base_dir[1024];
 
+/* Paquete -dbg (solo con -g) */
+static int split_debug = 0;
+static char debug_tmpdir[64];
+static msa_file_entry_t dbg_files[MSA_MAX_FILES];
+static int dbg_file_count = 0;
+static char *dbg_file_data[MSA_MAX_FILES];
+static uint32_t dbg_data_size = 0;
+static uint32_t debug_bytes_removed = 0;
+static int debug_split_count = 0;
+
+/* Orden de los datos */
+static int layout_policy = LAYOUT_DIR;
+static char (*manifest)[MSA_PATH_MAX];
+static int manifest_count = 0;
+static const msa_file_entry_t *layout_entries;
+
+/* ==================== Separación de debug info ==================== */
+
+/**
+ * Inspecciona un ELF en memoria: indica si tiene secciones de depuración y
+ * extrae el build-id (nota NT_GNU_BUILD_ID) si existe.
+ * Retorna 0 si es un ELF válido, -1 si no lo es.
+ */
+static int elf_inspect(const uint8_t *data, size_t size, int *has_debug,
+                       uint8_t *build_id, size_t *build_id_len) {
+    *has_debug = 0;
+    *build_id_len = 0;
+    
+    if (size < EI_NIDENT || memcmp(data, ELFMAG, SELFMAG) != 0)
+        return -1;
+    if (data[EI_DATA] != ELFDATA2LSB)
+        return -1;  /* MesaOS y el host son little-endian */
+    
+    int is64 = data[EI_CLASS] == ELFCLASS64;
+    if (!is64 && data[EI_CLASS] != ELFCLASS32)
+        return -1;
+    
+    uint64_t shoff;
+    uint32_t shentsize, shnum, shstrndx;
+    if (is64) {
+        if (size < sizeof(Elf64_Ehdr)) return -1;
+        const Elf64_Ehdr *eh = (const Elf64_Ehdr *)data;
+        shoff = eh->e_shoff; shentsize = eh->e_shentsize;
+        shnum = eh->e_shnum; shstrndx = eh->e_shstrndx;
+    } else {
+        if (size < sizeof(Elf32_Ehdr)) return -1;
+        const Elf32_Ehdr *eh = (const Elf32_Ehdr *)data;
+        shoff = eh->e_shoff; shentsize = eh->e_shentsize;
+        shnum = eh->e_shnum; shstrndx = eh->e_shstrndx;
+    }
+    
+    if (shoff == 0 || shnum == 0 || shstrndx >= shnum ||
+        shentsize < (is64 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr)) ||
+        shoff > size || (uint64_t)shnum * shentsize > size - shoff)
+        return 0;  /* ELF sin tabla de secciones: nada que separar */
+    
+    /* Leer cabeceras de sección de forma uniforme */
+    #define SH_FIELD(i, f) (is64 ? (uint64_t)((const Elf64_Shdr *)(data + shoff + (uint64_t)(i) * shentsize))->f \
+                                 : (uint64_t)((const Elf32_Shdr *)(data + shoff + (uint64_t)(i) * shentsize))->f)
+    
+    uint64_t str_off = SH_FIELD(shstrndx, sh_offset);
+    uint64_t str_size = SH_FIELD(shstrndx, sh_size);
+    if (str_off > size || str_size > size - str_off)
+        return 0;
+    const char *strtab = (const char *)data + str_off;
+    
+    for (uint32_t i = 0; i < shnum; i++) {
+        uint64_t name = SH_FIELD(i, sh_name);
+        uint64_t type = SH_FIELD(i, sh_type);
+        uint64_t off = SH_FIELD(i, sh_offset);
+        uint64_t len = SH_FIELD(i, sh_size);
+        
+        if (name < str_size) {
+            const char *sname = strtab + name;
+            size_t max = str_size - name;
+            if (strncmp(sname, ".debug_", max < 7 ? max : 7) == 0 ||
+                strncmp(sname, ".zdebug_", max < 8 ? max : 8) == 0)
+                *has_debug = 1;
+        }
+        
+        if (type != SHT_NOTE || off > size || len > size - off)
+            continue;
+        
+        /* Recorrer las notas buscando el build-id */
+        uint64_t p = off, end = off + len;
+        while (p + 12 <= end) {
+            uint32_t namesz, descsz, ntype;
+            memcpy(&namesz, data + p, 4);
+            memcpy(&descsz, data + p + 4, 4);
+            memcpy(&ntype, data + p + 8, 4);
+            uint64_t name_p = p + 12;
+            uint64_t desc_p = name_p + ((namesz + 3) & ~3u);
+            uint64_t next = desc_p + ((descsz + 3) & ~3u);
+            if (next > end)
+                break;
+            if (ntype == NT_GNU_BUILD_ID && namesz == 4 &&
+                memcmp(data + name_p, "GNU", 4) == 0 &&
+                descsz > 0 && descsz <= BUILD_ID_MAX) {
+                memcpy(build_id, data + desc_p, descsz);
+                *build_id_len = descsz;
+            }
+            p = next;
+        }
+    }
+    #undef SH_FIELD
+    
+    return 0;
+}
+
+static int run_objcopy(char *const args[]) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+static char *read_whole_file(const char *path, uint32_t *size) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = malloc(len > 0 ? len : 1);
+    if (buf && fread(buf, 1, len, fp) != (size_t)len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+    *size = (uint32_t)len;
+    return buf;
+}
+
+static int write_whole_file(const char *path, const char *data, uint32_t size) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return -1;
+    int ok = fwrite(data, 1, size, fp) == size;
+    return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+/* Añade un directorio al paquete -dbg si aún no existe */
+static int add_dbg_dir(const char *path) {
+    for (int i = 0; i < dbg_file_count; i++) {
+        if (dbg_files[i].type == 1 && strcmp(dbg_files[i].path, path) == 0)
+            return 0;
+    }
+    if (dbg_file_count >= MSA_MAX_FILES) {
+        fprintf(stderr, "Error: Too many debug files (max %d)\n", MSA_MAX_FILES);
+        return -1;
+    }
+    msa_file_entry_t *f = &dbg_files[dbg_file_count];
+    memset(f, 0, sizeof(*f));
+    strncpy(f->path, path, MSA_PATH_MAX - 1);
+    f->type = 1;
+    f->mode = 0755;
+    dbg_file_data[dbg_file_count++] = NULL;
+    return 0;
+}
+
+/* Añade un directorio y todos sus padres (en orden) al paquete -dbg */
+static int add_dbg_dirs(const char *path) {
+    char partial[MSA_PATH_MAX];
+    for (const char *p = path + 1; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            size_t len = p - path;
+            if (len >= sizeof(partial)) return -1;
+            memcpy(partial, path, len);
+            partial[len] = '\0';
+            if (add_dbg_dir(partial) != 0) return -1;
+            if (*p == '\0') break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Separa la información de depuración de un ELF. Si tiene secciones de
+ * debug, reemplaza data y size por la versión sin ellas y añade el archivo
+ * .debug al paquete -dbg, enlazado por build-id (o por ruta si no hay).
+ * Retorna 0 si todo fue bien (haya o no separado algo), -1 en error.
+ */
+static int split_debug_info(const char *install_path, char **data, uint32_t *size) {
+    int has_debug;
+    uint8_t build_id[BUILD_ID_MAX];
+    size_t build_id_len;
+    
+    if (elf_inspect((const uint8_t *)*data, *size, &has_debug, build_id, &build_id_len) != 0 ||
+        !has_debug)
+        return 0;
+    
+    if (!debug_tmpdir[0]) {
+        strcpy(debug_tmpdir, "/tmp/msa-dbg.XXXXXX");
+        if (!mkdtemp(debug_tmpdir)) {
+            perror("mkdtemp");
+            debug_tmpdir[0] = '\0';
+            return -1;
+        }
+    }
+    
+    char orig_path[128], dbg_path[128], stripped_path[128];
+    snprintf(orig_path, sizeof(orig_path), "%s/orig", debug_tmpdir);
+    snprintf(stripped_path, sizeof(stripped_path), "%s/stripped", debug_tmpdir);
+    
+    /* Ruta de instalación del .debug */
+    char debug_install[MSA_PATH_MAX];
+    char debug_parent[MSA_PATH_MAX];
+    if (build_id_len >= 2) {
+        char hex[BUILD_ID_MAX * 2 + 1];
+        for (size_t i = 0; i < build_id_len; i++)
+            sprintf(hex + i * 2, "%02x", build_id[i]);
+        /* Con BUILD_ID_MAX bytes la ruta ocupa como mucho 160: cabe siempre */
+        snprintf(debug_parent, sizeof(debug_parent), MSA_DEBUG_DIR "/.build-id/%.2s", hex);
+        snprintf(debug_install, sizeof(debug_install), MSA_DEBUG_DIR "/.build-id/%.2s/%s.debug",
+                 hex, hex + 2);
+    } else {
+        /* Sin build-id: directorio global de debug + gnu-debuglink */
+        if (snprintf(debug_install, sizeof(debug_install), MSA_DEBUG_DIR "%s%s.debug",
+                     install_path[0] == '/' ? "" : "/", install_path) >= (int)sizeof(debug_install)) {
+            printf("         Warning: debug path for %s too long, debug info kept\n", install_path);
+            return 0;
+        }
+        strncpy(debug_parent, debug_install, sizeof(debug_parent) - 1);
+        debug_parent[sizeof(debug_parent) - 1] = '\0';
+        *strrchr(debug_parent, '/') = '\0';
+    }
+    
+    const char *objcopy = getenv("OBJCOPY");
+    if (!objcopy || !objcopy[0]) objcopy = "objcopy";
+    
+    char debuglink_arg[MSA_PATH_MAX + 32];
+    const char *base = strrchr(debug_install, '/') + 1;
+    snprintf(dbg_path, sizeof(dbg_path), "%s/%s", debug_tmpdir, base);
+    snprintf(debuglink_arg, sizeof(debuglink_arg), "--add-gnu-debuglink=%s", dbg_path);
+    
+    char *keep_args[] = { (char *)objcopy, "--only-keep-debug", orig_path, dbg_path, NULL };
+    char *strip_args[] = { (char *)objcopy, "--strip-debug", orig_path, stripped_path, NULL };
+    char *strip_link_args[] = { (char *)objcopy, "--strip-debug", debuglink_arg,
+                                orig_path, stripped_path, NULL };
+    
+    if (write_whole_file(orig_path, *data, *size) != 0 ||
+        run_objcopy(keep_args) != 0 ||
+        run_objcopy(build_id_len >= 2 ? strip_args : strip_link_args) != 0) {
+        fprintf(stderr, "Error: %s failed on %s\n", objcopy, install_path);
+        unlink(orig_path);
+        unlink(dbg_path);
+        unlink(stripped_path);
+        return -1;
+    }
+    
+    uint32_t dbg_size, stripped_size;
+    char *dbg_data = read_whole_file(dbg_path, &dbg_size);
+    char *stripped_data = read_whole_file(stripped_path, &stripped_size);
+    unlink(orig_path);
+    unlink(dbg_path);
+    unlink(stripped_path);
+    
+    if (!dbg_data || !stripped_data) {
+        perror("read objcopy output");
+        free(dbg_data);
+        free(stripped_data);
+        return -1;
+    }
+    
+    if (add_dbg_dirs(debug_parent) != 0 || dbg_file_count >= MSA_MAX_FILES) {
+        fprintf(stderr, "Error: Too many debug files (max %d)\n", MSA_MAX_FILES);
+        free(dbg_data);
+        free(stripped_data);
+        return -1;
+    }
+    
+    msa_file_entry_t *f = &dbg_files[dbg_file_count];
+    memset(f, 0, sizeof(*f));
+    strncpy(f->path, debug_install, MSA_PATH_MAX - 1);
+    f->type = 0;
+    f->mode = 0644;
+    f->size = dbg_size;
+    dbg_file_data[dbg_file_count++] = dbg_data;
+    dbg_data_size += dbg_size;
+    
+    printf("         -> debug: %s (%u bytes)\n", debug_install, dbg_size);
+    
+    if (stripped_size < *size)
+        debug_bytes_removed += *size - stripped_size;
+    debug_split_count++;
+    
+    free(*data);
+    *data = stripped_data;
+    *size = stripped_size;
+    return 0;
+}
+
 /* ==================== Funciones ==================== */
 
-static uint32_t calculate_crc32(const uint8_t *data, size_t len) {
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < len; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+/* ==================== Archivos dispersos ==================== */
+
+/* Lee len bytes desde offset, reintentando lecturas parciales */
+static int read_range(int fd, char *buf, uint32_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+ * Lee un archivo regular abierto (fd) de size bytes. Con -s, si
+ * SEEK_DATA/SEEK_HOLE encuentran huecos y el mapa de extents más los datos
+ * ocupan menos que size, devuelve el formato disperso y pone *sparse a 1;
+ * si no, el contenido completo. *stored recibe los bytes devueltos.
+ */
+static char *read_file_data(int fd, const char *path, uint32_t size, uint32_t *stored, int *sparse) {
+    msa_extent_t *ext = NULL;
+    uint32_t n = 0, cap = 0;
+    uint64_t data_bytes = 0;
+    int dense = (size == 0 || !sparse_files);
+    
+    for (off_t off = 0; !dense && off < size; ) {
+        off_t d = lseek(fd, off, SEEK_DATA);
+        if (d < 0) {
+            if (errno == ENXIO)
+                break;          /* Solo queda hueco hasta el final */
+            dense = 1;          /* El sistema de archivos no informa de huecos */
+            break;
         }
+        if (d >= size)
+            break;
+        off_t hole = lseek(fd, d, SEEK_HOLE);
+        if (hole < 0 || hole > size)
+            hole = size;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            msa_extent_t *tmp = realloc(ext, cap * sizeof(*ext));
+            if (!tmp) {
+                perror("realloc");
+                free(ext);
+                return NULL;
+            }
+            ext = tmp;
+        }
+        ext[n].offset = d;
+        ext[n].length = hole - d;
+        data_bytes += hole - d;
+        n++;
+        off = hole;
+    }
+    if (4 + (uint64_t)n * sizeof(msa_extent_t) + data_bytes >= size)
+        dense = 1;
+    
+    char *buf;
+    if (dense) {
+        buf = malloc(size ? size : 1);
+        if (buf && read_range(fd, buf, size, 0) != 0) {
+            perror(path);
+            free(buf);
+            buf = NULL;
+        }
+        *stored = size;
+        *sparse = 0;
+    } else {
+        /* u32 n, n extents y los datos de cada uno */
+        *stored = 4 + n * sizeof(msa_extent_t) + data_bytes;
+        buf = malloc(*stored);
+        if (buf) {
+            memcpy(buf, &n, 4);
+            memcpy(buf + 4, ext, n * sizeof(msa_extent_t));
+            char *p = buf + 4 + n * sizeof(msa_extent_t);
+            for (uint32_t i = 0; i < n; i++) {
+                if (read_range(fd, p, ext[i].length, ext[i].offset) != 0) {
+                    perror(path);
+                    free(buf);
+                    buf = NULL;
+                    break;
+                }
+                p += ext[i].length;
+            }
+        }
+        *sparse = 1;
+        hole_bytes += size - data_bytes;
     }
-    return ~crc;
+    
+    free(ext);
+    return buf;
 }
 
-static int scan_directory(const char *dir_path, const char *install_prefix) {
-    DIR *dir = opendir(dir_path);
-    if (!dir) {
-        perror("opendir");
+/* ==================== Compresión ==================== */
+
+/* Carga el diccionario de un paquete creado con msa-dict */
+static int load_dictionary(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
         return -1;
     }
     
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+    msa_header_t h;
+    msa_file_entry_t *entries;
+    uint64_t size;
+    char err[256];
+    if (msa_read_table(fd, &h, &entries, &size, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: %s: %s\n", path, err);
+        close(fd);
+        return -1;
+    }
+    
+    int result = -1;
+    size_t dir_len = strlen(MSA_DICT_DIR);
+    for (uint32_t i = 0; i < h.num_files; i++) {
+        const msa_file_entry_t *e = &entries[i];
+        if (e->type != MSA_TYPE_FILE || e->flags != MSA_ENTRY_CRC ||
+            strncmp(e->path, MSA_DICT_DIR "/", dir_len + 1) != 0)
             continue;
+        if (e->size == 0 || e->size > MSA_DICT_MAX ||
+            pread(fd, dict, e->size, e->offset) != (ssize_t)e->size)
+            break;
+        dict_len = e->size;
+        dict_id = adler32(adler32(0L, Z_NULL, 0), dict, dict_len);
+        if (strtoul(e->path + dir_len + 1, NULL, 16) != dict_id) {
+            fprintf(stderr, "Error: %s: dictionary %s does not match its id %08x\n",
+                    path, e->path, dict_id);
+            break;
+        }
+        memcpy(dict_package, h.name, MSA_NAME_MAX);
+        dict_package[MSA_NAME_MAX - 1] = '\0';
+        result = 0;
+        break;
+    }
+    if (result != 0 && dict_len == 0)
+        fprintf(stderr, "Error: %s is not a dictionary package\n", path);
+    
+    free(entries);
+    close(fd);
+    return result;
+}
+
+/**
+ * Comprime los datos de una entrada en formato zlib (con el diccionario si
+ * lo hay). Solo se queda con la versión comprimida si ocupa menos.
+ */
+static int compress_entry(msa_file_entry_t *e, char **data) {
+    uLong cap = compressBound(e->size);
+    Bytef *out = malloc(cap);
+    if (!out) {
+        perror("malloc");
+        return -1;
+    }
+    
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, Z_BEST_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "Error: deflate init failed\n");
+        free(out);
+        return -1;
+    }
+    if (dict_len && deflateSetDictionary(&zs, dict, dict_len) != Z_OK) {
+        fprintf(stderr, "Error: deflate dictionary rejected\n");
+        deflateEnd(&zs);
+        free(out);
+        return -1;
+    }
+    zs.next_in = (Bytef *)*data;
+    zs.avail_in = e->size;
+    zs.next_out = out;
+    zs.avail_out = cap;
+    int rc = deflate(&zs, Z_FINISH);
+    uLong out_len = zs.total_out;
+    deflateEnd(&zs);
+    
+    if (rc != Z_STREAM_END || out_len >= e->size) {
+        free(out);
+        return 0;
+    }
+    
+    free(*data);
+    *data = (char *)out;
+    e->flags |= MSA_ENTRY_DEFLATE;
+    e->stored_size = out_len;
+    return 0;
+}
+
+/* Tarea del pool: comprime una entrada (si toca) y calcula su CRC */
+typedef struct {
+    msa_file_entry_t *entry;
+    char **data;
+    int compress;
+    int failed;
+} entry_job_t;
+
+static void entry_task(void *arg, int worker) {
+    entry_job_t *job = arg;
+    (void)worker;
+    if (job->compress && compress_entry(job->entry, job->data) != 0) {
+        job->failed = 1;
+        return;
+    }
+    job->entry->crc32 = msa_crc32(*job->data, msa_stored_size(job->entry));
+    job->entry->flags |= MSA_ENTRY_CRC;
+}
+
+/*
+ * Marca un paquete con entradas comprimidas con el diccionario: dict_id en
+ * el header y dependencia del paquete del diccionario, sin el que no se
+ * pueden descomprimir.
+ */
+static int use_dictionary(msa_header_t *header) {
+    header->dict_id = dict_id;
+    for (int i = 0; i < header->num_deps; i++) {
+        if (strncmp(header->deps[i], dict_package, MSA_NAME_MAX) == 0)
+            return 0;
+    }
+    if (header->num_deps >= MSA_MAX_DEPS) {
+        fprintf(stderr, "Error: Too many dependencies (max %d)\n", MSA_MAX_DEPS);
+        return -1;
+    }
+    memcpy(header->deps[header->num_deps++], dict_package, MSA_NAME_MAX);
+    return 0;
+}
+
+/* ==================== Recorrido del árbol ==================== */
+
+/*
+ * El árbol se recorre con descriptores de directorio: getdents64 en bloque,
+ * y openat/readlinkat relativos al directorio, así que el kernel nunca
+ * vuelve a resolver la ruta completa. d_type evita el stat de cada entrada;
+ * solo si vale DT_UNKNOWN se recurre a fstatat.
+ */
+
+/* Registro de getdents64(2) */
+struct linux_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+#define DIRENT_BUF_SIZE     32768
+
+/* Syscalls de metadatos del recorrido */
+static struct {
+    unsigned long getdents;
+    unsigned long openat;
+    unsigned long fstat;
+    unsigned long fstatat;
+    unsigned long readlinkat;
+} walk;
+
+static int scan_directory(int dir_fd, const char *install_prefix);
+
+/* Añade una entrada del directorio dir_fd (y recorre los subdirectorios) */
+static int scan_entry(int dir_fd, const char *name, unsigned char d_type,
+                      const char *install_prefix) {
+    char install_path[MSA_PATH_MAX];
+    snprintf(install_path, sizeof(install_path), "%s/%s", install_prefix, name);
+    
+    struct stat st;
+    int have_stat = 0;
+    if (d_type == DT_UNKNOWN) {
+        walk.fstatat++;
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            perror(install_path);
+            return 0;
+        }
+        have_stat = 1;
+        d_type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK :
+                 S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+    if (d_type != DT_DIR && d_type != DT_LNK && d_type != DT_REG)
+        return 0;
+    
+    if (file_count >= MSA_MAX_FILES) {
+        fprintf(stderr, "Error: Too many files (max %d)\n", MSA_MAX_FILES);
+        return -1;
+    }
+    
+    if (d_type == DT_LNK) {
+        /* Enlace simbólico: solo el destino */
+        char *target = malloc(PATH_MAX);
+        walk.readlinkat++;
+        ssize_t len = target ? readlinkat(dir_fd, name, target, PATH_MAX) : -1;
+        if (len <= 0 || len >= PATH_MAX) {
+            perror("readlink");
+            free(target);
+            return 0;
+        }
         
-        char full_path[1024];
-        char install_path[MSA_PATH_MAX];
+        msa_file_entry_t *f = &files[file_count];
+        memset(f, 0, sizeof(*f));
+        strncpy(f->path, install_path, MSA_PATH_MAX - 1);
+        f->type = MSA_TYPE_SYMLINK;
+        f->mode = 0777;
+        f->size = len;
         
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-        snprintf(install_path, sizeof(install_path), "%s/%s", install_prefix, entry->d_name);
+        file_data[file_count] = target;
+        total_data_size += len;
+        symlink_count++;
         
-        struct stat st;
-        if (stat(full_path, &st) != 0) {
-            perror("stat");
-            continue;
+        printf("  [LINK] %s -> %.*s\n", install_path, (int)len, target);
+        
+        file_count++;
+        return 0;
+    }
+    
+    /* Directorios y archivos se abren; el modo y tamaño salen de fstat(fd) */
+    int flags = O_RDONLY | O_NOFOLLOW | O_CLOEXEC | (d_type == DT_DIR ? O_DIRECTORY : 0);
+    walk.openat++;
+    int fd = openat(dir_fd, name, flags);
+    if (fd < 0) {
+        perror(install_path);
+        return 0;
+    }
+    if (!have_stat) {
+        walk.fstat++;
+        if (fstat(fd, &st) != 0) {
+            perror(install_path);
+            close(fd);
+            return 0;
         }
+    }
+    
+    if (d_type == DT_DIR) {
+        /* Directorio */
+        msa_file_entry_t *f = &files[file_count];
+        memset(f, 0, sizeof(*f));
+        strncpy(f->path, install_path, MSA_PATH_MAX - 1);
+        f->type = 1;  /* Directorio */
+        f->mode = st.st_mode & 0777;
+        f->size = 0;
+        f->offset = 0;
+        file_data[file_count] = NULL;
+        file_count++;
         
-        if (file_count >= MSA_MAX_FILES) {
-            fprintf(stderr, "Error: Too many files (max %d)\n", MSA_MAX_FILES);
-            closedir(dir);
+        printf("  [DIR]  %s\n", install_path);
+        
+        /* Recursivo */
+        int result = scan_directory(fd, install_path);
+        close(fd);
+        return result;
+    }
+    
+    /* Archivo regular */
+    if (st.st_size > UINT32_MAX) {
+        fprintf(stderr, "Error: %s too large\n", install_path);
+        close(fd);
+        return 0;
+    }
+    uint32_t stored;
+    int sparse;
+    char *data = read_file_data(fd, install_path, st.st_size, &stored, &sparse);
+    close(fd);
+    if (!data)
+        return 0;
+    
+    uint32_t size = st.st_size;
+    if (split_debug && !sparse && split_debug_info(install_path, &data, &size) != 0) {
+        free(data);
+        return -1;
+    }
+    
+    msa_file_entry_t *f = &files[file_count];
+    memset(f, 0, sizeof(*f));
+    strncpy(f->path, install_path, MSA_PATH_MAX - 1);
+    f->type = 0;  /* Archivo */
+    f->mode = st.st_mode & 0777;
+    f->size = size;
+    f->executable = (st.st_mode & S_IXUSR) ? 1 : 0;
+    if (sparse) {
+        f->flags |= MSA_ENTRY_SPARSE;
+        f->stored_size = stored;
+        sparse_count++;
+    }
+    
+    file_data[file_count] = data;
+    total_data_size += size;
+    
+    if (sparse)
+        printf("  [FILE] %s (%u bytes, sparse, %u stored)%s\n", install_path,
+               (unsigned)size, stored, f->executable ? " [exec]" : "");
+    else
+        printf("  [FILE] %s (%u bytes)%s\n", install_path,
+               (unsigned)size, f->executable ? " [exec]" : "");
+    
+    file_count++;
+    return 0;
+}
+
+/* Recorre un directorio abierto leyendo las entradas con getdents64 */
+static int scan_directory(int dir_fd, const char *install_prefix) {
+    char *buf = malloc(DIRENT_BUF_SIZE);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+    for (;;) {
+        walk.getdents++;
+        long n = syscall(SYS_getdents64, dir_fd, buf, DIRENT_BUF_SIZE);
+        if (n < 0) {
+            perror("getdents64");
+            free(buf);
             return -1;
         }
+        if (n == 0)
+            break;
         
-        if (S_ISDIR(st.st_mode)) {
-            /* Directorio */
-            msa_file_entry_t *f = &files[file_count];
-            memset(f, 0, sizeof(*f));
-            strncpy(f->path, install_path, MSA_PATH_MAX - 1);
-            f->type = 1;  /* Directorio */
-            f->mode = st.st_mode & 0777;
-            f->size = 0;
-            f->offset = 0;
-            file_data[file_count] = NULL;
-            file_count++;
-            
-            printf("  [DIR]  %s\n", install_path);
-            
-            /* Recursivo */
-            if (scan_directory(full_path, install_path) != 0) {
-                closedir(dir);
-                return -1;
-            }
-        } else if (S_ISREG(st.st_mode)) {
-            /* Archivo regular */
-            FILE *fp = fopen(full_path, "rb");
-            if (!fp) {
-                perror("fopen");
-                continue;
-            }
-            
-            char *data = malloc(st.st_size);
-            if (!data) {
-                perror("malloc");
-                fclose(fp);
+        for (long pos = 0; pos < n; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + pos);
+            pos += d->d_reclen;
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
                 continue;
+            if (scan_entry(dir_fd, d->d_name, d->d_type, install_prefix) != 0) {
+                free(buf);
+                return -1;
             }
-            
-            if (fread(data, 1, st.st_size, fp) != (size_t)st.st_size) {
-                perror("fread");
-                free(data);
+        }
+    }
+    
+    free(buf);
+    return 0;
+}
+
+/* ==================== Orden de los datos ==================== */
+
+/**
+ * Carga un manifiesto de orden de acceso: una ruta de instalación por línea
+ * (un directorio cubre todo lo que contiene); '#' inicia un comentario.
+ */
+static int load_manifest(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    
+    char line[MSA_PATH_MAX + 2];
+    int cap = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                           line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '/'))
+            line[--len] = '\0';
+        char *start = line;
+        while (*start == ' ' || *start == '\t')
+            start++;
+        if (*start == '\0')
+            continue;
+        
+        if (manifest_count == cap) {
+            cap = cap ? cap * 2 : 64;
+            void *tmp = realloc(manifest, cap * sizeof(*manifest));
+            if (!tmp) {
+                perror("realloc");
                 fclose(fp);
-                continue;
+                return -1;
             }
-            fclose(fp);
-            
-            msa_file_entry_t *f = &files[file_count];
-            memset(f, 0, sizeof(*f));
-            strncpy(f->path, install_path, MSA_PATH_MAX - 1);
-            f->type = 0;  /* Archivo */
-            f->mode = st.st_mode & 0777;
-            f->size = st.st_size;
-            f->executable = (st.st_mode & S_IXUSR) ? 1 : 0;
-            
-            file_data[file_count] = data;
-            total_data_size += st.st_size;
-            
-            printf("  [FILE] %s (%u bytes)%s\n", install_path, 
-                   (unsigned)st.st_size, f->executable ? " [exec]" : "");
-            
-            file_count++;
+            manifest = tmp;
         }
+        snprintf(manifest[manifest_count++], MSA_PATH_MAX, "%s%s",
+                 *start == '/' ? "" : "/", start);
     }
     
-    closedir(dir);
+    fclose(fp);
+    return 0;
+}
+
+/* Posición de path en el manifiesto (o manifest_count si no aparece) */
+static int manifest_rank(const char *path) {
+    for (int i = 0; i < manifest_count; i++) {
+        size_t len = strlen(manifest[i]);
+        if (strncmp(path, manifest[i], len) == 0 && (path[len] == '\0' || path[len] == '/'))
+            return i;
+    }
+    return manifest_count;
+}
+
+/* Compara por directorio contenedor y, dentro de él, por nombre */
+static int compare_dir(const char *a, const char *b) {
+    const char *sa = strrchr(a, '/');
+    const char *sb = strrchr(b, '/');
+    size_t la = sa ? (size_t)(sa - a) : 0;
+    size_t lb = sb ? (size_t)(sb - b) : 0;
+    int cmp = memcmp(a, b, la < lb ? la : lb);
+    if (cmp != 0)
+        return cmp;
+    if (la != lb)
+        return la < lb ? -1 : 1;
+    return strcmp(a, b);
+}
+
+static int compare_layout(const void *pa, const void *pb) {
+    uint32_t ia = *(const uint32_t *)pa, ib = *(const uint32_t *)pb;
+    const msa_file_entry_t *a = &layout_entries[ia], *b = &layout_entries[ib];
+    
+    /* Los directorios no tienen datos: primero, en el orden del escaneo */
+    int fa = a->type != MSA_TYPE_DIR, fb = b->type != MSA_TYPE_DIR;
+    if (fa != fb || !fa)
+        return fa != fb ? fa - fb : (ia > ib) - (ia < ib);
+    
+    int ra = manifest_rank(a->path), rb = manifest_rank(b->path);
+    if (ra != rb)
+        return ra - rb;
+    
+    if (layout_policy == LAYOUT_SIZE && a->size != b->size)
+        return a->size < b->size ? -1 : 1;
+    if (layout_policy != LAYOUT_SCAN) {
+        int cmp = compare_dir(a->path, b->path);
+        if (cmp != 0)
+            return cmp;
+    }
+    return (ia > ib) - (ia < ib);
+}
+
+/* Orden de los datos de entries según la política y el manifiesto */
+static void compute_layout(const msa_file_entry_t *entries, int count, uint32_t *layout) {
+    for (int i = 0; i < count; i++)
+        layout[i] = i;
+    layout_entries = entries;
+    qsort(layout, count, sizeof(uint32_t), compare_layout);
+}
+
+/* Reordena entradas y datos según order */
+static int apply_order(msa_file_entry_t *entries, char **data, int count, const uint32_t *order) {
+    msa_file_entry_t *tmp_e = malloc(count * sizeof(*tmp_e));
+    char **tmp_d = malloc(count * sizeof(*tmp_d));
+    if (!tmp_e || !tmp_d) {
+        free(tmp_e);
+        free(tmp_d);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        tmp_e[i] = entries[order[i]];
+        tmp_d[i] = data[order[i]];
+    }
+    memcpy(entries, tmp_e, count * sizeof(*tmp_e));
+    memcpy(data, tmp_d, count * sizeof(*tmp_d));
+    free(tmp_e);
+    free(tmp_d);
     return 0;
 }
 
+/**
+ * Escribe un paquete completo: header, file table y datos. Calcula los
+ * offsets de cada archivo y el checksum final. El formato (v1 o v2
+ * compacto) lo indica header->version.
+ * Retorna el tamaño total escrito, o -1 en error.
+ */
+static long write_package(const char *output_file, msa_header_t *header,
+                          msa_file_entry_t *entries, char **data, int count) {
+    /*
+     * v2 exige la tabla ordenada por ruta; en v1 la tabla sigue el orden de
+     * los datos (directorios primero), así que recorrerla tampoco retrocede.
+     */
+    uint32_t order[MSA_MAX_FILES];
+    if (header->version == MSA_VERSION_COMPACT)
+        msa_sort_order(entries, count, order);
+    else
+        compute_layout(entries, count, order);
+    if (count > 0 && apply_order(entries, data, count, order) != 0) {
+        perror("malloc");
+        return -1;
+    }
+    
+    /*
+     * Compresión (no de los dispersos ni de los enlaces) y CRC de cada
+     * archivo y enlace: una tarea del pool por entrada
+     */
+    entry_job_t *jobs = calloc(count ? count : 1, sizeof(*jobs));
+    if (!jobs) {
+        perror("calloc");
+        return -1;
+    }
+    pool_t *pool = pool_get();
+    for (int i = 0; i < count; i++) {
+        if (entries[i].type == MSA_TYPE_DIR)
+            continue;
+        jobs[i].entry = &entries[i];
+        jobs[i].data = &data[i];
+        jobs[i].compress = compress_files && entries[i].type == MSA_TYPE_FILE &&
+                           entries[i].size > 0 &&
+                           !(entries[i].flags & (MSA_ENTRY_SPARSE | MSA_ENTRY_DEFLATE));
+        if (!pool || pool_submit(pool, entry_task, &jobs[i]) != 0)
+            entry_task(&jobs[i], 0);
+    }
+    if (pool)
+        pool_wait(pool);
+    
+    int failed = 0, deflated = 0;
+    for (int i = 0; i < count; i++) {
+        failed |= jobs[i].failed;
+        if (jobs[i].compress && (entries[i].flags & MSA_ENTRY_DEFLATE)) {
+            deflated = 1;
+            compressed_count++;
+            compressed_in += entries[i].size;
+            compressed_out += entries[i].stored_size;
+        }
+    }
+    free(jobs);
+    if (failed || (deflated && dict_len && use_dictionary(header) != 0))
+        return -1;
+    
+    /* Offsets (relativos a los datos), en el orden de los datos */
+    uint32_t layout[MSA_MAX_FILES];
+    compute_layout(entries, count, layout);
+    uint32_t current_offset = 0;
+    
+    for (int k = 0; k < count; k++) {
+        int i = layout[k];
+        if (entries[i].type != MSA_TYPE_DIR) {  /* Archivos y enlaces */
+            entries[i].offset = current_offset;
+            current_offset += msa_stored_size(&entries[i]);
+        }
+    }
+    
+    /* Header y file table en el formato pedido */
+    uint8_t *table;
+    size_t table_len;
+    if (msa_build_header(header, entries, count, &table, &table_len) != 0) {
+        fprintf(stderr, "Error: cannot encode package header\n");
+        return -1;
+    }
+    
+    /* Escribir archivo */
+    FILE *out = fopen(output_file, "wb");
+    if (!out) {
+        perror("fopen output");
+        free(table);
+        return -1;
+    }
+    
+    /* Escribir header y file table */
+    fwrite(table, 1, table_len, out);
+    uint32_t checksum = msa_crc32(table, table_len);
+    
+    /* Escribir datos; el checksum se combina con el CRC de cada archivo */
+    for (int k = 0; k < count; k++) {
+        int i = layout[k];
+        if (entries[i].type != MSA_TYPE_DIR && data[i]) {
+            uint32_t stored = msa_stored_size(&entries[i]);
+            fwrite(data[i], 1, stored, out);
+            checksum = msa_crc32_combine(checksum, entries[i].crc32, stored);
+        }
+    }
+    
+    long total_size = ftell(out);
+    
+    /* Reescribir header con checksum */
+    header->checksum = checksum;
+    memcpy(table + msa_checksum_offset(table), &checksum, 4);
+    fseek(out, 0, SEEK_SET);
+    fwrite(table, 1, table_len, out);
+    free(table);
+    
+    if (fclose(out) != 0) {
+        perror("fclose output");
+        return -1;
+    }
+    
+    return total_size;
+}
+
 static void print_usage(const char *prog) {
     printf("MesaOS Package Creator v1.0\n\n");
     printf("Usage: %s [options] <source-dir> <output.msa>\n\n", prog);
@@ -177,7 +1065,17 @@ static void print_usage(const char *prog) {
     printf("  -d <description> Package description\n");
     printf("  -D <dep>         Add dependency (can repeat)\n");
     printf("  -p <prefix>      Install prefix (default: /)\n");
+    printf("  -g               Split ELF debug info into <name>-dbg.msa\n");
+    printf("  -2               Use the compact v2 header/file-table encoding\n");
+    printf("  -s               Store files with holes as sparse extent maps\n");
+    printf("  -L <policy>      Data order: dir (default), size or scan\n");
+    printf("  -M <manifest>    Access-order manifest: listed paths go first\n");
+    printf("  -z               Compress files with deflate\n");
+    printf("  -Z <dict.msa>    Compress with a shared dictionary from msa-dict (implies -z)\n");
+    printf("  -j <threads>     Compression threads (default: $MESA_JOBS or online CPUs)\n");
     printf("  -h               Show this help\n");
+    printf("\nThe summary counts the metadata syscalls this run's tree walk issued;\n");
+    printf("it is not compared with other walks (measure those with strace -c).\n");
     printf("\nExample:\n");
     printf("  %s -n hello -v 1.0.0 -a \"John\" -d \"Hello World\" ./pkg-root hello.msa\n", prog);
 }
@@ -190,9 +1088,10 @@ int main(int argc, char **argv) {
     char *prefix = "";
     char *deps[MSA_MAX_DEPS];
     int num_deps = 0;
+    uint32_t format = MSA_VERSION;
     
     int opt;
-    while ((opt = getopt(argc, argv, "n:v:a:d:D:p:h")) != -1) {
+    while ((opt = getopt(argc, argv, "n:v:a:d:D:p:g2sL:M:zZ:j:h")) != -1) {
         switch (opt) {
             case 'n': name = optarg; break;
             case 'v': version = optarg; break;
@@ -204,6 +1103,29 @@ int main(int argc, char **argv) {
                 }
                 break;
             case 'p': prefix = optarg; break;
+            case 'g': split_debug = 1; break;
+            case '2': format = MSA_VERSION_COMPACT; break;
+            case 's': sparse_files = 1; break;
+            case 'L':
+                if (strcmp(optarg, "dir") == 0) layout_policy = LAYOUT_DIR;
+                else if (strcmp(optarg, "size") == 0) layout_policy = LAYOUT_SIZE;
+                else if (strcmp(optarg, "scan") == 0) layout_policy = LAYOUT_SCAN;
+                else {
+                    fprintf(stderr, "Error: unknown layout policy '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'M':
+                if (load_manifest(optarg) != 0)
+                    return 1;
+                break;
+            case 'z': compress_files = 1; break;
+            case 'Z':
+                if (load_dictionary(optarg) != 0)
+                    return 1;
+                compress_files = 1;
+                break;
+            case 'j': pool_set_width(atol(optarg)); break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -227,89 +1149,131 @@ int main(int argc, char **argv) {
     printf("\nScanning files...\n");
     
     /* Escanear directorio */
-    if (scan_directory(source_dir, prefix) != 0) {
+    walk.openat++;
+    int root_fd = open(source_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        perror(source_dir);
+        return 1;
+    }
+    int scan_result = scan_directory(root_fd, prefix);
+    close(root_fd);
+    if (debug_tmpdir[0]) rmdir(debug_tmpdir);
+    if (scan_result != 0) {
         fprintf(stderr, "Error scanning directory\n");
         return 1;
     }
     
     printf("\nFound %d files/directories\n", file_count);
     
-    /* Calcular offsets */
-    uint32_t header_size = sizeof(msa_header_t) + (file_count * sizeof(msa_file_entry_t));
-    uint32_t current_offset = header_size;
-    
-    for (int i = 0; i < file_count; i++) {
-        if (files[i].type == 0) {  /* Solo archivos */
-            files[i].offset = current_offset;
-            current_offset += files[i].size;
-        }
-    }
-    
     /* Crear header */
     msa_header_t header;
     memset(&header, 0, sizeof(header));
     header.magic = MSA_MAGIC;
-    header.version = MSA_VERSION;
+    header.version = format;
     strncpy(header.name, name, MSA_NAME_MAX - 1);
     strncpy(header.pkg_version, version, 15);
     strncpy(header.author, author, MSA_NAME_MAX - 1);
     strncpy(header.description, description, MSA_DESC_MAX - 1);
-    header.num_files = file_count;
     header.total_size = total_data_size;
-    header.header_size = header_size;
     header.num_deps = num_deps;
     
     for (int i = 0; i < num_deps; i++) {
         strncpy(header.deps[i], deps[i], MSA_NAME_MAX - 1);
     }
     
-    /* Escribir archivo */
-    FILE *out = fopen(output_file, "wb");
-    if (!out) {
-        perror("fopen output");
+    long total_size = write_package(output_file, &header, files, file_data, file_count);
+    if (total_size < 0) {
         return 1;
     }
     
-    /* Escribir header */
-    fwrite(&header, sizeof(header), 1, out);
-    
-    /* Escribir file table */
-    for (int i = 0; i < file_count; i++) {
-        fwrite(&files[i], sizeof(msa_file_entry_t), 1, out);
+    printf("\nPackage created successfully!\n");
+    printf("  Total size: %ld bytes\n", total_size);
+    printf("  Header size: %u bytes (format v%u)\n", header.header_size, header.version);
+    printf("  Files: %d\n", file_count);
+    printf("  Data size: %u bytes\n", total_data_size);
+    if (symlink_count > 0)
+        printf("  Symlinks: %d\n", symlink_count);
+    if (compressed_count > 0) {
+        printf("  Compressed: %d files, %llu -> %llu bytes", compressed_count,
+               (unsigned long long)compressed_in, (unsigned long long)compressed_out);
+        if (dict_len)
+            printf(" (dictionary %08x)", dict_id);
+        printf("\n");
     }
     
-    /* Escribir datos */
-    for (int i = 0; i < file_count; i++) {
-        if (files[i].type == 0 && file_data[i]) {
-            fwrite(file_data[i], 1, files[i].size, out);
+    unsigned long walk_calls = walk.getdents + walk.openat + walk.fstat + walk.fstatat +
+                               walk.readlinkat;
+    printf("  Walk syscalls: %lu (getdents64 %lu, openat %lu, fstat %lu, fstatat %lu, "
+           "readlinkat %lu)\n", walk_calls, walk.getdents, walk.openat, walk.fstat,
+           walk.fstatat, walk.readlinkat);
+    if (sparse_count > 0)
+        printf("  Sparse files: %d (%llu bytes of holes not stored)\n", sparse_count,
+               (unsigned long long)hole_bytes);
+    
+    static const char *const layout_names[] = { "scan", "dir", "size" };
+    printf("  Layout: %s", layout_names[layout_policy]);
+    if (manifest_count > 0) {
+        int placed = 0;
+        for (int i = 0; i < file_count; i++) {
+            if (files[i].type != MSA_TYPE_DIR && manifest_rank(files[i].path) < manifest_count)
+                placed++;
         }
+        printf(", %d files placed by manifest", placed);
+    }
+    printf("\n");
+    for (int i = 0; i < manifest_count; i++) {
+        int used = 0;
+        for (int j = 0; j < file_count && !used; j++) {
+            size_t len = strlen(manifest[i]);
+            used = strncmp(files[j].path, manifest[i], len) == 0 &&
+                   (files[j].path[len] == '\0' || files[j].path[len] == '/');
+        }
+        if (!used)
+            printf("  Warning: manifest path %s not in package\n", manifest[i]);
     }
     
-    /* Calcular y escribir checksum */
-    fseek(out, 0, SEEK_END);
-    long total_size = ftell(out);
-    fseek(out, 0, SEEK_SET);
-    
-    uint8_t *all_data = malloc(total_size);
-    fread(all_data, 1, total_size, out);
-    header.checksum = calculate_crc32(all_data, total_size);
-    free(all_data);
-    
-    /* Reescribir header con checksum */
-    fseek(out, 0, SEEK_SET);
-    fwrite(&header, sizeof(header), 1, out);
-    
-    fclose(out);
-    
-    printf("\nPackage created successfully!\n");
-    printf("  Total size: %ld bytes\n", total_size);
-    printf("  Files: %d\n", file_count);
-    printf("  Data size: %u bytes\n", total_data_size);
+    /* Paquete de depuración */
+    if (split_debug && dbg_file_count > 0) {
+        char dbg_output[1024];
+        size_t out_len = strlen(output_file);
+        if (out_len > 4 && strcmp(output_file + out_len - 4, ".msa") == 0)
+            out_len -= 4;
+        snprintf(dbg_output, sizeof(dbg_output), "%.*s-dbg.msa", (int)out_len, output_file);
+        
+        msa_header_t dbg_header;
+        memset(&dbg_header, 0, sizeof(dbg_header));
+        dbg_header.magic = MSA_MAGIC;
+        dbg_header.version = format;
+        snprintf(dbg_header.name, MSA_NAME_MAX, "%.*s-dbg", MSA_NAME_MAX - 5, name);
+        strncpy(dbg_header.pkg_version, version, 15);
+        strncpy(dbg_header.author, author, MSA_NAME_MAX - 1);
+        snprintf(dbg_header.description, MSA_DESC_MAX, "Debug symbols for %s", name);
+        dbg_header.total_size = dbg_data_size;
+        dbg_header.num_deps = 1;
+        strncpy(dbg_header.deps[0], name, MSA_NAME_MAX - 1);
+        
+        long dbg_total = write_package(dbg_output, &dbg_header, dbg_files, dbg_file_data,
+                                       dbg_file_count);
+        if (dbg_total < 0) {
+            return 1;
+        }
+        
+        printf("\nDebug package created: %s\n", dbg_output);
+        printf("  Total size: %ld bytes\n", dbg_total);
+        printf("  Binaries split: %d\n", debug_split_count);
+        printf("  Debug bytes removed from %s: %u\n", output_file, debug_bytes_removed);
+    } else if (split_debug) {
+        printf("\nNo debug info found, %s-dbg not created\n", name);
+    }
     
     /* Limpiar */
     for (int i = 0; i < file_count; i++) {
         if (file_data[i]) free(file_data[i]);
     }
+    for (int i = 0; i < dbg_file_count; i++) {
+        if (dbg_file_data[i]) free(dbg_file_data[i]);
+    }
+    free(manifest);
     
     return 0;
 }
\ No newline at end of file
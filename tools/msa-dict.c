@@ -0,0 +1,394 @@
+/**
+ * @file msa-dict.c
+ * @brief Entrena un diccionario de compresión compartido a partir de paquetes
+ *
+ * Compilar: gcc -o msa-dict msa-dict.c msa.c -lz
+ * Uso: ./msa-dict [opciones] <salida.msa> <paquete.msa>...
+ *
+ * Los paquetes pequeños comprimidos por separado apenas ganan: deflate no
+ * tiene historia al empezar cada archivo. Un diccionario preestablecido con
+ * el contenido que se repite entre paquetes (cabeceras ELF, scripts,
+ * configuración) da esa historia a todos. El diccionario se publica como un
+ * paquete más, msa-dict-<id>, y msa-create -Z lo usa.
+ *
+ * El entrenamiento sigue la idea de COVER (zstd): se cuenta en cuántas
+ * muestras aparece cada d-mer, se divide el corpus en épocas y de cada una
+ * se toma el segmento cuyos d-mers son más frecuentes; esos d-mers dejan de
+ * puntuar para no repetir contenido. Los mejores segmentos van al final del
+ * diccionario, donde las distancias de deflate son más cortas.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "msa.h"
+
+/* ==================== Constantes ==================== */
+
+#define DMER_SIZE           8           /* Bytes por d-mer */
+#define HASH_BITS           20
+#define HASH_SIZE           (1u << HASH_BITS)
+#define SAMPLE_MAX          (64 * 1024) /* Bytes por muestra */
+#define CORPUS_MAX          (16 * 1024 * 1024)
+#define NO_DMER             UINT32_MAX
+
+/* ==================== Variables Globales ==================== */
+
+static uint8_t *corpus;
+static uint32_t corpus_size = 0;
+static uint32_t *sample_start;          /* Inicio de cada muestra en corpus */
+static uint32_t sample_count = 0;
+static uint32_t sample_cap = 0;
+
+/* ==================== Corpus ==================== */
+
+static int add_sample(const uint8_t *data, uint32_t len) {
+    if (len < DMER_SIZE)
+        return 0;
+    if (len > SAMPLE_MAX)
+        len = SAMPLE_MAX;
+    if (corpus_size + len > CORPUS_MAX)
+        return 0;
+    if (sample_count + 1 >= sample_cap) {
+        sample_cap = sample_cap ? sample_cap * 2 : 256;
+        uint32_t *tmp = realloc(sample_start, sample_cap * sizeof(uint32_t));
+        if (!tmp)
+            return -1;
+        sample_start = tmp;
+    }
+    memcpy(corpus + corpus_size, data, len);
+    sample_start[sample_count++] = corpus_size;
+    corpus_size += len;
+    sample_start[sample_count] = corpus_size;
+    return 0;
+}
+
+/* Añade como muestras los archivos de un paquete (sin comprimir ni dispersos) */
+static int load_package(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    msa_header_t h;
+    msa_file_entry_t *entries;
+    uint64_t size;
+    char err[256];
+    if (msa_read_table(fd, &h, &entries, &size, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: %s: %s\n", path, err);
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *buf = malloc(SAMPLE_MAX);
+    int result = buf ? 0 : -1;
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < h.num_files && result == 0; i++) {
+        const msa_file_entry_t *e = &entries[i];
+        if (e->type != MSA_TYPE_FILE || (e->flags & (MSA_ENTRY_SPARSE | MSA_ENTRY_DEFLATE)))
+            continue;
+        uint32_t len = e->size < SAMPLE_MAX ? e->size : SAMPLE_MAX;
+        if (pread(fd, buf, len, e->offset) != (ssize_t)len) {
+            perror(path);
+            result = -1;
+            break;
+        }
+        result = add_sample(buf, len);
+        used++;
+    }
+
+    printf("  %s: %u samples\n", path, used);
+    free(buf);
+    free(entries);
+    close(fd);
+    return result;
+}
+
+/* ==================== Entrenamiento ==================== */
+
+static uint32_t dmer_hash(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS));
+}
+
+typedef struct {
+    uint32_t start;
+    uint32_t score;
+} segment_t;
+
+static int compare_score(const void *a, const void *b) {
+    const segment_t *sa = a, *sb = b;
+    if (sa->score != sb->score)
+        return sa->score < sb->score ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Construye un diccionario de dict_size bytes con segmentos de seg_size.
+ * Retorna los bytes escritos en dict.
+ */
+static uint32_t train(uint8_t *dict, uint32_t dict_size, uint32_t seg_size) {
+    uint32_t *dmer = malloc((size_t)corpus_size * sizeof(uint32_t));
+    uint32_t *freq = calloc(HASH_SIZE, sizeof(uint32_t));
+    uint32_t *last = malloc(HASH_SIZE * sizeof(uint32_t));
+    uint32_t nseg = dict_size / seg_size;
+    segment_t *chosen = malloc((nseg ? nseg : 1) * sizeof(segment_t));
+    uint32_t out = 0;
+
+    if (!dmer || !freq || !last || !chosen) {
+        perror("malloc");
+        goto done;
+    }
+    memset(last, 0xFF, HASH_SIZE * sizeof(uint32_t));
+
+    /* Frecuencia de cada d-mer = muestras distintas que lo contienen */
+    for (uint32_t s = 0; s < sample_count; s++) {
+        uint32_t end = sample_start[s + 1];
+        for (uint32_t i = sample_start[s]; i < end; i++) {
+            if (i + DMER_SIZE > end) {
+                dmer[i] = NO_DMER;
+                continue;
+            }
+            uint32_t h = dmer_hash(corpus + i);
+            dmer[i] = h;
+            if (last[h] != s) {
+                last[h] = s;
+                freq[h]++;
+            }
+        }
+    }
+    /* Lo que solo aparece en una muestra no sirve a las demás */
+    for (uint32_t h = 0; h < HASH_SIZE; h++) {
+        if (freq[h] < 2)
+            freq[h] = 0;
+    }
+
+    /* Una época por segmento: el mejor segmento de cada una */
+    uint32_t epoch = corpus_size / (nseg ? nseg : 1);
+    uint32_t count = 0;
+    for (uint32_t ep = 0; ep < nseg && epoch >= seg_size; ep++) {
+        uint32_t begin = ep * epoch;
+        uint32_t end = begin + epoch;
+        uint64_t score = 0, best = 0;
+        uint32_t best_start = begin;
+
+        for (uint32_t i = begin; i < begin + seg_size; i++)
+            score += dmer[i] != NO_DMER ? freq[dmer[i]] : 0;
+        best = score;
+        for (uint32_t i = begin + 1; i + seg_size <= end; i++) {
+            uint32_t out_d = dmer[i - 1], in_d = dmer[i + seg_size - 1];
+            score -= out_d != NO_DMER ? freq[out_d] : 0;
+            score += in_d != NO_DMER ? freq[in_d] : 0;
+            if (score > best) {
+                best = score;
+                best_start = i;
+            }
+        }
+        if (best == 0)
+            continue;
+
+        chosen[count].start = best_start;
+        chosen[count].score = best > UINT32_MAX ? UINT32_MAX : best;
+        count++;
+        for (uint32_t i = best_start; i < best_start + seg_size; i++) {
+            if (dmer[i] != NO_DMER)
+                freq[dmer[i]] = 0;
+        }
+    }
+
+    /* Los de más puntuación al final */
+    qsort(chosen, count, sizeof(segment_t), compare_score);
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(dict + out, corpus + chosen[i].start, seg_size);
+        out += seg_size;
+    }
+
+done:
+    free(dmer);
+    free(freq);
+    free(last);
+    free(chosen);
+    return out;
+}
+
+/* Tamaño total de las muestras comprimidas una a una, con o sin diccionario */
+static uint64_t compressed_total(const uint8_t *dict, uint32_t dict_len) {
+    uint64_t total = 0;
+    uLong cap = compressBound(SAMPLE_MAX);
+    uint8_t *buf = malloc(cap);
+    if (!buf)
+        return 0;
+
+    for (uint32_t s = 0; s < sample_count; s++) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit(&zs, Z_BEST_COMPRESSION) != Z_OK)
+            break;
+        if (dict_len)
+            deflateSetDictionary(&zs, dict, dict_len);
+        zs.next_in = corpus + sample_start[s];
+        zs.avail_in = sample_start[s + 1] - sample_start[s];
+        zs.next_out = buf;
+        zs.avail_out = cap;
+        deflate(&zs, Z_FINISH);
+        total += zs.total_out;
+        deflateEnd(&zs);
+    }
+
+    free(buf);
+    return total;
+}
+
+/* ==================== Salida ==================== */
+
+/* Escribe el diccionario como paquete con MSA_DICT_DIR/<id>.dict */
+static int write_dict_package(const char *output_file, const char *name, const char *version,
+                              uint32_t format, const uint8_t *dict, uint32_t dict_len,
+                              uint32_t dict_id) {
+    static const char *const dirs[] = { "/usr", "/usr/share", "/usr/share/msa", MSA_DICT_DIR };
+    msa_file_entry_t entries[5];
+    memset(entries, 0, sizeof(entries));
+    for (int i = 0; i < 4; i++) {
+        strncpy(entries[i].path, dirs[i], MSA_PATH_MAX - 1);
+        entries[i].type = MSA_TYPE_DIR;
+        entries[i].mode = 0755;
+    }
+    msa_file_entry_t *f = &entries[4];
+    snprintf(f->path, MSA_PATH_MAX, "%s/%08x.dict", MSA_DICT_DIR, dict_id);
+    f->type = MSA_TYPE_FILE;
+    f->mode = 0644;
+    f->size = dict_len;
+    f->offset = 0;
+    f->crc32 = msa_crc32(dict, dict_len);
+    f->flags = MSA_ENTRY_CRC;
+
+    msa_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MSA_MAGIC;
+    header.version = format;
+    strncpy(header.name, name, MSA_NAME_MAX - 1);
+    strncpy(header.pkg_version, version, 15);
+    strncpy(header.author, "msa-dict", MSA_NAME_MAX - 1);
+    snprintf(header.description, MSA_DESC_MAX, "Shared compression dictionary %08x", dict_id);
+    header.total_size = dict_len;
+
+    uint8_t *table;
+    size_t table_len;
+    if (msa_build_header(&header, entries, 5, &table, &table_len) != 0) {
+        fprintf(stderr, "Error: cannot encode package header\n");
+        return -1;
+    }
+    uint32_t crc = msa_crc32_combine(msa_crc32(table, table_len), f->crc32, dict_len);
+    memcpy(table + msa_checksum_offset(table), &crc, 4);
+
+    FILE *out = fopen(output_file, "wb");
+    if (!out) {
+        perror(output_file);
+        free(table);
+        return -1;
+    }
+    int ok = fwrite(table, 1, table_len, out) == table_len &&
+             fwrite(dict, 1, dict_len, out) == dict_len;
+    free(table);
+    if (fclose(out) != 0 || !ok) {
+        perror(output_file);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaOS Package Dictionary Trainer v1.0\n\n");
+    printf("Usage: %s [options] <output.msa> <package.msa>...\n\n", prog);
+    printf("Options:\n");
+    printf("  -s <bytes>       Dictionary size (default: 16384, max %d)\n", MSA_DICT_MAX);
+    printf("  -l <bytes>       Segment length (default: 256)\n");
+    printf("  -v <version>     Package version (default: 1.0.0)\n");
+    printf("  -2               Write the compact v2 format\n");
+    printf("  -h               Show this help\n");
+    printf("\nThe dictionary package is named %s-<id>; use it with msa-create -Z.\n",
+           MSA_DICT_PACKAGE);
+    printf("\nExample:\n");
+    printf("  %s dict.msa repo/*.msa\n", prog);
+}
+
+int main(int argc, char **argv) {
+    uint32_t dict_size = 16384;
+    uint32_t seg_size = 256;
+    char *version = "1.0.0";
+    uint32_t format = MSA_VERSION;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:l:v:2h")) != -1) {
+        switch (opt) {
+            case 's': dict_size = strtoul(optarg, NULL, 0); break;
+            case 'l': seg_size = strtoul(optarg, NULL, 0); break;
+            case 'v': version = optarg; break;
+            case '2': format = MSA_VERSION_COMPACT; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 2 > argc || dict_size == 0 || dict_size > MSA_DICT_MAX ||
+        seg_size < DMER_SIZE || seg_size > dict_size) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *output_file = argv[optind];
+    corpus = malloc(CORPUS_MAX);
+    if (!corpus) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("Loading samples...\n");
+    for (int i = optind + 1; i < argc; i++) {
+        if (load_package(argv[i]) != 0)
+            return 1;
+    }
+    if (sample_count < 2) {
+        fprintf(stderr, "Error: need at least 2 samples, got %u\n", sample_count);
+        return 1;
+    }
+
+    printf("\nTraining on %u samples (%u bytes)...\n", sample_count, corpus_size);
+    uint8_t dict[MSA_DICT_MAX];
+    uint32_t dict_len = train(dict, dict_size, seg_size);
+    if (dict_len == 0) {
+        fprintf(stderr, "Error: samples share no content, no dictionary built\n");
+        return 1;
+    }
+    uint32_t dict_id = adler32(adler32(0L, Z_NULL, 0), dict, dict_len);
+
+    char name[MSA_NAME_MAX];
+    snprintf(name, sizeof(name), "%s-%08x", MSA_DICT_PACKAGE, dict_id);
+    if (write_dict_package(output_file, name, version, format, dict, dict_len, dict_id) != 0)
+        return 1;
+
+    uint64_t plain = compressed_total(NULL, 0);
+    uint64_t with_dict = compressed_total(dict, dict_len);
+
+    printf("\nDictionary created: %s\n", output_file);
+    printf("  Package: %s\n", name);
+    printf("  Dictionary ID: %08x\n", dict_id);
+    printf("  Size: %u bytes\n", dict_len);
+    printf("  Samples: %u bytes -> %llu compressed alone, %llu with dictionary (%.1f%%)\n",
+           corpus_size, (unsigned long long)plain, (unsigned long long)with_dict,
+           plain ? 100.0 * with_dict / plain : 0.0);
+
+    free(corpus);
+    free(sample_start);
+    return 0;
+}
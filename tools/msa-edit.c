@@ -0,0 +1,331 @@
+/**
+ * @file msa-edit.c
+ * @brief Edita los metadatos de un paquete .msa sin reconstruirlo
+ *
+ * Compilar: gcc -o msa-edit msa-edit.c msa.c
+ * Uso: ./msa-edit [opciones] <paquete.msa>
+ *
+ * Solo se reescribe msa_header_t. El CRC32 es lineal, así que el checksum
+ * nuevo se obtiene del antiguo y de los bytes del header que cambian,
+ * desplazados hasta el final del archivo: no se lee el resto del paquete.
+ *
+ * En v2 el header cambia de longitud, así que se escribe un archivo nuevo
+ * (header recodificado + datos con copy_file_range) y se renombra encima.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "msa.h"
+
+/* ==================== Funciones ==================== */
+
+/**
+ * Checksum de un paquete tras cambiar su header, a partir del checksum
+ * anterior. Para mensajes de igual longitud:
+ *   crc(M') = crc(M) ^ crc(D || 0^k) ^ crc(0^n),  D = H ^ H'
+ * y los dos últimos términos se reducen a desplazar crc(D) ^ crc(0^h)
+ * sobre los k bytes que siguen al header.
+ */
+static uint32_t update_checksum(uint32_t old_crc, const msa_header_t *old_h,
+                                const msa_header_t *new_h, uint64_t file_size) {
+    uint8_t delta[sizeof(msa_header_t)];
+    static const uint8_t zero[sizeof(msa_header_t)];
+    const uint8_t *a = (const uint8_t *)old_h;
+    const uint8_t *b = (const uint8_t *)new_h;
+
+    for (size_t i = 0; i < sizeof(delta); i++)
+        delta[i] = a[i] ^ b[i];
+    /* El campo checksum cuenta como 0 en ambos */
+    memset(delta + MSA_CHECKSUM_OFFSET, 0, 4);
+
+    uint32_t d = msa_crc32(delta, sizeof(delta)) ^ msa_crc32(zero, sizeof(zero));
+    return old_crc ^ msa_crc32_combine(d, 0, file_size - sizeof(msa_header_t));
+}
+
+/* Checksum completo, leyendo todo el paquete */
+static int full_checksum(int fd, uint64_t size, uint32_t *crc) {
+    uint8_t *buf = malloc(size);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+    if (pread(fd, buf, size, 0) != (ssize_t)size) {
+        perror("read package");
+        free(buf);
+        return -1;
+    }
+    *crc = msa_package_crc(buf, size);
+    free(buf);
+    return 0;
+}
+
+/**
+ * Reescribe un paquete v2 con el header new_h. Los datos no cambian: su CRC
+ * se despeja del checksum anterior quitando la contribución del header
+ * viejo, salvo con recompute, que los vuelve a leer.
+ */
+static int rewrite_v2(int fd, const char *path, const msa_header_t *old_h, msa_header_t *new_h,
+                      msa_file_entry_t *entries, uint64_t size, int recompute) {
+    uint64_t data_len = size - old_h->header_size;
+    uint32_t data_crc;
+    uint8_t *blob = NULL;
+    size_t blob_len;
+    int result = -1;
+
+    if (recompute) {
+        if (msa_file_crc(fd, old_h->header_size, data_len, &data_crc) != 0) {
+            perror("read package");
+            return -1;
+        }
+    } else {
+        uint8_t *old_blob = malloc(old_h->header_size);
+        if (!old_blob) {
+            perror("malloc");
+            return -1;
+        }
+        if (pread(fd, old_blob, old_h->header_size, 0) != (ssize_t)old_h->header_size) {
+            perror("read header");
+            free(old_blob);
+            return -1;
+        }
+        memset(old_blob + msa_checksum_offset(old_blob), 0, 4);
+        uint32_t old_head_crc = msa_crc32(old_blob, old_h->header_size);
+        free(old_blob);
+        data_crc = old_h->checksum ^ msa_crc32_combine(old_head_crc, 0, data_len);
+    }
+
+    for (uint32_t i = 0; i < new_h->num_files; i++) {
+        if (entries[i].type != MSA_TYPE_DIR)
+            entries[i].offset -= old_h->header_size;
+    }
+    if (msa_build_header(new_h, entries, new_h->num_files, &blob, &blob_len) != 0) {
+        fprintf(stderr, "Error: header does not fit in the v2 format\n");
+        return -1;
+    }
+    new_h->checksum = msa_crc32_combine(msa_crc32(blob, blob_len), data_crc, data_len);
+    memcpy(blob + msa_checksum_offset(blob), &new_h->checksum, 4);
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror(tmp);
+        free(blob);
+        return -1;
+    }
+    if (pwrite(out, blob, blob_len, 0) != (ssize_t)blob_len ||
+        msa_copy_range(fd, old_h->header_size, out, blob_len, data_len) != 0 ||
+        fsync(out) != 0) {
+        perror("write package");
+        unlink(tmp);
+    } else if (rename(tmp, path) != 0) {
+        perror("rename");
+        unlink(tmp);
+    } else {
+        result = 0;
+    }
+    close(out);
+    free(blob);
+    return result;
+}
+
+static int set_field(char *field, size_t max, const char *value, const char *what) {
+    if (strlen(value) >= max) {
+        fprintf(stderr, "Error: %s too long (max %zu chars)\n", what, max - 1);
+        return -1;
+    }
+    memset(field, 0, max);
+    strcpy(field, value);
+    return 0;
+}
+
+static int add_dep(msa_header_t *h, const char *dep) {
+    for (int i = 0; i < h->num_deps; i++) {
+        if (strncmp(h->deps[i], dep, MSA_NAME_MAX) == 0)
+            return 0;
+    }
+    if (h->num_deps >= MSA_MAX_DEPS) {
+        fprintf(stderr, "Error: Too many dependencies (max %d)\n", MSA_MAX_DEPS);
+        return -1;
+    }
+    return set_field(h->deps[h->num_deps++], MSA_NAME_MAX, dep, "dependency");
+}
+
+static int remove_dep(msa_header_t *h, const char *dep) {
+    for (int i = 0; i < h->num_deps; i++) {
+        if (strncmp(h->deps[i], dep, MSA_NAME_MAX) == 0) {
+            memmove(h->deps[i], h->deps[i + 1], (h->num_deps - i - 1) * MSA_NAME_MAX);
+            h->num_deps--;
+            memset(h->deps[h->num_deps], 0, MSA_NAME_MAX);
+            return 0;
+        }
+    }
+    fprintf(stderr, "Error: %s is not a dependency\n", dep);
+    return -1;
+}
+
+static void print_header(const msa_header_t *h) {
+    printf("  Name: %.*s\n", MSA_NAME_MAX, h->name);
+    printf("  Version: %.*s\n", 16, h->pkg_version);
+    printf("  Author: %.*s\n", MSA_NAME_MAX, h->author);
+    printf("  Description: %.*s\n", MSA_DESC_MAX, h->description);
+    printf("  Dependencies:");
+    for (int i = 0; i < h->num_deps; i++)
+        printf(" %.*s", MSA_NAME_MAX, h->deps[i]);
+    printf("%s\n", h->num_deps ? "" : " (none)");
+    if (h->dict_id)
+        printf("  Dictionary: %08x\n", h->dict_id);
+    printf("  Checksum: 0x%08X\n", h->checksum);
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaOS Package Editor v1.0\n\n");
+    printf("Usage: %s [options] <package.msa>\n\n", prog);
+    printf("Options:\n");
+    printf("  -n <name>        Set package name\n");
+    printf("  -v <version>     Set package version\n");
+    printf("  -a <author>      Set author name\n");
+    printf("  -d <description> Set package description\n");
+    printf("  -D <dep>         Add dependency (can repeat)\n");
+    printf("  -R <dep>         Remove dependency (can repeat)\n");
+    printf("  -C               Clear all dependencies\n");
+    printf("  -r               Recompute checksum from the whole package\n");
+    printf("  -h               Show this help\n");
+    printf("\nWithout options the header is printed.\n");
+    printf("\nExample:\n");
+    printf("  %s -v 1.0.1 -D libc hello.msa\n", prog);
+}
+
+int main(int argc, char **argv) {
+    /* Las opciones se aplican en orden sobre una copia del header */
+    int opt;
+    int recompute = 0;
+    int edits = 0;
+
+    while ((opt = getopt(argc, argv, "n:v:a:d:D:R:Crh")) != -1) {
+        switch (opt) {
+            case 'r': recompute = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            case '?':
+                print_usage(argv[0]);
+                return 1;
+            default: edits++; break;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    int fd = open(path, (edits || recompute) ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        perror("Cannot open package");
+        return 1;
+    }
+
+    struct stat st;
+    msa_header_t old_h;
+    memset(&old_h, 0, sizeof(old_h));
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(msa_v2_header_t) ||
+        pread(fd, &old_h, sizeof(old_h), 0) < (ssize_t)sizeof(msa_v2_header_t)) {
+        fprintf(stderr, "Error: %s is too small to be a package\n", path);
+        close(fd);
+        return 1;
+    }
+
+    msa_file_entry_t *entries = NULL;
+    int compact = old_h.magic == MSA_MAGIC && old_h.version == MSA_VERSION_COMPACT;
+    if (compact) {
+        /* v2: header y tabla decodificados a las estructuras v1 */
+        uint64_t size;
+        char err[256];
+        if (msa_read_table(fd, &old_h, &entries, &size, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Error: %s: %s\n", path, err);
+            close(fd);
+            return 1;
+        }
+    } else if (st.st_size < (off_t)sizeof(old_h) ||
+               old_h.magic != MSA_MAGIC || old_h.version != MSA_VERSION ||
+               old_h.header_size > st.st_size || old_h.num_deps > MSA_MAX_DEPS) {
+        fprintf(stderr, "Error: %s is not a valid v%d package\n", path, MSA_VERSION);
+        close(fd);
+        return 1;
+    }
+
+    if (!edits && !recompute) {
+        printf("Package: %s (%lld bytes, format v%u)\n", path, (long long)st.st_size,
+               old_h.version);
+        print_header(&old_h);
+        free(entries);
+        close(fd);
+        return 0;
+    }
+
+    msa_header_t new_h = old_h;
+    optind = 1;
+    while ((opt = getopt(argc, argv, "n:v:a:d:D:R:Crh")) != -1) {
+        int rc = 0;
+        switch (opt) {
+            case 'n': rc = set_field(new_h.name, MSA_NAME_MAX, optarg, "name"); break;
+            case 'v': rc = set_field(new_h.pkg_version, 16, optarg, "version"); break;
+            case 'a': rc = set_field(new_h.author, MSA_NAME_MAX, optarg, "author"); break;
+            case 'd': rc = set_field(new_h.description, MSA_DESC_MAX, optarg, "description"); break;
+            case 'D': rc = add_dep(&new_h, optarg); break;
+            case 'R': rc = remove_dep(&new_h, optarg); break;
+            case 'C':
+                memset(new_h.deps, 0, sizeof(new_h.deps));
+                new_h.num_deps = 0;
+                break;
+        }
+        if (rc != 0) {
+            close(fd);
+            return 1;
+        }
+    }
+
+    if (compact) {
+        int rc = rewrite_v2(fd, path, &old_h, &new_h, entries, st.st_size, recompute);
+        free(entries);
+        close(fd);
+        if (rc != 0)
+            return 1;
+    } else if (recompute) {
+        uint32_t crc;
+        new_h.checksum = 0;
+        if (pwrite(fd, &new_h, sizeof(new_h), 0) != sizeof(new_h) ||
+            full_checksum(fd, st.st_size, &crc) != 0) {
+            perror("write header");
+            close(fd);
+            return 1;
+        }
+        new_h.checksum = crc;
+    } else {
+        new_h.checksum = update_checksum(old_h.checksum, &old_h, &new_h, st.st_size);
+    }
+
+    if (!compact) {
+        if (pwrite(fd, &new_h, sizeof(new_h), 0) != sizeof(new_h) || fsync(fd) != 0) {
+            perror("write header");
+            close(fd);
+            return 1;
+        }
+        close(fd);
+    }
+
+    printf("Package updated: %s\n", path);
+    print_header(&new_h);
+    if (!recompute)
+        printf("  (checksum updated from header changes, 0x%08X -> 0x%08X)\n",
+               old_h.checksum, new_h.checksum);
+
+    return 0;
+}
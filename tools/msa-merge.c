@@ -0,0 +1,251 @@
+/**
+ * @file msa-merge.c
+ * @brief Combina varios paquetes .msa en un meta-paquete
+ *
+ * Compilar: gcc -o msa-merge msa-merge.c msa.c
+ * Uso: ./msa-merge -n <nombre> [opciones] <salida.msa> <entrada.msa>...
+ *
+ * Se construye una file table nueva con los offsets reescritos y los datos
+ * se mueven con copy_file_range, sin copiarlos a espacio de usuario. El
+ * checksum se obtiene combinando el CRC de cada entrada.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "msa.h"
+
+/* ==================== Variables Globales ==================== */
+
+static msa_file_entry_t files[MSA_MAX_FILES];
+static int file_fds[MSA_MAX_FILES];
+static int file_count = 0;
+
+static char deps[MSA_MAX_DEPS][MSA_NAME_MAX];
+static int num_deps = 0;
+
+/* Diccionario de compresión común a las entradas (0 = ninguno) */
+static uint32_t dict_id = 0;
+
+/* ==================== Funciones ==================== */
+
+static int find_entry(const char *path) {
+    for (int i = 0; i < file_count; i++) {
+        if (strcmp(files[i].path, path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int add_dep(const char *dep) {
+    for (int i = 0; i < num_deps; i++) {
+        if (strncmp(deps[i], dep, MSA_NAME_MAX) == 0)
+            return 0;
+    }
+    if (num_deps >= MSA_MAX_DEPS) {
+        fprintf(stderr, "Error: Too many dependencies (max %d)\n", MSA_MAX_DEPS);
+        return -1;
+    }
+    strncpy(deps[num_deps++], dep, MSA_NAME_MAX - 1);
+    return 0;
+}
+
+static int merge_package(const char *path, int fd, char *pkg_name) {
+    msa_header_t h;
+    msa_file_entry_t *entries;
+    uint64_t size;
+    char err[256];
+
+    if (msa_read_table(fd, &h, &entries, &size, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: %s: %s\n", path, err);
+        return -1;
+    }
+
+    memcpy(pkg_name, h.name, MSA_NAME_MAX - 1);
+
+    /* Un paquete solo puede referirse a un diccionario */
+    if (h.dict_id && dict_id && h.dict_id != dict_id) {
+        fprintf(stderr, "Error: %s: compressed with dictionary %08x, others use %08x\n",
+                path, h.dict_id, dict_id);
+        free(entries);
+        return -1;
+    }
+    if (h.dict_id)
+        dict_id = h.dict_id;
+    printf("  %s: %.*s v%.*s, %u entries\n", path, MSA_NAME_MAX, h.name, 16, h.pkg_version,
+           h.num_files);
+
+    /* Se recorre en el orden de los datos para conservar la disposición */
+    uint32_t *order = malloc((h.num_files ? h.num_files : 1) * sizeof(uint32_t));
+    if (!order) {
+        perror("malloc");
+        free(entries);
+        return -1;
+    }
+    msa_data_order(entries, h.num_files, order);
+
+    for (uint32_t k = 0; k < h.num_files; k++) {
+        uint32_t i = order[k];
+        int existing = find_entry(entries[i].path);
+        if (existing >= 0) {
+            /* Los directorios compartidos se fusionan; los archivos no */
+            if (entries[i].type == MSA_TYPE_DIR && files[existing].type == MSA_TYPE_DIR)
+                continue;
+            fprintf(stderr, "Error: %s: %s already provided by another package\n",
+                    path, entries[i].path);
+            free(order);
+            free(entries);
+            return -1;
+        }
+        if (file_count >= MSA_MAX_FILES) {
+            fprintf(stderr, "Error: Too many files (max %d)\n", MSA_MAX_FILES);
+            free(order);
+            free(entries);
+            return -1;
+        }
+        files[file_count] = entries[i];
+        file_fds[file_count] = fd;
+        file_count++;
+    }
+    free(order);
+
+    for (int i = 0; i < h.num_deps; i++) {
+        char dep[MSA_NAME_MAX];
+        strncpy(dep, h.deps[i], MSA_NAME_MAX - 1);
+        dep[MSA_NAME_MAX - 1] = '\0';
+        if (add_dep(dep) != 0) {
+            free(entries);
+            return -1;
+        }
+    }
+
+    free(entries);
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaOS Package Merger v1.0\n\n");
+    printf("Usage: %s [options] <output.msa> <input.msa>...\n\n", prog);
+    printf("Options:\n");
+    printf("  -n <name>        Package name (required)\n");
+    printf("  -v <version>     Package version (default: 1.0.0)\n");
+    printf("  -a <author>      Author name\n");
+    printf("  -d <description> Package description\n");
+    printf("  -D <dep>         Add dependency (can repeat)\n");
+    printf("  -2               Write the compact v2 format\n");
+    printf("  -h               Show this help\n");
+    printf("\nDependencies of the inputs are kept, except on each other.\n");
+    printf("\nExample:\n");
+    printf("  %s -n base -v 1.0.0 base.msa libc.msa coreutils.msa\n", prog);
+}
+
+int main(int argc, char **argv) {
+    char *name = NULL;
+    char *version = "1.0.0";
+    char *author = "Unknown";
+    char *description = "";
+    char *extra_deps[MSA_MAX_DEPS];
+    int num_extra = 0;
+    uint32_t format = MSA_VERSION;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:v:a:d:D:2h")) != -1) {
+        switch (opt) {
+            case 'n': name = optarg; break;
+            case 'v': version = optarg; break;
+            case 'a': author = optarg; break;
+            case 'd': description = optarg; break;
+            case 'D':
+                if (num_extra < MSA_MAX_DEPS) {
+                    extra_deps[num_extra++] = optarg;
+                }
+                break;
+            case '2': format = MSA_VERSION_COMPACT; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 2 > argc || !name) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *output_file = argv[optind];
+    int num_inputs = argc - optind - 1;
+    char (*input_names)[MSA_NAME_MAX] = calloc(num_inputs, MSA_NAME_MAX);
+    if (!input_names) {
+        perror("calloc");
+        return 1;
+    }
+
+    printf("Merging %d packages into %s\n", num_inputs, output_file);
+
+    for (int i = 0; i < num_inputs; i++) {
+        const char *path = argv[optind + 1 + i];
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            return 1;
+        }
+        if (merge_package(path, fd, input_names[i]) != 0)
+            return 1;
+    }
+
+    for (int i = 0; i < num_extra; i++) {
+        if (add_dep(extra_deps[i]) != 0)
+            return 1;
+    }
+
+    msa_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MSA_MAGIC;
+    header.version = format;
+    header.dict_id = dict_id;
+    strncpy(header.name, name, MSA_NAME_MAX - 1);
+    strncpy(header.pkg_version, version, 15);
+    strncpy(header.author, author, MSA_NAME_MAX - 1);
+    strncpy(header.description, description, MSA_DESC_MAX - 1);
+
+    /* Dependencias entre los paquetes fusionados ya no aplican */
+    for (int i = 0; i < num_deps; i++) {
+        int internal = 0;
+        for (int j = 0; j < num_inputs; j++) {
+            if (strncmp(deps[i], input_names[j], MSA_NAME_MAX) == 0)
+                internal = 1;
+        }
+        if (!internal)
+            memcpy(header.deps[header.num_deps++], deps[i], MSA_NAME_MAX);
+    }
+
+    int out = open(output_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror("open output");
+        return 1;
+    }
+
+    int64_t total_size = msa_assemble(out, &header, files, file_fds, file_count);
+    if (total_size < 0 || fsync(out) != 0) {
+        perror("write output");
+        close(out);
+        unlink(output_file);
+        return 1;
+    }
+    close(out);
+
+    printf("\nPackage merged successfully!\n");
+    printf("  Total size: %lld bytes\n", (long long)total_size);
+    printf("  Files: %d\n", file_count);
+    printf("  Data size: %u bytes\n", header.total_size);
+    printf("  Dependencies: %u\n", header.num_deps);
+
+    free(input_names);
+    return 0;
+}
@@ -0,0 +1,787 @@
+/**
+ * @file msa-owner.c
+ * @brief Índice inverso ruta -> paquete dentro de una imagen MesaFS
+ *
+ * Compilar: gcc -o msa-owner msa-owner.c msa.c mesafs.c
+ * Uso: ./msa-owner <disk.img> <ruta>...
+ *      ./msa-owner [-f] -a <paquete.msa> <disk.img>
+ *      ./msa-owner -c <paquete.msa> <disk.img>
+ *      ./msa-owner -r <nombre> <disk.img>
+ *      ./msa-owner [-b <buckets>] -R <disk.img>
+ *
+ * El índice vive en /pkgs/owners.idx y evita abrir cada .msa de /pkgs para
+ * saber a quién pertenece una ruta. Es una tabla hash de tamaño fijo:
+ *
+ *   bloque 0                header (owner_header_t)
+ *   bloques 1..8            paquetes indexados (owner_pkg_t, el id es el slot)
+ *   bloques 9..9+buckets-1  un bucket por bloque: entradas (hash, id)
+ *                           ordenadas por hash
+ *
+ * La ruta va al bucket hash % buckets, así que una consulta lee siempre el
+ * header, un bucket y el slot del paquete. Solo se indexan archivos y
+ * symlinks: los directorios se comparten entre paquetes. Las altas y bajas
+ * solo reescriben los buckets de las rutas del paquete.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "msa.h"
+#include "mesafs.h"
+
+#define OWNER_INDEX_FILE        "pkgs/owners.idx"
+#define OWNER_PKGS_PREFIX       "pkgs/"
+#define OWNER_MAGIC             0x4E574F4D  /* "MOWN" */
+#define OWNER_VERSION           1
+#define OWNER_PKG_BLOCKS        8
+#define OWNER_FIRST_BUCKET      (1 + OWNER_PKG_BLOCKS)
+#define OWNER_DEFAULT_BUCKETS   64
+#define OWNER_PKGS_PER_BLOCK    (MESAFS_BLOCK_SIZE / sizeof(owner_pkg_t))
+#define OWNER_MAX_PKGS          (OWNER_PKG_BLOCKS * OWNER_PKGS_PER_BLOCK)
+#define OWNER_BUCKET_MAX        ((MESAFS_BLOCK_SIZE - 8) / sizeof(owner_entry_t))
+#define OWNER_MAX_BUCKETS       (MESAFS_MAX_FILE_BLOCKS - OWNER_FIRST_BUCKET)
+
+/* Cabecera de tabla de paquete, suficiente para parsear la file table */
+#define PKG_HEAD_MAX            (sizeof(msa_header_t) + MSA_MAX_FILES * sizeof(msa_file_entry_t))
+
+/* ==================== Formato ==================== */
+
+typedef struct {
+    uint32_t magic;                         /* OWNER_MAGIC */
+    uint32_t version;                       /* OWNER_VERSION */
+    uint32_t num_buckets;
+    uint32_t num_pkgs;                      /* Slots en uso */
+    uint32_t num_entries;                   /* Rutas indexadas */
+    uint8_t  reserved[108];
+} __attribute__((packed)) owner_header_t;
+
+typedef struct {
+    char     name[MSA_NAME_MAX];            /* Nombre del paquete ("" = libre) */
+    char     file[MESAFS_MAX_FILENAME];     /* Entrada en la raíz ("pkgs/x.msa") */
+    uint32_t num_paths;                     /* Rutas que aporta al índice */
+    uint32_t reserved;
+} __attribute__((packed)) owner_pkg_t;
+
+typedef struct {
+    uint64_t hash;                          /* FNV-1a de la ruta */
+    uint32_t pkg;                           /* Slot del paquete */
+} __attribute__((packed)) owner_entry_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t reserved;
+    owner_entry_t entries[OWNER_BUCKET_MAX];
+} __attribute__((packed)) owner_bucket_t;
+
+/* ==================== Índice abierto ==================== */
+
+typedef struct {
+    mesafs_t        fs;
+    mesafs_inode_t  inode;                  /* Inodo de owners.idx */
+    uint32_t        blocks[MESAFS_MAX_FILE_BLOCKS];  /* Bloque físico de cada bloque lógico */
+    owner_header_t  h;
+    owner_bucket_t *buckets;                /* Caché de buckets leídos */
+    uint8_t        *loaded;
+    uint8_t        *dirty;
+    owner_pkg_t     pkgs[OWNER_MAX_PKGS];
+    uint8_t         pkgs_dirty[OWNER_PKG_BLOCKS];
+    uint32_t        reads;                  /* Bloques del índice leídos */
+} owner_index_t;
+
+/* Ruta de un paquete con su hash */
+typedef struct {
+    uint64_t hash;
+    const char *path;
+} owner_path_t;
+
+static uint64_t path_hash(const char *path) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const uint8_t *p = (const uint8_t *)path; *p; p++) {
+        h ^= *p;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static int index_read(owner_index_t *ix, uint32_t n, void *buf) {
+    ix->reads++;
+    return mesafs_read_block(&ix->fs, ix->blocks[n], buf);
+}
+
+/* Si un snapshot comparte el bloque, se escribe en una copia */
+static int index_write(owner_index_t *ix, uint32_t n, const void *buf) {
+    uint32_t block = mesafs_cow_block(&ix->fs, &ix->inode, n);
+    if (block == 0)
+        return -1;
+    ix->blocks[n] = block;
+    return mesafs_write_block(&ix->fs, block, buf);
+}
+
+/* Abre el índice de la imagen; retorna 1 si no existe */
+static int index_open(owner_index_t *ix) {
+    mesafs_dirent_t de;
+    if (mesafs_lookup(&ix->fs, OWNER_INDEX_FILE, &de) != 0)
+        return 1;
+
+    int nblocks;
+    if (mesafs_read_inode(&ix->fs, de.inode, &ix->inode) != 0 ||
+        (nblocks = mesafs_file_blocks(&ix->fs, &ix->inode, ix->blocks, MESAFS_MAX_FILE_BLOCKS)) < 0) {
+        printf("Failed to read /%s\n", OWNER_INDEX_FILE);
+        return -1;
+    }
+    ix->inode.inode_num = de.inode;
+
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    if (nblocks < OWNER_FIRST_BUCKET || index_read(ix, 0, block) != 0) {
+        printf("Invalid /%s\n", OWNER_INDEX_FILE);
+        return -1;
+    }
+    memcpy(&ix->h, block, sizeof(ix->h));
+    if (ix->h.magic != OWNER_MAGIC || ix->h.version != OWNER_VERSION || ix->h.num_buckets == 0 ||
+        OWNER_FIRST_BUCKET + ix->h.num_buckets > (uint32_t)nblocks) {
+        printf("Invalid /%s\n", OWNER_INDEX_FILE);
+        return -1;
+    }
+
+    ix->buckets = malloc(ix->h.num_buckets * sizeof(owner_bucket_t));
+    ix->loaded = calloc(ix->h.num_buckets, 1);
+    ix->dirty = calloc(ix->h.num_buckets, 1);
+    if (!ix->buckets || !ix->loaded || !ix->dirty) {
+        perror("malloc");
+        return -1;
+    }
+    return 0;
+}
+
+/* Lee los slots de paquetes (todos, para altas, bajas y listados) */
+static int index_load_pkgs(owner_index_t *ix) {
+    for (uint32_t b = 0; b < OWNER_PKG_BLOCKS; b++) {
+        if (index_read(ix, 1 + b, (uint8_t *)ix->pkgs + b * MESAFS_BLOCK_SIZE) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static owner_bucket_t *index_bucket(owner_index_t *ix, uint64_t hash) {
+    uint32_t b = hash % ix->h.num_buckets;
+    if (!ix->loaded[b]) {
+        uint8_t block[MESAFS_BLOCK_SIZE];
+        if (index_read(ix, OWNER_FIRST_BUCKET + b, block) != 0)
+            return NULL;
+        memcpy(&ix->buckets[b], block, sizeof(owner_bucket_t));
+        if (ix->buckets[b].count > OWNER_BUCKET_MAX)
+            return NULL;
+        ix->loaded[b] = 1;
+    }
+    return &ix->buckets[b];
+}
+
+/* Primera entrada con hash >= el buscado */
+static uint32_t bucket_search(const owner_bucket_t *bk, uint64_t hash) {
+    uint32_t lo = 0, hi = bk->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (bk->entries[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Escribe los buckets modificados, los slots y el header */
+static int index_write_dirty(owner_index_t *ix) {
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    for (uint32_t b = 0; b < ix->h.num_buckets; b++) {
+        if (!ix->dirty[b])
+            continue;
+        memset(block, 0, sizeof(block));
+        memcpy(block, &ix->buckets[b], sizeof(owner_bucket_t));
+        if (index_write(ix, OWNER_FIRST_BUCKET + b, block) != 0)
+            return -1;
+        ix->dirty[b] = 0;
+    }
+    for (uint32_t b = 0; b < OWNER_PKG_BLOCKS; b++) {
+        if (!ix->pkgs_dirty[b])
+            continue;
+        if (index_write(ix, 1 + b, (uint8_t *)ix->pkgs + b * MESAFS_BLOCK_SIZE) != 0)
+            return -1;
+        ix->pkgs_dirty[b] = 0;
+    }
+    memset(block, 0, sizeof(block));
+    memcpy(block, &ix->h, sizeof(ix->h));
+    return index_write(ix, 0, block);
+}
+
+/* Los lectores ven el índice de antes o el de después, no uno a medias */
+static int index_flush(owner_index_t *ix) {
+    if (mesafs_epoch_enter(&ix->fs) != 0)
+        return -1;
+    int ret = index_write_dirty(ix);
+    mesafs_epoch_exit(&ix->fs);
+    return ret;
+}
+
+static void index_free(owner_index_t *ix) {
+    free(ix->buckets);
+    free(ix->loaded);
+    free(ix->dirty);
+    ix->buckets = NULL;
+    ix->loaded = ix->dirty = NULL;
+}
+
+/* Crea un índice vacío (reemplazando el que hubiera) y lo abre */
+static int index_create(owner_index_t *ix, uint32_t num_buckets) {
+    mesafs_unlink(&ix->fs, OWNER_INDEX_FILE);
+    if (mesafs_create_file(&ix->fs, OWNER_INDEX_FILE,
+                           (OWNER_FIRST_BUCKET + num_buckets) * MESAFS_BLOCK_SIZE) < 0)
+        return -1;
+
+    mesafs_dirent_t de;
+    if (mesafs_lookup(&ix->fs, OWNER_INDEX_FILE, &de) != 0 ||
+        mesafs_read_inode(&ix->fs, de.inode, &ix->inode) != 0 ||
+        mesafs_file_blocks(&ix->fs, &ix->inode, ix->blocks, MESAFS_MAX_FILE_BLOCKS) < 0)
+        return -1;
+    ix->inode.inode_num = de.inode;
+
+    uint8_t block[MESAFS_BLOCK_SIZE];
+    memset(block, 0, sizeof(block));
+    owner_header_t *h = (owner_header_t *)block;
+    h->magic = OWNER_MAGIC;
+    h->version = OWNER_VERSION;
+    h->num_buckets = num_buckets;
+    if (index_write(ix, 0, block) != 0)
+        return -1;
+
+    index_free(ix);
+    return index_open(ix);
+}
+
+/* ==================== Paquetes ==================== */
+
+/* Rutas indexables (archivos y symlinks) de una file table, con su hash */
+static owner_path_t *package_paths(const msa_header_t *h, const msa_file_entry_t *entries,
+                                   uint32_t *count) {
+    owner_path_t *paths = malloc((h->num_files ? h->num_files : 1) * sizeof(owner_path_t));
+    if (!paths) {
+        perror("malloc");
+        return NULL;
+    }
+    *count = 0;
+    for (uint32_t i = 0; i < h->num_files; i++) {
+        if (entries[i].type == MSA_TYPE_DIR)
+            continue;
+        paths[*count].path = entries[i].path;
+        paths[*count].hash = path_hash(entries[i].path);
+        (*count)++;
+    }
+    return paths;
+}
+
+/* Lee la file table de un paquete guardado en la imagen */
+static int read_image_package(mesafs_t *fs, const char *file, msa_header_t *h,
+                              msa_file_entry_t **entries) {
+    mesafs_dirent_t de;
+    mesafs_inode_t inode;
+    if (mesafs_lookup(fs, file, &de) != 0 || mesafs_read_inode(fs, de.inode, &inode) != 0)
+        return -1;
+
+    uint32_t avail = inode.size < PKG_HEAD_MAX ? inode.size : PKG_HEAD_MAX;
+    uint8_t *head = malloc(avail ? avail : 1);
+    if (!head)
+        return -1;
+
+    char err[256];
+    int ret = -1;
+    if (mesafs_read_file(fs, &inode, 0, head, avail) == (int)avail &&
+        msa_parse(head, avail, inode.size, h, entries, err, sizeof(err)) == 0)
+        ret = 0;
+    else
+        printf("Warning: /%s: cannot read package table\n", file);
+    free(head);
+    return ret;
+}
+
+static int find_pkg(const owner_index_t *ix, const char *name) {
+    for (uint32_t i = 0; i < OWNER_MAX_PKGS; i++) {
+        if (ix->pkgs[i].name[0] && strncmp(ix->pkgs[i].name, name, MSA_NAME_MAX) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void mark_pkg(owner_index_t *ix, uint32_t id) {
+    ix->pkgs_dirty[id / OWNER_PKGS_PER_BLOCK] = 1;
+}
+
+/* Informa de las rutas que ya pertenecen a otro paquete que no sea self */
+static int check_conflicts(owner_index_t *ix, const owner_path_t *paths, uint32_t count, int self) {
+    int conflicts = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        owner_bucket_t *bk = index_bucket(ix, paths[i].hash);
+        if (!bk) {
+            printf("Failed to read index bucket\n");
+            return -1;
+        }
+        for (uint32_t k = bucket_search(bk, paths[i].hash);
+             k < bk->count && bk->entries[k].hash == paths[i].hash; k++) {
+            uint32_t owner = bk->entries[k].pkg;
+            if ((int)owner == self || owner >= OWNER_MAX_PKGS)
+                continue;
+            printf("  Conflict: %s is owned by %.*s\n", paths[i].path, MSA_NAME_MAX,
+                   ix->pkgs[owner].name);
+            conflicts++;
+            break;
+        }
+    }
+    return conflicts;
+}
+
+/* Inserta las rutas de un paquete; falla sin escribir nada si un bucket se llena */
+static int insert_paths(owner_index_t *ix, const owner_path_t *paths, uint32_t count, uint32_t id) {
+    for (uint32_t i = 0; i < count; i++) {
+        owner_bucket_t *bk = index_bucket(ix, paths[i].hash);
+        if (!bk) {
+            printf("Failed to read index bucket\n");
+            return -1;
+        }
+        if (bk->count >= OWNER_BUCKET_MAX) {
+            printf("Index bucket full (%u entries); rebuild with more buckets (-R -b %u)\n",
+                   (unsigned)OWNER_BUCKET_MAX, ix->h.num_buckets * 2);
+            return -1;
+        }
+        uint32_t k = bucket_search(bk, paths[i].hash);
+        memmove(&bk->entries[k + 1], &bk->entries[k], (bk->count - k) * sizeof(owner_entry_t));
+        bk->entries[k].hash = paths[i].hash;
+        bk->entries[k].pkg = id;
+        bk->count++;
+        ix->dirty[paths[i].hash % ix->h.num_buckets] = 1;
+    }
+    ix->h.num_entries += count;
+    return 0;
+}
+
+/* Quita las entradas de un paquete de un bucket */
+static uint32_t bucket_remove(owner_bucket_t *bk, uint32_t id, int all, uint64_t hash) {
+    uint32_t kept = 0, removed = 0;
+    for (uint32_t k = 0; k < bk->count; k++) {
+        if (bk->entries[k].pkg == id && (all || bk->entries[k].hash == hash))
+            removed++;
+        else
+            bk->entries[kept++] = bk->entries[k];
+    }
+    bk->count = kept;
+    return removed;
+}
+
+/*
+ * Da de baja un paquete. Con su file table solo se tocan sus buckets; si el
+ * .msa ya no está en la imagen se recorren todos.
+ */
+static int remove_pkg(owner_index_t *ix, uint32_t id) {
+    msa_header_t h;
+    msa_file_entry_t *entries = NULL;
+    owner_path_t *paths = NULL;
+    uint32_t count = 0, removed = 0;
+    char file[MESAFS_MAX_FILENAME + 1];
+    snprintf(file, sizeof(file), "%.*s", MESAFS_MAX_FILENAME, ix->pkgs[id].file);
+
+    if (read_image_package(&ix->fs, file, &h, &entries) == 0 &&
+        strncmp(h.name, ix->pkgs[id].name, MSA_NAME_MAX) == 0)
+        paths = package_paths(&h, entries, &count);
+
+    if (paths) {
+        for (uint32_t i = 0; i < count; i++) {
+            owner_bucket_t *bk = index_bucket(ix, paths[i].hash);
+            if (!bk)
+                goto fail;
+            uint32_t n = bucket_remove(bk, id, 0, paths[i].hash);
+            if (n)
+                ix->dirty[paths[i].hash % ix->h.num_buckets] = 1;
+            removed += n;
+        }
+    }
+    if (removed != ix->pkgs[id].num_paths) {
+        for (uint32_t b = 0; b < ix->h.num_buckets; b++) {
+            owner_bucket_t *bk = index_bucket(ix, b);
+            if (!bk)
+                goto fail;
+            uint32_t n = bucket_remove(bk, id, 1, 0);
+            if (n)
+                ix->dirty[b] = 1;
+            removed += n;
+        }
+    }
+
+    ix->h.num_entries -= removed < ix->h.num_entries ? removed : ix->h.num_entries;
+    ix->h.num_pkgs--;
+    memset(&ix->pkgs[id], 0, sizeof(owner_pkg_t));
+    mark_pkg(ix, id);
+    free(paths);
+    free(entries);
+    return 0;
+
+fail:
+    printf("Failed to read index bucket\n");
+    free(paths);
+    free(entries);
+    return -1;
+}
+
+/* Registra un paquete en un slot libre (o en el suyo, si ya estaba) */
+static int add_pkg(owner_index_t *ix, const msa_header_t *h, const char *file,
+                   const owner_path_t *paths, uint32_t count) {
+    int id = find_pkg(ix, h->name);
+    if (id < 0) {
+        for (uint32_t i = 0; i < OWNER_MAX_PKGS && id < 0; i++) {
+            if (!ix->pkgs[i].name[0])
+                id = i;
+        }
+        if (id < 0) {
+            printf("Index full (max %u packages)\n", (unsigned)OWNER_MAX_PKGS);
+            return -1;
+        }
+    } else if (remove_pkg(ix, id) != 0) {
+        return -1;
+    }
+
+    if (insert_paths(ix, paths, count, id) != 0)
+        return -1;
+
+    owner_pkg_t *p = &ix->pkgs[id];
+    memset(p, 0, sizeof(*p));
+    memcpy(p->name, h->name, MSA_NAME_MAX - 1);
+    strncpy(p->file, file, MESAFS_MAX_FILENAME);
+    p->num_paths = count;
+    ix->h.num_pkgs++;
+    mark_pkg(ix, id);
+    return id;
+}
+
+/* Entrada de la raíz donde mesa-pkg-inject.sh deja el paquete */
+static void image_name(const char *pkg_path, char *file) {
+    const char *base = strrchr(pkg_path, '/');
+    base = base ? base + 1 : pkg_path;
+    snprintf(file, MESAFS_MAX_FILENAME + 1, "%s%s", OWNER_PKGS_PREFIX, base);
+}
+
+/* ==================== Reconstrucción ==================== */
+
+typedef struct {
+    msa_header_t      h;
+    msa_file_entry_t *entries;
+    owner_path_t     *paths;
+    uint32_t          count;
+    char              file[MESAFS_MAX_FILENAME + 1];
+} rebuild_pkg_t;
+
+/* Recoge los .msa del directorio raíz ("pkgs/x.msa") */
+static int collect_image_packages(mesafs_t *fs, rebuild_pkg_t *pkgs, uint32_t *num_pkgs) {
+    mesafs_inode_t root;
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS];
+    int nblocks;
+    if (mesafs_read_inode(fs, fs->sb.root_inode, &root) != 0 ||
+        (nblocks = mesafs_file_blocks(fs, &root, blocks, MESAFS_MAX_FILE_BLOCKS)) < 0) {
+        printf("Failed to read root directory\n");
+        return -1;
+    }
+
+    size_t prefix_len = strlen(OWNER_PKGS_PREFIX);
+    *num_pkgs = 0;
+    for (int b = 0; b < nblocks; b++) {
+        uint8_t block[MESAFS_BLOCK_SIZE];
+        if (blocks[b] == 0 || mesafs_read_block(fs, blocks[b], block) != 0)
+            continue;
+        mesafs_dirent_t *entries = (mesafs_dirent_t *)block;
+        for (size_t i = 0; i < MESAFS_DIRENTS_PER_BLOCK; i++) {
+            mesafs_dirent_t *de = &entries[i];
+            size_t len = strnlen(de->name, MESAFS_MAX_FILENAME);
+            if (de->inode == 0 || de->type != MESAFS_TYPE_FILE || len <= prefix_len + 4 ||
+                memcmp(de->name, OWNER_PKGS_PREFIX, prefix_len) != 0 ||
+                memcmp(de->name + len - 4, ".msa", 4) != 0)
+                continue;
+            if (*num_pkgs >= OWNER_MAX_PKGS) {
+                printf("Too many packages (max %u)\n", (unsigned)OWNER_MAX_PKGS);
+                return -1;
+            }
+
+            rebuild_pkg_t *p = &pkgs[*num_pkgs];
+            memset(p, 0, sizeof(*p));
+            memcpy(p->file, de->name, len);
+            if (read_image_package(fs, p->file, &p->h, &p->entries) != 0)
+                continue;
+            p->paths = package_paths(&p->h, p->entries, &p->count);
+            if (!p->paths)
+                return -1;
+            (*num_pkgs)++;
+        }
+    }
+    return 0;
+}
+
+/* Buckets suficientes para que ninguno se llene con estas rutas */
+static uint32_t size_buckets(const rebuild_pkg_t *pkgs, uint32_t num_pkgs, uint32_t num_buckets) {
+    uint32_t *fill = NULL;
+    for (; num_buckets <= OWNER_MAX_BUCKETS; num_buckets *= 2) {
+        free(fill);
+        fill = calloc(num_buckets, sizeof(uint32_t));
+        if (!fill)
+            return 0;
+        int ok = 1;
+        for (uint32_t p = 0; p < num_pkgs && ok; p++) {
+            for (uint32_t i = 0; i < pkgs[p].count && ok; i++)
+                ok = ++fill[pkgs[p].paths[i].hash % num_buckets] <= OWNER_BUCKET_MAX;
+        }
+        if (ok) {
+            free(fill);
+            return num_buckets;
+        }
+    }
+    free(fill);
+    return 0;
+}
+
+static int rebuild_index(owner_index_t *ix, uint32_t num_buckets, int fixed) {
+    rebuild_pkg_t *pkgs = calloc(OWNER_MAX_PKGS, sizeof(rebuild_pkg_t));
+    uint32_t num_pkgs = 0;
+    int ret = -1;
+    if (!pkgs) {
+        perror("calloc");
+        return -1;
+    }
+    if (collect_image_packages(&ix->fs, pkgs, &num_pkgs) != 0)
+        goto out;
+
+    uint32_t sized = fixed ? num_buckets : size_buckets(pkgs, num_pkgs, num_buckets);
+    if (sized == 0 || sized > OWNER_MAX_BUCKETS) {
+        printf("Too many paths for an index of %u buckets\n", (unsigned)OWNER_MAX_BUCKETS);
+        goto out;
+    }
+    if (index_create(ix, sized) != 0)
+        goto out;
+    memset(ix->pkgs, 0, sizeof(ix->pkgs));
+
+    /* El índice recién creado está vacío: no hace falta leer los buckets */
+    memset(ix->buckets, 0, ix->h.num_buckets * sizeof(owner_bucket_t));
+    memset(ix->loaded, 1, ix->h.num_buckets);
+
+    for (uint32_t p = 0; p < num_pkgs; p++) {
+        if (check_conflicts(ix, pkgs[p].paths, pkgs[p].count, -1) > 0)
+            printf("  (while indexing /%s)\n", pkgs[p].file);
+        if (add_pkg(ix, &pkgs[p].h, pkgs[p].file, pkgs[p].paths, pkgs[p].count) < 0)
+            goto out;
+    }
+    memset(ix->pkgs_dirty, 1, sizeof(ix->pkgs_dirty));
+    memset(ix->dirty, 1, ix->h.num_buckets);
+    ret = index_flush(ix);
+
+out:
+    for (uint32_t p = 0; p < num_pkgs; p++) {
+        free(pkgs[p].paths);
+        free(pkgs[p].entries);
+    }
+    free(pkgs);
+    return ret;
+}
+
+/* ==================== Main ==================== */
+
+static void print_usage(const char *prog) {
+    printf("MesaOS Package Owner Index v1.0\n\n");
+    printf("Usage: %s [options] <disk.img> [path...]\n\n", prog);
+    printf("Without -a/-c/-r/-R/-l, print the package that owns each path.\n\n");
+    printf("Options:\n");
+    printf("  -a <pkg.msa>     Record a package installed as /pkgs/<basename>\n");
+    printf("  -c <pkg.msa>     Check a package for conflicts with installed files\n");
+    printf("  -f               With -a, record the package despite conflicts\n");
+    printf("  -r <name>        Forget a package (on removal)\n");
+    printf("  -R               Rebuild the index from the packages in /pkgs\n");
+    printf("  -b <buckets>     Buckets for a new index (default: %d, -R sizes it)\n",
+           OWNER_DEFAULT_BUCKETS);
+    printf("  -l               List indexed packages\n");
+    printf("  -h               Show this help\n");
+    printf("\nExample:\n");
+    printf("  %s -c hello-1.0.0.msa disk.img && %s -a hello-1.0.0.msa disk.img\n", prog, prog);
+    printf("  %s disk.img /bin/hello\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *add_file = NULL;
+    const char *check_file = NULL;
+    const char *remove_name = NULL;
+    int rebuild = 0, list = 0, force = 0;
+    uint32_t num_buckets = OWNER_DEFAULT_BUCKETS;
+    int fixed_buckets = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:c:fr:Rb:lh")) != -1) {
+        switch (opt) {
+            case 'a': add_file = optarg; break;
+            case 'c': check_file = optarg; break;
+            case 'f': force = 1; break;
+            case 'r': remove_name = optarg; break;
+            case 'R': rebuild = 1; break;
+            case 'b':
+                num_buckets = strtoul(optarg, NULL, 0);
+                fixed_buckets = 1;
+                if (num_buckets == 0 || num_buckets > OWNER_MAX_BUCKETS) {
+                    fprintf(stderr, "Error: buckets must be 1-%u\n", (unsigned)OWNER_MAX_BUCKETS);
+                    return 1;
+                }
+                break;
+            case 'l': list = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    int actions = !!add_file + !!check_file + !!remove_name + rebuild + list;
+    int query = actions == 0;
+    if (optind >= argc || actions > 1 || (query && optind + 2 > argc) ||
+        (!query && optind + 1 != argc)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *disk_path = argv[optind];
+
+    owner_index_t *ix = calloc(1, sizeof(owner_index_t));
+    if (!ix) {
+        perror("calloc");
+        return 1;
+    }
+    int writable = add_file || remove_name || rebuild;
+    if (mesafs_open(&ix->fs, disk_path, writable ? O_RDWR : O_RDONLY) != 0)
+        return 1;
+
+    if (rebuild) {
+        if (rebuild_index(ix, num_buckets, fixed_buckets) != 0)
+            return 1;
+        printf("Rebuilt /%s: %u packages, %u paths, %u buckets\n", OWNER_INDEX_FILE,
+               ix->h.num_pkgs, ix->h.num_entries, ix->h.num_buckets);
+        mesafs_close(&ix->fs);
+        return 0;
+    }
+
+    int status = index_open(ix);
+    if (status < 0)
+        return 1;
+    if (status > 0) {
+        /* Sin índice: se crea vacío al registrar, y nada más lo necesita */
+        if (!add_file) {
+            printf("No /%s in %s (create it with -R)\n", OWNER_INDEX_FILE, disk_path);
+            return check_file ? 0 : 1;
+        }
+        if (index_create(ix, num_buckets) != 0)
+            return 1;
+        printf("Created /%s with %u buckets\n", OWNER_INDEX_FILE, num_buckets);
+    }
+
+    int ret = 0;
+    if (query) {
+        for (int a = optind + 1; a < argc; a++) {
+            char path[MSA_PATH_MAX];
+            snprintf(path, sizeof(path), "%s%s", argv[a][0] == '/' ? "" : "/", argv[a]);
+            owner_bucket_t *bk = index_bucket(ix, path_hash(path));
+            if (!bk) {
+                printf("Failed to read index bucket\n");
+                return 1;
+            }
+            uint64_t hash = path_hash(path);
+            uint32_t k = bucket_search(bk, hash);
+            int found = 0;
+            for (; k < bk->count && bk->entries[k].hash == hash; k++) {
+                uint32_t id = bk->entries[k].pkg;
+                if (id >= OWNER_MAX_PKGS)
+                    continue;
+                /* Solo el bloque del slot que interesa */
+                uint8_t block[MESAFS_BLOCK_SIZE];
+                if (index_read(ix, 1 + id / OWNER_PKGS_PER_BLOCK, block) != 0)
+                    return 1;
+                owner_pkg_t *p = (owner_pkg_t *)block + id % OWNER_PKGS_PER_BLOCK;
+                printf("%s: %.*s (/%.*s)\n", path, MSA_NAME_MAX, p->name,
+                       MESAFS_MAX_FILENAME, p->file);
+                found = 1;
+            }
+            if (!found) {
+                printf("%s: not owned by any package\n", path);
+                ret = 1;
+            }
+        }
+        printf("Index blocks read: %u\n", ix->reads);
+    } else if (list) {
+        if (index_load_pkgs(ix) != 0)
+            return 1;
+        printf("/%s: %u packages, %u paths, %u buckets\n", OWNER_INDEX_FILE,
+               ix->h.num_pkgs, ix->h.num_entries, ix->h.num_buckets);
+        for (uint32_t i = 0; i < OWNER_MAX_PKGS; i++) {
+            if (ix->pkgs[i].name[0])
+                printf("  [%3u] %-24.*s %5u paths  /%.*s\n", i, MSA_NAME_MAX, ix->pkgs[i].name,
+                       ix->pkgs[i].num_paths, MESAFS_MAX_FILENAME, ix->pkgs[i].file);
+        }
+    } else if (remove_name) {
+        int id;
+        if (index_load_pkgs(ix) != 0)
+            return 1;
+        if ((id = find_pkg(ix, remove_name)) < 0) {
+            printf("%s is not in the index\n", remove_name);
+            return 1;
+        }
+        if (remove_pkg(ix, id) != 0 || index_flush(ix) != 0)
+            return 1;
+        printf("Removed %s from /%s (%u index blocks read)\n", remove_name, OWNER_INDEX_FILE,
+               ix->reads);
+    } else {
+        const char *pkg_file = add_file ? add_file : check_file;
+        int fd = open(pkg_file, O_RDONLY);
+        if (fd < 0) {
+            perror(pkg_file);
+            return 1;
+        }
+        msa_header_t h;
+        msa_file_entry_t *entries;
+        uint64_t size;
+        char err[256];
+        if (msa_read_table(fd, &h, &entries, &size, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Error: %s: %s\n", pkg_file, err);
+            return 1;
+        }
+        close(fd);
+
+        uint32_t count;
+        owner_path_t *paths = package_paths(&h, entries, &count);
+        if (!paths || index_load_pkgs(ix) != 0)
+            return 1;
+
+        /* Reinstalar o actualizar el mismo paquete no es un conflicto */
+        int conflicts = check_conflicts(ix, paths, count, find_pkg(ix, h.name));
+        if (conflicts < 0)
+            return 1;
+        printf("%s: %u paths, %d conflicts (%u index blocks read)\n", h.name, count, conflicts,
+               ix->reads);
+
+        if (add_file && (conflicts == 0 || force)) {
+            char file[MESAFS_MAX_FILENAME + 1];
+            image_name(add_file, file);
+            int id = add_pkg(ix, &h, file, paths, count);
+            if (id < 0 || index_flush(ix) != 0)
+                return 1;
+            printf("Recorded %s as package %d in /%s\n", h.name, id, OWNER_INDEX_FILE);
+        }
+        if (conflicts > 0 && !force)
+            ret = 1;
+        free(paths);
+        free(entries);
+    }
+
+    index_free(ix);
+    mesafs_close(&ix->fs);
+    free(ix);
+    return ret;
+}
@@ -0,0 +1,194 @@
+/**
+ * @file msa-split.c
+ * @brief Separa un paquete .msa por prefijo de directorio
+ *
+ * Compilar: gcc -o msa-split msa-split.c msa.c
+ * Uso: ./msa-split -n <nombre> [-r <resto.msa>] <entrada.msa> <prefijo> <salida.msa>
+ *
+ * Las entradas bajo <prefijo> van a <salida.msa> (junto con los directorios
+ * padres que las contienen); con -r el resto va a otro paquete que conserva
+ * el nombre original. Como en msa-merge, los datos se mueven con
+ * copy_file_range y el checksum sale de los CRC de cada entrada. Las partes
+ * se escriben en el formato de la entrada, o en v2 con -2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "msa.h"
+
+/* ==================== Funciones ==================== */
+
+/* 1 si path es prefix o está dentro de prefix */
+static int under_prefix(const char *path, const char *prefix, size_t prefix_len) {
+    if (strncmp(path, prefix, prefix_len) != 0)
+        return 0;
+    return path[prefix_len] == '\0' || path[prefix_len] == '/';
+}
+
+/* 1 si path es un directorio padre de prefix */
+static int is_parent_of(const char *path, const char *prefix) {
+    size_t len = strlen(path);
+    return len > 0 && strncmp(prefix, path, len) == 0 && prefix[len] == '/';
+}
+
+static int write_part(const char *output_file, const msa_header_t *src_h,
+                      const char *name, msa_file_entry_t *entries, int count, int in_fd) {
+    msa_header_t h = *src_h;
+    memset(h.name, 0, MSA_NAME_MAX);
+    strncpy(h.name, name, MSA_NAME_MAX - 1);
+
+    int *fds = malloc((count ? count : 1) * sizeof(int));
+    if (!fds) {
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+        fds[i] = in_fd;
+
+    int out = open(output_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror("open output");
+        free(fds);
+        return -1;
+    }
+
+    int64_t total_size = msa_assemble(out, &h, entries, fds, count);
+    free(fds);
+    if (total_size < 0 || fsync(out) != 0) {
+        perror("write output");
+        close(out);
+        unlink(output_file);
+        return -1;
+    }
+    close(out);
+
+    printf("  %s: %s, %d entries, %lld bytes\n", output_file, name, count,
+           (long long)total_size);
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaOS Package Splitter v1.0\n\n");
+    printf("Usage: %s [options] <input.msa> <prefix> <output.msa>\n\n", prog);
+    printf("Options:\n");
+    printf("  -n <name>        Name of the package with <prefix> (required)\n");
+    printf("  -r <rest.msa>    Write the remaining entries to another package\n");
+    printf("  -2               Write the compact v2 format\n");
+    printf("  -h               Show this help\n");
+    printf("\nExample:\n");
+    printf("  %s -n hello-doc -r hello-core.msa hello.msa /usr/share/doc hello-doc.msa\n", prog);
+}
+
+int main(int argc, char **argv) {
+    char *name = NULL;
+    char *rest_file = NULL;
+    int compact = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:2h")) != -1) {
+        switch (opt) {
+            case 'n': name = optarg; break;
+            case 'r': rest_file = optarg; break;
+            case '2': compact = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind + 3 != argc || !name) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *input_file = argv[optind];
+    char prefix[MSA_PATH_MAX];
+    strncpy(prefix, argv[optind + 1], MSA_PATH_MAX - 1);
+    prefix[MSA_PATH_MAX - 1] = '\0';
+    size_t prefix_len = strlen(prefix);
+    while (prefix_len > 1 && prefix[prefix_len - 1] == '/')
+        prefix[--prefix_len] = '\0';
+    const char *output_file = argv[optind + 2];
+
+    int fd = open(input_file, O_RDONLY);
+    if (fd < 0) {
+        perror(input_file);
+        return 1;
+    }
+
+    msa_header_t h;
+    msa_file_entry_t *entries;
+    uint64_t size;
+    char err[256];
+    if (msa_read_table(fd, &h, &entries, &size, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: %s: %s\n", input_file, err);
+        return 1;
+    }
+
+    /* Las partes conservan el formato de la entrada salvo con -2 */
+    if (compact)
+        h.version = MSA_VERSION_COMPACT;
+
+    msa_file_entry_t *part = malloc((h.num_files + 1) * sizeof(msa_file_entry_t));
+    msa_file_entry_t *rest = malloc((h.num_files + 1) * sizeof(msa_file_entry_t));
+    if (!part || !rest) {
+        perror("malloc");
+        return 1;
+    }
+    int part_count = 0, rest_count = 0, matched = 0;
+
+    /* En el orden de los datos, para conservar la disposición del original */
+    uint32_t *order = malloc((h.num_files + 1) * sizeof(uint32_t));
+    if (!order) {
+        perror("malloc");
+        return 1;
+    }
+    msa_data_order(entries, h.num_files, order);
+
+    for (uint32_t k = 0; k < h.num_files; k++) {
+        const msa_file_entry_t *e = &entries[order[k]];
+        if (under_prefix(e->path, prefix, prefix_len)) {
+            part[part_count++] = *e;
+            matched++;
+        } else {
+            /* Los padres del prefijo quedan en ambos paquetes */
+            if (e->type == MSA_TYPE_DIR && is_parent_of(e->path, prefix))
+                part[part_count++] = *e;
+            rest[rest_count++] = *e;
+        }
+    }
+
+    if (matched == 0) {
+        fprintf(stderr, "Error: no entries under %s in %s\n", prefix, input_file);
+        return 1;
+    }
+
+    printf("Splitting %s at %s\n", input_file, prefix);
+
+    if (write_part(output_file, &h, name, part, part_count, fd) != 0)
+        return 1;
+
+    if (rest_file) {
+        char orig_name[MSA_NAME_MAX];
+        strncpy(orig_name, h.name, MSA_NAME_MAX - 1);
+        orig_name[MSA_NAME_MAX - 1] = '\0';
+        if (write_part(rest_file, &h, orig_name, rest, rest_count, fd) != 0)
+            return 1;
+    }
+
+    printf("\nPackage split successfully!\n");
+
+    free(order);
+    free(part);
+    free(rest);
+    free(entries);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,729 @@
+/**
+ * @file msa-verify.c
+ * @brief Verifica la integridad de paquetes .msa en paralelo
+ *
+ * Compilar: gcc -O2 -o msa-verify msa-verify.c msa.c mesafs.c pool.c -lpthread
+ * Uso: ./msa-verify [-j <hilos>] [-q] <paquete.msa|directorio>...
+ *      ./msa-verify [-j <hilos>] [-q] [-D] -i <disk.img>
+ *
+ * Cada paquete se mapea con mmap, se validan el header y los offsets de la
+ * file table contra el tamaño real del archivo, se recalcula el checksum
+ * global y, si el paquete los trae, el CRC de cada archivo.
+ *
+ * Con -i se verifican los paquetes de /pkgs en una imagen MesaFS sin extraerlos:
+ * los bloques de todos los paquetes se leen juntos en orden físico, se
+ * calcula el CRC de cada bloque y luego se combinan en orden lógico. Con -D
+ * la imagen se lee con O_DIRECT, en tramos de hasta 4 MiB. La imagen puede
+ * estar cambiando (una construcción en marcha): la lista de paquetes se
+ * saca de un estado publicado (mesafs_epoch_pin) y, si al terminar ha
+ * cambiado y algún paquete falla, se vuelve a verificar.
+ *
+ * Las dos fases se reparten en el pool de hilos compartido (pool.h): una
+ * tarea por paquete, o por segmento de bloques físicos contiguos con -i.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "msa.h"
+#include "mesafs.h"
+#include "pool.h"
+
+#define ERR_MAX 256
+
+#define IMG_HEAD_BLOCKS ((sizeof(msa_header_t) + MSA_MAX_FILES * sizeof(msa_file_entry_t) + \
+                          MESAFS_BLOCK_SIZE - 1) / MESAFS_BLOCK_SIZE)
+#define PKGS_PREFIX     "pkgs/"
+#define TASKS_PER_THREAD 4     /* Segmentos de -i por hilo, para repartir mejor */
+
+/* ==================== Estado ==================== */
+
+typedef struct {
+    char    *path;
+    uint64_t size;
+    int      ok;
+    char     err[ERR_MAX];
+} verify_job_t;
+
+static verify_job_t *jobs = NULL;
+static size_t job_count = 0;
+static size_t job_cap = 0;
+static int quiet = 0;
+
+/* Paquete dentro de una imagen MesaFS (-i) */
+typedef struct {
+    char      name[MESAFS_MAX_FILENAME + 8];
+    uint32_t  size;
+    uint32_t  nblocks;
+    uint32_t *block_crc;        /* CRC de cada bloque lógico */
+    uint8_t  *head;             /* Header + file table */
+    int       io_error;
+    char      err[ERR_MAX];
+} image_pkg_t;
+
+/* Referencia a un bloque físico de un paquete */
+typedef struct {
+    uint32_t phys;
+    uint32_t pkg;
+    uint32_t index;             /* Bloque lógico dentro del paquete */
+} block_ref_t;
+
+/* Estado de cada hilo del pool */
+typedef struct {
+    uint8_t      *buf;          /* Tramo alineado del pool de la imagen */
+    uint64_t      bytes_read;
+} image_worker_t;
+
+/* Segmento de refs en orden físico */
+typedef struct {
+    mesafs_t       *fs;
+    image_pkg_t    *pkgs;
+    block_ref_t    *refs;
+    size_t          start, end;
+    image_worker_t *workers;
+} image_task_t;
+
+/* ==================== Funciones ==================== */
+
+static int add_job(const char *path) {
+    if (job_count == job_cap) {
+        size_t cap = job_cap ? job_cap * 2 : 256;
+        verify_job_t *n = realloc(jobs, cap * sizeof(*jobs));
+        if (!n) {
+            perror("realloc");
+            return -1;
+        }
+        jobs = n;
+        job_cap = cap;
+    }
+    memset(&jobs[job_count], 0, sizeof(*jobs));
+    jobs[job_count].path = strdup(path);
+    if (!jobs[job_count].path) {
+        perror("strdup");
+        return -1;
+    }
+    job_count++;
+    return 0;
+}
+
+static int ends_with_msa(const char *name) {
+    size_t len = strlen(name);
+    return len > 4 && strcmp(name + len - 4, ".msa") == 0;
+}
+
+/* Añade un paquete o todos los .msa de un directorio (recursivo) */
+static int collect(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return add_job(path);
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        char full_path[4096];
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+        if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN &&
+            stat(full_path, &st) == 0 && S_ISDIR(st.st_mode))) {
+            if (collect(full_path) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        } else if (ends_with_msa(entry->d_name)) {
+            if (add_job(full_path) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+static void verify_package(verify_job_t *job) {
+    int fd = open(job->path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(job->err, ERR_MAX, "open: %s", strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        snprintf(job->err, ERR_MAX, "fstat: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+    job->size = st.st_size;
+    if (st.st_size == 0) {
+        snprintf(job->err, ERR_MAX, "empty file");
+        close(fd);
+        return;
+    }
+
+    uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        snprintf(job->err, ERR_MAX, "mmap: %s", strerror(errno));
+        return;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    size_t size = st.st_size;
+    msa_header_t header;
+    msa_file_entry_t *e;
+    if (msa_parse(data, size, size, &header, &e, job->err, ERR_MAX) != 0) {
+        munmap(data, size);
+        return;
+    }
+    const msa_header_t *h = &header;
+
+    /*
+     * CRC por archivo: localiza qué archivo está dañado. Si los datos de los
+     * archivos cubren el paquete sin huecos, el checksum global sale de
+     * combinar esos CRCs (en orden de offset) y el paquete se lee una vez.
+     */
+    uint32_t crc = msa_package_crc(data, h->header_size);
+    uint64_t pos = h->header_size;
+    int contiguous = 1;
+    uint32_t *order = malloc((h->num_files + 1) * sizeof(uint32_t));
+    if (!order) {
+        snprintf(job->err, ERR_MAX, "out of memory");
+        free(e);
+        munmap(data, size);
+        return;
+    }
+    msa_data_order(e, h->num_files, order);
+
+    for (uint32_t k = 0; k < h->num_files; k++) {
+        uint32_t i = order[k];
+        if (e[i].type == MSA_TYPE_DIR)
+            continue;
+        if (!(e[i].flags & MSA_ENTRY_CRC) && !contiguous)
+            continue;
+        uint32_t stored = msa_stored_size(&e[i]);
+        uint32_t file_crc = msa_crc32(data + e[i].offset, stored);
+        if ((e[i].flags & MSA_ENTRY_CRC) && file_crc != e[i].crc32) {
+            snprintf(job->err, ERR_MAX, "%.160s: file checksum mismatch (stored 0x%08X, computed 0x%08X)",
+                     e[i].path, e[i].crc32, file_crc);
+            free(order);
+            free(e);
+            munmap(data, size);
+            return;
+        }
+        if ((e[i].flags & MSA_ENTRY_SPARSE) &&
+            msa_sparse_check(data + e[i].offset, stored, e[i].size) < 0) {
+            snprintf(job->err, ERR_MAX, "%.160s: corrupt sparse map", e[i].path);
+            free(order);
+            free(e);
+            munmap(data, size);
+            return;
+        }
+        if (contiguous && e[i].offset == pos) {
+            crc = msa_crc32_combine(crc, file_crc, stored);
+            pos += stored;
+        } else {
+            contiguous = 0;
+        }
+    }
+
+    if (!contiguous || pos != size)
+        crc = msa_package_crc(data, size);
+    free(order);
+    free(e);
+
+    if (crc != h->checksum) {
+        snprintf(job->err, ERR_MAX, "checksum mismatch (stored 0x%08X, computed 0x%08X)",
+                 h->checksum, crc);
+        munmap(data, size);
+        return;
+    }
+
+    munmap(data, size);
+    job->ok = 1;
+}
+
+static void package_task(void *arg, int worker) {
+    verify_job_t *job = arg;
+    (void)worker;
+    verify_package(job);
+    if (!quiet) {
+        if (job->ok)
+            printf("  [OK]   %s\n", job->path);
+        else
+            printf("  [FAIL] %s: %s\n", job->path, job->err);
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ==================== Verificación dentro de la imagen ==================== */
+
+static int ends_with_msa_n(const char *name, size_t len) {
+    return len > 4 && memcmp(name + len - 4, ".msa", 4) == 0;
+}
+
+/*
+ * CRC de un bloque de paquete. El campo checksum puede caer fuera del
+ * bloque 0 (con bloques de 1 KiB), así que los bloques de cabecera se
+ * vuelven a sumar con él a 0 desde head en image_check_pkgs.
+ */
+static void image_block_crc(image_pkg_t *pkg, uint32_t index, const uint8_t *data) {
+    uint32_t len = MESAFS_BLOCK_SIZE;
+    if ((uint64_t)(index + 1) * MESAFS_BLOCK_SIZE > pkg->size)
+        len = pkg->size - index * MESAFS_BLOCK_SIZE;
+
+    pkg->block_crc[index] = msa_crc32(data, len);
+
+    if (index < IMG_HEAD_BLOCKS)
+        memcpy(pkg->head + (size_t)index * MESAFS_BLOCK_SIZE, data, len);
+}
+
+/* Añade un paquete de la imagen a la lista */
+static int image_add_pkg(mesafs_t *fs, image_pkg_t **pkgs, size_t *count, size_t *cap,
+                         const char *dir, const mesafs_dirent_t *de,
+                         block_ref_t **refs, size_t *ref_count, size_t *ref_cap) {
+    if (*count == *cap) {
+        size_t n = *cap ? *cap * 2 : 64;
+        image_pkg_t *p = realloc(*pkgs, n * sizeof(**pkgs));
+        if (!p) return -1;
+        *pkgs = p;
+        *cap = n;
+    }
+
+    image_pkg_t *pkg = &(*pkgs)[*count];
+    memset(pkg, 0, sizeof(*pkg));
+    snprintf(pkg->name, sizeof(pkg->name), "/%s%.*s", dir,
+             (int)strnlen(de->name, MESAFS_MAX_FILENAME), de->name);
+
+    mesafs_inode_t inode;
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS];
+    int nblocks;
+    if (mesafs_read_inode(fs, de->inode, &inode) != 0 ||
+        (nblocks = mesafs_file_blocks(fs, &inode, blocks, MESAFS_MAX_FILE_BLOCKS)) < 0) {
+        pkg->io_error = 1;
+        (*count)++;
+        return 0;
+    }
+
+    /* Solo los bloques que contienen datos del archivo */
+    uint32_t needed = mesafs_blocks_for(inode.size);
+    if (needed > (uint32_t)nblocks) {
+        pkg->io_error = 1;
+        (*count)++;
+        return 0;
+    }
+
+    pkg->size = inode.size;
+    pkg->nblocks = needed;
+    pkg->block_crc = calloc(needed ? needed : 1, sizeof(uint32_t));
+    pkg->head = calloc(IMG_HEAD_BLOCKS, MESAFS_BLOCK_SIZE);
+    if (!pkg->block_crc || !pkg->head) return -1;
+
+    if (*ref_count + needed > *ref_cap) {
+        size_t n = *ref_cap ? *ref_cap : 1024;
+        while (n < *ref_count + needed) n *= 2;
+        block_ref_t *r = realloc(*refs, n * sizeof(**refs));
+        if (!r) return -1;
+        *refs = r;
+        *ref_cap = n;
+    }
+    for (uint32_t i = 0; i < needed; i++) {
+        /* Los huecos no tienen bloque: se leen como ceros */
+        if (blocks[i] == 0) {
+            static const uint8_t zero_block[MESAFS_BLOCK_SIZE];
+            image_block_crc(pkg, i, zero_block);
+            continue;
+        }
+        block_ref_t *r = &(*refs)[(*ref_count)++];
+        r->phys = blocks[i];
+        r->pkg = *count;
+        r->index = i;
+    }
+
+    (*count)++;
+    return 0;
+}
+
+/* Recorre un directorio y añade los .msa (con o sin prefijo "pkgs/") */
+static int image_scan_dir(mesafs_t *fs, uint32_t dir_inode, const char *dir, int in_pkgs,
+                          image_pkg_t **pkgs, size_t *count, size_t *cap,
+                          block_ref_t **refs, size_t *ref_count, size_t *ref_cap) {
+    mesafs_inode_t inode;
+    uint32_t blocks[MESAFS_MAX_FILE_BLOCKS];
+    int nblocks;
+    if (mesafs_read_inode(fs, dir_inode, &inode) != 0 ||
+        (nblocks = mesafs_file_blocks(fs, &inode, blocks, MESAFS_MAX_FILE_BLOCKS)) < 0) {
+        printf("Failed to read directory inode %u\n", dir_inode);
+        return -1;
+    }
+
+    for (int b = 0; b < nblocks; b++) {
+        uint8_t block[MESAFS_BLOCK_SIZE];
+        if (mesafs_read_block(fs, blocks[b], block) != 0) {
+            printf("Failed to read directory block %u\n", blocks[b]);
+            return -1;
+        }
+        mesafs_dirent_t *entries = (mesafs_dirent_t *)block;
+        for (size_t i = 0; i < MESAFS_DIRENTS_PER_BLOCK; i++) {
+            mesafs_dirent_t *de = &entries[i];
+            if (de->inode == 0)
+                continue;
+            size_t len = strnlen(de->name, MESAFS_MAX_FILENAME);
+
+            if (!in_pkgs && de->type == MESAFS_TYPE_DIR && len == 4 &&
+                memcmp(de->name, "pkgs", 4) == 0) {
+                if (image_scan_dir(fs, de->inode, PKGS_PREFIX, 1, pkgs, count, cap,
+                                   refs, ref_count, ref_cap) != 0)
+                    return -1;
+                continue;
+            }
+
+            /* inject-file guarda /pkgs/x.msa como "pkgs/x.msa" en la raíz */
+            int match = in_pkgs || (len > strlen(PKGS_PREFIX) &&
+                                    memcmp(de->name, PKGS_PREFIX, strlen(PKGS_PREFIX)) == 0);
+            if (de->type != MESAFS_TYPE_FILE || !match || !ends_with_msa_n(de->name, len))
+                continue;
+
+            if (image_add_pkg(fs, pkgs, count, cap, dir, de, refs, ref_count, ref_cap) != 0) {
+                perror("malloc");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int compare_refs(const void *a, const void *b) {
+    const block_ref_t *ra = a, *rb = b;
+    if (ra->phys != rb->phys)
+        return ra->phys < rb->phys ? -1 : 1;
+    return 0;
+}
+
+/* Lee un segmento de bloques en orden físico, agrupando los contiguos */
+static void image_task(void *arg, int worker) {
+    image_task_t *w = arg;
+    uint8_t *buf = w->workers[worker].buf;
+    if (!buf) {
+        for (size_t i = w->start; i < w->end; i++)
+            w->pkgs[w->refs[i].pkg].io_error = 1;
+        return;
+    }
+
+    size_t i = w->start;
+    while (i < w->end) {
+        size_t run = 1;
+        while (i + run < w->end && run < MESAFS_RUN_BLOCKS &&
+               w->refs[i + run].phys == w->refs[i].phys + run)
+            run++;
+
+        size_t len = run * MESAFS_BLOCK_SIZE;
+        if (mesafs_read_run(w->fs, w->refs[i].phys, run, buf) != 0) {
+            for (size_t k = 0; k < run; k++)
+                w->pkgs[w->refs[i + k].pkg].io_error = 1;
+        } else {
+            for (size_t k = 0; k < run; k++) {
+                block_ref_t *r = &w->refs[i + k];
+                image_block_crc(&w->pkgs[r->pkg], r->index, buf + k * MESAFS_BLOCK_SIZE);
+            }
+            w->workers[worker].bytes_read += len;
+        }
+        i += run;
+    }
+}
+
+static void image_free_pkgs(image_pkg_t *pkgs, size_t count) {
+    for (size_t p = 0; p < count; p++) {
+        free(pkgs[p].block_crc);
+        free(pkgs[p].head);
+    }
+    free(pkgs);
+}
+
+/* Paquetes y bloques de una misma generación de la imagen */
+static int image_collect(mesafs_t *fs, uint32_t *epoch, image_pkg_t **pkgs, size_t *count,
+                         block_ref_t **refs, size_t *ref_count) {
+    for (int attempt = 0; attempt <= MESAFS_EPOCH_RETRIES; attempt++) {
+        size_t cap = 0, ref_cap = 0;
+        *pkgs = NULL;
+        *refs = NULL;
+        *count = *ref_count = 0;
+        if (mesafs_epoch_pin(fs, epoch) != 0)
+            return -1;
+        int failed = image_scan_dir(fs, fs->sb.root_inode, "", 0, pkgs, count, &cap,
+                                    refs, ref_count, &ref_cap) != 0;
+        int changed = mesafs_epoch_check(fs, *epoch) != 0;
+        if (!changed && !failed)
+            return 0;
+        image_free_pkgs(*pkgs, *count);
+        free(*refs);
+        if (!changed)
+            return -1;
+    }
+    printf("File system kept changing while scanning it\n");
+    return -1;
+}
+
+/* Combina los CRC de bloque en orden lógico y valida cada paquete; retorna los fallos */
+static size_t image_check_pkgs(image_pkg_t *pkgs, size_t count) {
+    size_t failures = 0;
+    for (size_t p = 0; p < count; p++) {
+        image_pkg_t *pkg = &pkgs[p];
+        char *err = pkg->err;
+
+        if (pkg->io_error) {
+            snprintf(err, ERR_MAX, "cannot read package blocks");
+        } else {
+            size_t avail = pkg->nblocks < IMG_HEAD_BLOCKS ? pkg->size
+                                                          : IMG_HEAD_BLOCKS * MESAFS_BLOCK_SIZE;
+            msa_header_t h;
+            msa_file_entry_t *entries;
+            if (msa_parse(pkg->head, avail, pkg->size, &h, &entries, err, ERR_MAX) == 0) {
+                free(entries);
+                /* Bloques hasta el campo checksum: desde head, con el campo a 0 */
+                uint32_t first = mesafs_blocks_for(msa_checksum_offset(pkg->head) + 4);
+                uint64_t head_len = (uint64_t)first * MESAFS_BLOCK_SIZE;
+                uint32_t crc = msa_package_crc(pkg->head, head_len < pkg->size ? head_len
+                                                                               : pkg->size);
+                for (uint32_t b = first; b < pkg->nblocks; b++) {
+                    uint32_t len = MESAFS_BLOCK_SIZE;
+                    if (b == pkg->nblocks - 1)
+                        len = pkg->size - b * MESAFS_BLOCK_SIZE;
+                    crc = msa_crc32_combine(crc, pkg->block_crc[b], len);
+                }
+                if (crc != h.checksum)
+                    snprintf(err, ERR_MAX, "checksum mismatch (stored 0x%08X, computed 0x%08X)",
+                             h.checksum, crc);
+            }
+        }
+        failures += err[0] != 0;
+    }
+    return failures;
+}
+
+/*
+ * Una pasada sobre la imagen. Retorna 0, 1 si falla algún paquete, o -1 si
+ * hay fallos y la imagen ha cambiado mientras se leía (y queda otro intento).
+ */
+static int verify_image_pass(mesafs_t *fs, const char *disk_path, pool_t *pool, int last) {
+    image_pkg_t *pkgs;
+    size_t count;
+    block_ref_t *refs;
+    size_t ref_count;
+    uint32_t epoch;
+
+    if (image_collect(fs, &epoch, &pkgs, &count, &refs, &ref_count) != 0)
+        return 1;
+
+    if (count == 0) {
+        printf("No packages found in %s\n", disk_path);
+        free(pkgs);
+        free(refs);
+        return 1;
+    }
+
+    qsort(refs, ref_count, sizeof(*refs), compare_refs);
+
+    int threads = pool_width(pool);
+    size_t segments = (size_t)threads * TASKS_PER_THREAD;
+    if (segments > ref_count)
+        segments = ref_count ? ref_count : 1;
+
+    printf("Verifying %zu packages (%zu blocks) in %s with %d threads...\n",
+           count, ref_count, disk_path, threads);
+
+    double start = now_seconds();
+
+    image_worker_t *workers = calloc(threads, sizeof(*workers));
+    image_task_t *tasks = calloc(segments, sizeof(*tasks));
+    if (!workers || !tasks) {
+        perror("malloc");
+        return 1;
+    }
+    for (int t = 0; t < threads; t++)
+        workers[t].buf = mesafs_buffer_get(fs);
+
+    /* Cada segmento es un tramo contiguo del disco; los hilos que acaban antes roban el resto */
+    for (size_t s = 0; s < segments; s++) {
+        tasks[s].fs = fs;
+        tasks[s].pkgs = pkgs;
+        tasks[s].refs = refs;
+        tasks[s].start = ref_count * s / segments;
+        tasks[s].end = ref_count * (s + 1) / segments;
+        tasks[s].workers = workers;
+        if (pool_submit(pool, image_task, &tasks[s]) != 0)
+            image_task(&tasks[s], 0);
+    }
+    pool_wait(pool);
+
+    double elapsed = now_seconds() - start;
+
+    uint64_t bytes_read = 0;
+    for (int t = 0; t < threads; t++) {
+        bytes_read += workers[t].bytes_read;
+        mesafs_buffer_put(fs, workers[t].buf);
+    }
+    free(workers);
+    free(tasks);
+    free(refs);
+
+    /*
+     * Un paquete que pasa el checksum se leyó entero de su generación; uno
+     * que falla puede haber leído bloques que un escritor ya había reusado.
+     */
+    size_t failures = image_check_pkgs(pkgs, count);
+    if (failures && !last && mesafs_epoch_check(fs, epoch) != 0) {
+        printf("%s changed during verification, checking again\n", disk_path);
+        image_free_pkgs(pkgs, count);
+        return -1;
+    }
+
+    for (size_t p = 0; p < count; p++) {
+        if (pkgs[p].err[0])
+            printf("  [FAIL] %s: %s\n", pkgs[p].name, pkgs[p].err);
+        else if (!quiet)
+            printf("  [OK]   %s\n", pkgs[p].name);
+    }
+
+    printf("\nVerification complete\n");
+    printf("  Packages: %zu (%zu ok, %zu failed)\n", count, count - failures, failures);
+    printf("  Generation: %u\n", epoch);
+    printf("  Bytes read: %llu%s\n", (unsigned long long)bytes_read, fs->direct ? " (O_DIRECT)" : "");
+    printf("  Time: %.3f s\n", elapsed);
+    if (elapsed > 0) {
+        printf("  Throughput: %.1f MB/s\n", bytes_read / elapsed / (1024.0 * 1024.0));
+    }
+
+    image_free_pkgs(pkgs, count);
+    return failures ? 1 : 0;
+}
+
+static int verify_image(const char *disk_path, pool_t *pool, int direct) {
+    mesafs_t fs;
+    if (mesafs_open(&fs, disk_path, O_RDONLY | (direct ? O_DIRECT : 0)) != 0)
+        return 1;
+
+    int ret = -1;
+    for (int attempt = 0; ret < 0; attempt++)
+        ret = verify_image_pass(&fs, disk_path, pool, attempt == MESAFS_EPOCH_RETRIES);
+    mesafs_close(&fs);
+    return ret;
+}
+
+static void print_usage(const char *prog) {
+    printf("MesaOS Package Verifier v1.0\n\n");
+    printf("Usage: %s [options] <package.msa|directory>...\n", prog);
+    printf("       %s [options] -i <disk.img>\n\n", prog);
+    printf("Options:\n");
+    printf("  -i <disk.img>    Verify /pkgs/*.msa inside a MesaFS image\n");
+    printf("  -D               With -i, read the image with O_DIRECT\n");
+    printf("  -j <threads>     Worker threads (default: $MESA_JOBS or online CPUs)\n");
+    printf("  -q               Only print failures and the summary\n");
+    printf("  -h               Show this help\n");
+    printf("\nExample:\n");
+    printf("  %s -j 8 ./repo\n", prog);
+    printf("  %s -i disk.img\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *image = NULL;
+    int direct = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:Dj:qh")) != -1) {
+        switch (opt) {
+            case 'i': image = optarg; break;
+            case 'D': direct = 1; break;
+            case 'j': pool_set_width(atol(optarg)); break;
+            case 'q': quiet = 1; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    pool_t *pool = pool_get();
+    if (!pool) {
+        fprintf(stderr, "Error: cannot create worker threads\n");
+        return 1;
+    }
+    if (image)
+        return verify_image(image, pool, direct);
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (collect(argv[i]) != 0)
+            return 1;
+    }
+
+    if (job_count == 0) {
+        printf("No packages found\n");
+        return 1;
+    }
+    printf("Verifying %zu packages with %d threads...\n", job_count, pool_width(pool));
+
+    double start = now_seconds();
+
+    for (size_t i = 0; i < job_count; i++) {
+        if (pool_submit(pool, package_task, &jobs[i]) != 0)
+            package_task(&jobs[i], 0);
+    }
+    pool_wait(pool);
+
+    double elapsed = now_seconds() - start;
+
+    uint64_t total_bytes = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < job_count; i++) {
+        total_bytes += jobs[i].size;
+        if (!jobs[i].ok) {
+            if (quiet)
+                printf("  [FAIL] %s: %s\n", jobs[i].path, jobs[i].err);
+            failures++;
+        }
+    }
+
+    printf("\nVerification complete\n");
+    printf("  Packages: %zu (%zu ok, %zu failed)\n", job_count, job_count - failures, failures);
+    printf("  Bytes: %llu\n", (unsigned long long)total_bytes);
+    printf("  Time: %.3f s\n", elapsed);
+    if (elapsed > 0) {
+        printf("  Throughput: %.1f MB/s, %.0f packages/s\n",
+               total_bytes / elapsed / (1024.0 * 1024.0), job_count / elapsed);
+    }
+
+    for (size_t i = 0; i < job_count; i++)
+        free(jobs[i].path);
+    free(jobs);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,826 @@
+/**
+ * @file msa.c
+ * @brief CRC32 y validación de paquetes .msa (ver msa.h)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "msa.h"
+
+#define COPY_CHUNK (1024 * 1024)
+
+/* ==================== CRC32 ==================== */
+
+#define CRC32_POLY 0xEDB88320
+
+/* Tablas para slicing-by-8: 8 bytes por iteración en vez de 1 bit */
+static uint32_t crc_table[8][256];
+
+/* x^(2^n) mod P(x), para combinar CRCs sin releer datos */
+static uint32_t x2n_table[32];
+
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+    }
+    return p;
+}
+
+__attribute__((constructor))
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++)
+            c = (c >> 1) ^ (CRC32_POLY & -(c & 1));
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++)
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xFF];
+    }
+
+    uint32_t p = (uint32_t)1 << 30;  /* x^1 */
+    x2n_table[0] = p;
+    for (int n = 1; n < 32; n++)
+        x2n_table[n] = p = multmodp(p, p);
+}
+
+/* x^(n * 2^k) mod P(x) */
+static uint32_t x2nmodp(uint64_t n, unsigned k) {
+    uint32_t p = (uint32_t)1 << 31;  /* x^0 == 1 */
+    while (n) {
+        if (n & 1)
+            p = multmodp(x2n_table[k & 31], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+uint32_t msa_crc32_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    crc = ~crc;
+
+    while (len && ((uintptr_t)p & 7)) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+
+    return ~crc;
+}
+
+uint32_t msa_crc32(const void *data, size_t len) {
+    return msa_crc32_update(0, data, len);
+}
+
+uint32_t msa_crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+    return multmodp(x2nmodp(len_b, 3), crc_a) ^ crc_b;
+}
+
+/* ==================== Formato v2 (compacto) ==================== */
+
+static size_t put_varint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    uint64_t r = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p >= end)
+            return -1;
+        uint8_t b = *(*p)++;
+        r |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static size_t put_string(uint8_t *p, const char *s, size_t max) {
+    size_t len = strnlen(s, max);
+    size_t n = put_varint(p, len);
+    memcpy(p + n, s, len);
+    return n + len;
+}
+
+static int get_string(const uint8_t **p, const uint8_t *end, char *out, size_t max) {
+    uint64_t len;
+    if (get_varint(p, end, &len) != 0 || len >= max || len > (uint64_t)(end - *p))
+        return -1;
+    memcpy(out, *p, len);
+    out[len] = '\0';
+    *p += len;
+    return 0;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int compare_paths(const void *a, const void *b, void *arg) {
+    const msa_file_entry_t *entries = arg;
+    return strcmp(entries[*(const uint32_t *)a].path, entries[*(const uint32_t *)b].path);
+}
+
+void msa_sort_order(const msa_file_entry_t *entries, uint32_t count, uint32_t *order) {
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = i;
+    qsort_r(order, count, sizeof(uint32_t), compare_paths, (void *)entries);
+}
+
+static int compare_offsets(const void *a, const void *b, void *arg) {
+    const msa_file_entry_t *ea = (const msa_file_entry_t *)arg + *(const uint32_t *)a;
+    const msa_file_entry_t *eb = (const msa_file_entry_t *)arg + *(const uint32_t *)b;
+    /* Los directorios (sin datos) primero, en su orden */
+    int da = ea->type != MSA_TYPE_DIR, db = eb->type != MSA_TYPE_DIR;
+    if (da != db)
+        return da - db;
+    if (da && ea->offset != eb->offset)
+        return ea->offset < eb->offset ? -1 : 1;
+    return (*(const uint32_t *)a > *(const uint32_t *)b) - (*(const uint32_t *)a < *(const uint32_t *)b);
+}
+
+void msa_data_order(const msa_file_entry_t *entries, uint32_t count, uint32_t *order) {
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = i;
+    qsort_r(order, count, sizeof(uint32_t), compare_offsets, (void *)entries);
+}
+
+int msa_encode_v2(const msa_header_t *h, const msa_file_entry_t *entries, uint32_t count,
+                  uint8_t **out, size_t *out_len) {
+    /* Cota superior: cada campo ocupa como mucho su tamaño v1 + varints */
+    size_t cap = sizeof(msa_v2_header_t) + sizeof(msa_header_t) + 64 +
+                 (size_t)count * (MSA_PATH_MAX + 48);
+    uint8_t *buf = malloc(cap);
+    if (!buf)
+        return -1;
+
+    uint8_t *p = buf + sizeof(msa_v2_header_t);
+    p += put_string(p, h->name, MSA_NAME_MAX);
+    p += put_string(p, h->pkg_version, sizeof(h->pkg_version));
+    p += put_string(p, h->author, MSA_NAME_MAX);
+    p += put_string(p, h->description, MSA_DESC_MAX);
+    p += put_varint(p, h->num_deps);
+    for (int i = 0; i < h->num_deps; i++)
+        p += put_string(p, h->deps[i], MSA_NAME_MAX);
+
+    const char *prev = "";
+    uint64_t expected = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const msa_file_entry_t *e = &entries[i];
+        if (strcmp(prev, e->path) > 0) {
+            free(buf);
+            return -1;  /* Deben venir ordenadas */
+        }
+
+        /* Ruta: prefijo compartido con la anterior + sufijo */
+        size_t shared = 0;
+        while (prev[shared] && prev[shared] == e->path[shared])
+            shared++;
+        size_t suffix = strnlen(e->path, MSA_PATH_MAX) - shared;
+        p += put_varint(p, shared);
+        p += put_varint(p, suffix);
+        memcpy(p, e->path + shared, suffix);
+        p += suffix;
+        prev = e->path;
+
+        *p++ = e->type;
+        *p++ = e->flags | (e->executable ? MSA_V2_EXEC : 0);
+        p += put_varint(p, e->mode);
+
+        if (e->type != MSA_TYPE_DIR) {
+            p += put_varint(p, e->size);
+            if (e->flags & (MSA_ENTRY_SPARSE | MSA_ENTRY_DEFLATE))
+                p += put_varint(p, e->stored_size);
+            /* Offset relativo a los datos, como diferencia con el esperado */
+            p += put_varint(p, zigzag((int64_t)e->offset - (int64_t)expected));
+            expected = (uint64_t)e->offset + msa_stored_size(e);
+            if (e->flags & MSA_ENTRY_CRC) {
+                memcpy(p, &e->crc32, 4);
+                p += 4;
+            }
+        }
+    }
+
+    msa_v2_header_t *v2 = (msa_v2_header_t *)buf;
+    memset(v2, 0, sizeof(*v2));
+    v2->magic = MSA_MAGIC;
+    v2->version = MSA_VERSION_COMPACT;
+    v2->header_size = p - buf;
+    v2->num_files = count;
+    v2->total_size = h->total_size;
+    v2->dict_id = h->dict_id;
+
+    *out = buf;
+    *out_len = p - buf;
+    return 0;
+}
+
+static int decode_v2(const uint8_t *data, size_t avail, msa_header_t *h,
+                     msa_file_entry_t **entries, char *err, size_t err_len) {
+    const msa_v2_header_t *v2 = (const msa_v2_header_t *)data;
+    const uint8_t *p = data + sizeof(*v2);
+    const uint8_t *end = data + v2->header_size;
+    uint64_t num_deps;
+
+    memset(h, 0, sizeof(*h));
+    h->magic = v2->magic;
+    h->version = v2->version;
+    h->header_size = v2->header_size;
+    h->checksum = v2->checksum;
+    h->num_files = v2->num_files;
+    h->total_size = v2->total_size;
+    h->dict_id = v2->dict_id;
+
+    if (v2->header_size > avail) {
+        snprintf(err, err_len, "file table not available (%u bytes)", v2->header_size);
+        return -1;
+    }
+    /* Cada entrada ocupa al menos 5 bytes */
+    if (v2->num_files > (v2->header_size - sizeof(*v2)) / 5) {
+        snprintf(err, err_len, "bad num_files %u", v2->num_files);
+        return -1;
+    }
+
+    if (get_string(&p, end, h->name, MSA_NAME_MAX) != 0 ||
+        get_string(&p, end, h->pkg_version, sizeof(h->pkg_version)) != 0 ||
+        get_string(&p, end, h->author, MSA_NAME_MAX) != 0 ||
+        get_string(&p, end, h->description, MSA_DESC_MAX) != 0 ||
+        get_varint(&p, end, &num_deps) != 0 || num_deps > MSA_MAX_DEPS) {
+        snprintf(err, err_len, "corrupt package strings");
+        return -1;
+    }
+    h->num_deps = num_deps;
+    for (int i = 0; i < h->num_deps; i++) {
+        if (get_string(&p, end, h->deps[i], MSA_NAME_MAX) != 0) {
+            snprintf(err, err_len, "corrupt dependency %d", i);
+            return -1;
+        }
+    }
+
+    msa_file_entry_t *e = calloc(h->num_files ? h->num_files : 1, sizeof(*e));
+    if (!e) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+
+    uint64_t expected = 0;
+    for (uint32_t i = 0; i < h->num_files; i++) {
+        uint64_t shared, suffix, mode, size, stored = 0, delta;
+        if (get_varint(&p, end, &shared) != 0 || get_varint(&p, end, &suffix) != 0 ||
+            (i == 0 ? shared != 0 : shared > strlen(e[i - 1].path)) ||
+            shared + suffix >= MSA_PATH_MAX || suffix + 2 > (uint64_t)(end - p)) {
+            snprintf(err, err_len, "entry %u: corrupt path", i);
+            free(e);
+            return -1;
+        }
+        if (i > 0)
+            memcpy(e[i].path, e[i - 1].path, shared);
+        memcpy(e[i].path + shared, p, suffix);
+        p += suffix;
+
+        e[i].type = *p++;
+        uint8_t flags = *p++;
+        e[i].executable = (flags & MSA_V2_EXEC) ? 1 : 0;
+        e[i].flags = flags & ~MSA_V2_EXEC;
+        if (get_varint(&p, end, &mode) != 0) {
+            snprintf(err, err_len, "entry %u (%s): corrupt mode", i, e[i].path);
+            free(e);
+            return -1;
+        }
+        e[i].mode = mode;
+
+        if (e[i].type != MSA_TYPE_DIR) {
+            if (get_varint(&p, end, &size) != 0 ||
+                ((e[i].flags & (MSA_ENTRY_SPARSE | MSA_ENTRY_DEFLATE)) &&
+                 get_varint(&p, end, &stored) != 0) ||
+                get_varint(&p, end, &delta) != 0 || size > UINT32_MAX || stored > UINT32_MAX) {
+                snprintf(err, err_len, "entry %u (%s): corrupt size/offset", i, e[i].path);
+                free(e);
+                return -1;
+            }
+            int64_t offset = (int64_t)expected + unzigzag(delta);
+            if (offset < 0 || (uint64_t)offset + h->header_size > UINT32_MAX) {
+                snprintf(err, err_len, "entry %u (%s): bad offset", i, e[i].path);
+                free(e);
+                return -1;
+            }
+            e[i].size = size;
+            e[i].stored_size = stored;
+            e[i].offset = offset + h->header_size;
+            expected = (uint64_t)offset + msa_stored_size(&e[i]);
+            if (e[i].flags & MSA_ENTRY_CRC) {
+                if (end - p < 4) {
+                    snprintf(err, err_len, "entry %u (%s): truncated", i, e[i].path);
+                    free(e);
+                    return -1;
+                }
+                memcpy(&e[i].crc32, p, 4);
+                p += 4;
+            }
+        }
+    }
+
+    *entries = e;
+    return 0;
+}
+
+/* ==================== Paquetes ==================== */
+
+static int validate_entries(const msa_header_t *h, const msa_file_entry_t *e, uint64_t size,
+                            char *err, size_t err_len) {
+    uint64_t data_total = 0;
+
+    for (uint32_t i = 0; i < h->num_files; i++) {
+        if (memchr(e[i].path, '\0', MSA_PATH_MAX) == NULL) {
+            snprintf(err, err_len, "entry %u: unterminated path", i);
+            return -1;
+        }
+        if (e[i].type > MSA_TYPE_SYMLINK) {
+            snprintf(err, err_len, "entry %u (%s): unknown type %u", i, e[i].path, e[i].type);
+            return -1;
+        }
+        if (e[i].type == MSA_TYPE_DIR)
+            continue;
+        if (e[i].type == MSA_TYPE_SYMLINK &&
+            (e[i].size == 0 || (e[i].flags & (MSA_ENTRY_SPARSE | MSA_ENTRY_DEFLATE)))) {
+            snprintf(err, err_len, "entry %u (%s): bad symlink target", i, e[i].path);
+            return -1;
+        }
+        if (e[i].offset < h->header_size ||
+            (uint64_t)e[i].offset + msa_stored_size(&e[i]) > size) {
+            snprintf(err, err_len, "entry %u (%s): data [%u, +%u) outside file (%llu bytes)",
+                     i, e[i].path, e[i].offset, msa_stored_size(&e[i]), (unsigned long long)size);
+            return -1;
+        }
+        if ((e[i].flags & MSA_ENTRY_SPARSE) && e[i].stored_size < 4) {
+            snprintf(err, err_len, "entry %u (%s): sparse map truncated", i, e[i].path);
+            return -1;
+        }
+        if ((e[i].flags & MSA_ENTRY_SPARSE) && (e[i].flags & MSA_ENTRY_DEFLATE)) {
+            snprintf(err, err_len, "entry %u (%s): both sparse and compressed", i, e[i].path);
+            return -1;
+        }
+        data_total += e[i].size;
+    }
+
+    if (data_total != h->total_size) {
+        snprintf(err, err_len, "total_size %u does not match entries (%llu)",
+                 h->total_size, (unsigned long long)data_total);
+        return -1;
+    }
+
+    return 0;
+}
+
+int msa_sparse_check(const uint8_t *data, uint32_t stored_size, uint32_t size) {
+    uint32_t n;
+    if (stored_size < 4)
+        return -1;
+    memcpy(&n, data, 4);
+    if (n > (stored_size - 4) / sizeof(msa_extent_t))
+        return -1;
+
+    uint64_t end = 0, bytes = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        msa_extent_t ext;
+        memcpy(&ext, data + 4 + i * sizeof(ext), sizeof(ext));
+        if (ext.offset < end || (uint64_t)ext.offset + ext.length > size)
+            return -1;
+        end = (uint64_t)ext.offset + ext.length;
+        bytes += ext.length;
+    }
+
+    if (4 + (uint64_t)n * sizeof(msa_extent_t) + bytes != stored_size)
+        return -1;
+    return n;
+}
+
+int msa_parse(const uint8_t *data, size_t avail, uint64_t size, msa_header_t *h,
+              msa_file_entry_t **entries, char *err, size_t err_len) {
+    *entries = NULL;
+
+    if (size < sizeof(msa_v2_header_t) || avail < sizeof(msa_v2_header_t)) {
+        snprintf(err, err_len, "file too small for header (%llu bytes)", (unsigned long long)size);
+        return -1;
+    }
+
+    const msa_v2_header_t *v2 = (const msa_v2_header_t *)data;
+    if (v2->magic != MSA_MAGIC) {
+        snprintf(err, err_len, "bad magic 0x%08X", v2->magic);
+        return -1;
+    }
+
+    if (v2->version == MSA_VERSION_COMPACT) {
+        if (v2->header_size < sizeof(*v2) || v2->header_size > size) {
+            snprintf(err, err_len, "bad header_size %u (file %llu)", v2->header_size,
+                     (unsigned long long)size);
+            return -1;
+        }
+        if (decode_v2(data, avail, h, entries, err, err_len) != 0)
+            return -1;
+    } else if (v2->version == MSA_VERSION) {
+        if (size < sizeof(msa_header_t) || avail < sizeof(msa_header_t)) {
+            snprintf(err, err_len, "file too small for header (%llu bytes)",
+                     (unsigned long long)size);
+            return -1;
+        }
+        memcpy(h, data, sizeof(*h));
+        if (h->num_deps > MSA_MAX_DEPS) {
+            snprintf(err, err_len, "too many dependencies (%u)", h->num_deps);
+            return -1;
+        }
+        uint64_t expected = sizeof(msa_header_t) + (uint64_t)h->num_files * sizeof(msa_file_entry_t);
+        if (h->header_size != expected || h->header_size > size) {
+            snprintf(err, err_len, "bad header_size %u (expected %llu, file %llu)",
+                     h->header_size, (unsigned long long)expected, (unsigned long long)size);
+            return -1;
+        }
+        if (h->header_size > avail) {
+            snprintf(err, err_len, "file table not available (%u bytes)", h->header_size);
+            return -1;
+        }
+        size_t table_len = h->header_size - sizeof(*h);
+        *entries = malloc(table_len ? table_len : 1);
+        if (!*entries) {
+            snprintf(err, err_len, "out of memory");
+            return -1;
+        }
+        memcpy(*entries, data + sizeof(*h), table_len);
+    } else {
+        snprintf(err, err_len, "unsupported format version %u", v2->version);
+        return -1;
+    }
+
+    if (validate_entries(h, *entries, size, err, err_len) != 0) {
+        free(*entries);
+        *entries = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int msa_validate(const uint8_t *data, size_t size, char *err, size_t err_len) {
+    return msa_validate_header(data, size, size, err, err_len);
+}
+
+int msa_validate_header(const uint8_t *data, size_t avail, uint64_t size,
+                        char *err, size_t err_len) {
+    msa_header_t h;
+    msa_file_entry_t *entries;
+    if (msa_parse(data, avail, size, &h, &entries, err, err_len) != 0)
+        return -1;
+    free(entries);
+    return 0;
+}
+
+size_t msa_checksum_offset(const uint8_t *data) {
+    const msa_v2_header_t *v2 = (const msa_v2_header_t *)data;
+    return v2->version == MSA_VERSION_COMPACT ? offsetof(msa_v2_header_t, checksum)
+                                              : offsetof(msa_header_t, checksum);
+}
+
+uint32_t msa_package_crc(const uint8_t *data, size_t size) {
+    static const uint8_t zero[4];
+    size_t off = msa_checksum_offset(data);
+
+    uint32_t crc = msa_crc32(data, off);
+    crc = msa_crc32_update(crc, zero, sizeof(zero));
+    return msa_crc32_update(crc, data + off + 4, size - off - 4);
+}
+
+int msa_read_table(int fd, msa_header_t *h, msa_file_entry_t **entries,
+                   uint64_t *size, char *err, size_t err_len) {
+    struct stat st;
+    *entries = NULL;
+
+    if (fstat(fd, &st) != 0) {
+        snprintf(err, err_len, "fstat: %s", strerror(errno));
+        return -1;
+    }
+    *size = st.st_size;
+
+    /* header_size está en sitios distintos según la versión */
+    msa_v2_header_t v2;
+    if (pread(fd, &v2, sizeof(v2), 0) != sizeof(v2) || v2.magic != MSA_MAGIC) {
+        snprintf(err, err_len, "not a valid package");
+        return -1;
+    }
+    uint64_t header_size = v2.header_size;
+    if (v2.version != MSA_VERSION_COMPACT) {
+        if (pread(fd, h, sizeof(*h), 0) != sizeof(*h)) {
+            snprintf(err, err_len, "file too small for header");
+            return -1;
+        }
+        header_size = h->header_size;
+    }
+    if (header_size < sizeof(v2) || header_size > *size) {
+        snprintf(err, err_len, "not a valid package");
+        return -1;
+    }
+
+    uint8_t *buf = malloc(header_size);
+    if (!buf) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    if (pread(fd, buf, header_size, 0) != (ssize_t)header_size) {
+        snprintf(err, err_len, "cannot read file table");
+        free(buf);
+        return -1;
+    }
+
+    int rc = msa_parse(buf, header_size, *size, h, entries, err, err_len);
+    free(buf);
+    return rc;
+}
+
+int msa_file_crc(int fd, uint64_t offset, uint64_t len, uint32_t *crc) {
+    uint8_t *buf = malloc(COPY_CHUNK);
+    if (!buf)
+        return -1;
+
+    uint32_t c = 0;
+    while (len > 0) {
+        size_t chunk = len < COPY_CHUNK ? len : COPY_CHUNK;
+        ssize_t n = pread(fd, buf, chunk, offset);
+        if (n <= 0) {
+            free(buf);
+            return -1;
+        }
+        c = msa_crc32_update(c, buf, n);
+        offset += n;
+        len -= n;
+    }
+
+    free(buf);
+    *crc = c;
+    return 0;
+}
+
+int msa_copy_range(int in_fd, uint64_t in_off, int out_fd, uint64_t out_off, uint64_t len) {
+    while (len > 0) {
+        loff_t src = in_off, dst = out_off;
+        ssize_t n = copy_file_range(in_fd, &src, out_fd, &dst, len, 0);
+        if (n <= 0)
+            break;
+        in_off += n;
+        out_off += n;
+        len -= n;
+    }
+    if (len == 0)
+        return 0;
+
+    /* Sin soporte (EXDEV, ENOSYS, ...): copia clásica */
+    uint8_t *buf = malloc(COPY_CHUNK);
+    if (!buf)
+        return -1;
+    while (len > 0) {
+        size_t chunk = len < COPY_CHUNK ? len : COPY_CHUNK;
+        ssize_t n = pread(in_fd, buf, chunk, in_off);
+        if (n <= 0 || pwrite(out_fd, buf, n, out_off) != n) {
+            free(buf);
+            return -1;
+        }
+        in_off += n;
+        out_off += n;
+        len -= n;
+    }
+    free(buf);
+    return 0;
+}
+
+int msa_build_header(msa_header_t *h, msa_file_entry_t *entries, uint32_t count,
+                     uint8_t **out, size_t *out_len) {
+    h->num_files = count;
+    h->checksum = 0;
+
+    if (h->version == MSA_VERSION_COMPACT) {
+        if (msa_encode_v2(h, entries, count, out, out_len) != 0)
+            return -1;
+        h->header_size = *out_len;
+        for (uint32_t i = 0; i < count; i++) {
+            if (entries[i].type != MSA_TYPE_DIR)
+                entries[i].offset += h->header_size;
+        }
+        return 0;
+    }
+
+    h->header_size = sizeof(msa_header_t) + count * sizeof(msa_file_entry_t);
+    for (uint32_t i = 0; i < count; i++) {
+        if (entries[i].type != MSA_TYPE_DIR)
+            entries[i].offset += h->header_size;
+    }
+
+    uint8_t *buf = malloc(h->header_size);
+    if (!buf)
+        return -1;
+    memcpy(buf, h, sizeof(*h));
+    memcpy(buf + sizeof(*h), entries, (size_t)count * sizeof(msa_file_entry_t));
+    *out = buf;
+    *out_len = h->header_size;
+    return 0;
+}
+
+/*
+ * Comprueba la cabecera y la file table de un paquete abierto antes de
+ * copiar de él: si los datos cubren el paquete sin huecos, el checksum sale
+ * de combinar los CRC de la tabla, y solo se leen las entradas sin CRC. Los
+ * datos de cada entrada copiada se comprueban aparte. Retorna 0 si coincide.
+ */
+static int check_source(int fd) {
+    msa_header_t h;
+    msa_file_entry_t *e;
+    uint64_t size;
+    char err[256];
+
+    if (msa_read_table(fd, &h, &e, &size, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: input package: %s\n", err);
+        errno = EBADMSG;
+        return -1;
+    }
+
+    uint8_t *head = malloc(h.header_size);
+    uint32_t *order = malloc((h.num_files + 1) * sizeof(uint32_t));
+    int rc = -1;
+    if (!head || !order || pread(fd, head, h.header_size, 0) != (ssize_t)h.header_size)
+        goto out;
+
+    uint32_t crc = msa_package_crc(head, h.header_size);
+    uint64_t pos = h.header_size;
+    msa_data_order(e, h.num_files, order);
+    for (uint32_t k = 0; k < h.num_files; k++) {
+        uint32_t i = order[k];
+        if (e[i].type == MSA_TYPE_DIR)
+            continue;
+        if (e[i].offset != pos)
+            break;
+        uint32_t stored = msa_stored_size(&e[i]), file_crc = e[i].crc32;
+        if (!(e[i].flags & MSA_ENTRY_CRC) && msa_file_crc(fd, pos, stored, &file_crc) != 0)
+            goto out;
+        crc = msa_crc32_combine(crc, file_crc, stored);
+        pos += stored;
+    }
+
+    /* Huecos o entradas solapadas: el resto se lee */
+    if (pos < size) {
+        uint32_t rest;
+        if (msa_file_crc(fd, pos, size - pos, &rest) != 0)
+            goto out;
+        crc = msa_crc32_combine(crc, rest, size - pos);
+    }
+
+    if (crc != h.checksum) {
+        fprintf(stderr, "Error: input package checksum mismatch (0x%08X, expected 0x%08X)\n",
+                crc, h.checksum);
+        errno = EBADMSG;
+        goto out;
+    }
+    rc = 0;
+
+out:
+    free(head);
+    free(order);
+    free(e);
+    return rc;
+}
+
+int64_t msa_assemble(int out_fd, msa_header_t *h, msa_file_entry_t *entries,
+                     const int *src_fds, uint32_t count) {
+    uint32_t n = count ? count : 1;
+    uint32_t *order = malloc(n * sizeof(uint32_t));
+    msa_file_entry_t *out_e = malloc(n * sizeof(msa_file_entry_t));
+    uint64_t *src_off = malloc(n * sizeof(uint64_t));
+    uint8_t *blob = NULL;
+    size_t blob_len;
+    int64_t result = -1;
+
+    if (!order || !out_e || !src_off)
+        goto out;
+
+    /* Cada paquete de origen se comprueba una vez (order guarda los ya vistos) */
+    uint32_t sources = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t j = 0;
+        while (j < sources && src_fds[order[j]] != src_fds[i])
+            j++;
+        if (j < sources)
+            continue;
+        if (check_source(src_fds[i]) != 0)
+            goto out;
+        order[sources++] = i;
+    }
+
+    /*
+     * Los datos van en el orden de entries; el CRC de cada entrada se
+     * calcula y, si el origen lo trae, se compara. Los offsets quedan
+     * relativos a los datos.
+     */
+    uint64_t pos = 0, total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        src_off[i] = entries[i].offset;
+        if (entries[i].type == MSA_TYPE_DIR)
+            continue;
+        uint32_t crc;
+        if (msa_file_crc(src_fds[i], entries[i].offset, msa_stored_size(&entries[i]), &crc) != 0)
+            goto out;
+        if ((entries[i].flags & MSA_ENTRY_CRC) && crc != entries[i].crc32) {
+            fprintf(stderr, "Error: %s: input file checksum mismatch (0x%08X, expected 0x%08X)\n",
+                    entries[i].path, crc, entries[i].crc32);
+            errno = EBADMSG;
+            goto out;
+        }
+        entries[i].crc32 = crc;
+        entries[i].flags |= MSA_ENTRY_CRC;
+        entries[i].offset = pos;
+        pos += msa_stored_size(&entries[i]);
+        total += entries[i].size;
+    }
+
+    /* v2 exige la tabla ordenada por ruta */
+    if (h->version == MSA_VERSION_COMPACT) {
+        msa_sort_order(entries, count, order);
+    } else {
+        for (uint32_t i = 0; i < count; i++)
+            order[i] = i;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        out_e[i] = entries[order[i]];
+
+    h->total_size = total;
+    if (msa_build_header(h, out_e, count, &blob, &blob_len) != 0)
+        goto out;
+
+    if (blob_len + pos > UINT32_MAX) {
+        fprintf(stderr, "Error: package would exceed 4 GiB\n");
+        goto out;
+    }
+
+    uint32_t crc = msa_crc32(blob, blob_len);
+    for (uint32_t i = 0; i < count; i++) {
+        if (entries[i].type == MSA_TYPE_DIR)
+            continue;
+        uint32_t stored = msa_stored_size(&entries[i]);
+        if (msa_copy_range(src_fds[i], src_off[i], out_fd, blob_len + entries[i].offset,
+                           stored) != 0)
+            goto out;
+        crc = msa_crc32_combine(crc, entries[i].crc32, stored);
+    }
+
+    h->checksum = crc;
+    memcpy(blob + msa_checksum_offset(blob), &crc, 4);
+    if (pwrite(out_fd, blob, blob_len, 0) != (ssize_t)blob_len ||
+        ftruncate(out_fd, blob_len + pos) != 0)
+        goto out;
+
+    memcpy(entries, out_e, (size_t)count * sizeof(msa_file_entry_t));
+    result = blob_len + pos;
+
+out:
+    free(order);
+    free(out_e);
+    free(src_off);
+    free(blob);
+    return result;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file msa.h
+ * @brief Formato de paquetes .msa compartido por las herramientas de host
+ *
+ * Las estructuras deben coincidir con las de MesaOS. Las funciones viven en
+ * msa.c, que se compila junto a cada herramienta:
+ *   gcc -o msa-verify msa-verify.c msa.c -lpthread
+ */
+
+#ifndef MSA_H
+#define MSA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ==================== Constantes ==================== */
+
+#define MSA_MAGIC           0x4153454D  /* "MESA" */
+#define MSA_VERSION         1
+#define MSA_VERSION_COMPACT 2           /* Header y file table compactos */
+#define MSA_NAME_MAX        64
+#define MSA_PATH_MAX        256
+#define MSA_DESC_MAX        256
+#define MSA_MAX_FILES       256
+#define MSA_MAX_DEPS        16
+
+/* Tipos de entrada */
+#define MSA_TYPE_FILE       0
+#define MSA_TYPE_DIR        1
+#define MSA_TYPE_SYMLINK    2           /* Los datos son el destino, sin '\0' */
+
+/* Flags de entrada (msa_file_entry_t.flags) */
+#define MSA_ENTRY_CRC       0x01    /* crc32 contiene el CRC de los datos */
+#define MSA_ENTRY_SPARSE    0x02    /* Datos con mapa de extents (ver abajo) */
+#define MSA_ENTRY_DEFLATE   0x04    /* Datos en formato zlib (ver abajo) */
+#define MSA_V2_EXEC         0x80    /* v2: executable va dentro de flags */
+
+/* ==================== Estructuras (deben coincidir con MesaOS) ==================== */
+
+typedef struct {
+    uint32_t magic;                         /* MSA_MAGIC */
+    uint32_t version;                       /* Versión del formato */
+    char     name[MSA_NAME_MAX];            /* Nombre del paquete */
+    char     pkg_version[16];               /* Versión del paquete */
+    char     author[MSA_NAME_MAX];          /* Autor */
+    char     description[MSA_DESC_MAX];     /* Descripción */
+    uint32_t num_files;                     /* Cantidad de archivos */
+    uint32_t total_size;                    /* Tamaño total descomprimido */
+    uint32_t header_size;                   /* Tamaño del header + file table */
+    uint16_t num_deps;                      /* Número de dependencias */
+    char     deps[MSA_MAX_DEPS][MSA_NAME_MAX]; /* Dependencias */
+    uint32_t checksum;                      /* CRC32 del paquete (con este campo a 0) */
+    uint32_t dict_id;                       /* Diccionario de compresión (0 = ninguno) */
+    uint8_t  reserved[124];                 /* Reservado */
+} __attribute__((packed)) msa_header_t;
+
+typedef struct {
+    char     path[MSA_PATH_MAX];            /* Ruta de instalación */
+    uint32_t size;                          /* Tamaño del archivo */
+    uint32_t offset;                        /* Offset en el archivo .msa */
+    uint32_t mode;                          /* Permisos (estilo UNIX) */
+    uint8_t  type;                          /* 0=archivo, 1=directorio, 2=symlink */
+    uint8_t  executable;                    /* 1 si es ejecutable */
+    uint32_t crc32;                         /* CRC32 de los datos (si MSA_ENTRY_CRC) */
+    uint8_t  flags;                         /* MSA_ENTRY_* */
+    uint32_t stored_size;                   /* Bytes en el paquete (si SPARSE o DEFLATE) */
+    uint8_t  reserved[45];                  /* Padding a 324 bytes */
+} __attribute__((packed)) msa_file_entry_t;
+
+#define MSA_CHECKSUM_OFFSET offsetof(msa_header_t, checksum)
+
+/*
+ * Entradas dispersas (MSA_ENTRY_SPARSE): size es el tamaño lógico y los
+ * stored_size bytes en offset son
+ *   u32 n, n x msa_extent_t (ordenados, sin solaparse), datos de los extents
+ * Lo que no cubre ningún extent es un hueco (ceros). crc32 es el CRC de
+ * los bytes almacenados.
+ */
+typedef struct {
+    uint32_t offset;                        /* Offset lógico en el archivo */
+    uint32_t length;
+} __attribute__((packed)) msa_extent_t;
+
+/*
+ * Entradas comprimidas (MSA_ENTRY_DEFLATE): stored_size bytes en formato
+ * zlib que se descomprimen a size bytes. Si el header tiene dict_id, los
+ * streams usan como diccionario preestablecido el del paquete
+ * MSA_DICT_PACKAGE "-<dict_id en hex>", que contiene MSA_DICT_DIR/<id>.dict;
+ * dict_id es el Adler-32 del diccionario, el mismo que zlib guarda en los
+ * streams que lo usan (inflate lo pide con Z_NEED_DICT; los que no, se
+ * descomprimen sin él). crc32 es el CRC de los bytes almacenados.
+ */
+#define MSA_DICT_PACKAGE    "msa-dict"
+#define MSA_DICT_DIR        "/usr/share/msa/dict"
+#define MSA_DICT_MAX        32768       /* Ventana de deflate */
+
+/* Bytes que ocupan los datos de una entrada dentro del paquete */
+static inline uint32_t msa_stored_size(const msa_file_entry_t *e) {
+    return (e->flags & (MSA_ENTRY_SPARSE | MSA_ENTRY_DEFLATE)) ? e->stored_size : e->size;
+}
+
+/*
+ * Formato v2: header fijo de 32 bytes seguido de metadatos de longitud
+ * variable; los datos empiezan en header_size.
+ *
+ *   cadenas:  name, pkg_version, author, description  (varint len + bytes)
+ *   varint    num_deps, y cada dependencia como cadena
+ *   entradas, ordenadas por ruta:
+ *     varint  bytes compartidos con la ruta anterior
+ *     varint  longitud del sufijo, y el sufijo
+ *     u8      type
+ *     u8      flags (MSA_ENTRY_* | MSA_V2_EXEC)
+ *     varint  mode
+ *     si no es directorio:
+ *       varint  size
+ *       varint  stored_size (si MSA_ENTRY_SPARSE o MSA_ENTRY_DEFLATE)
+ *       varint  zigzag(offset - fin de la entrada anterior), relativo a datos
+ *       u32     crc32 (si MSA_ENTRY_CRC)
+ */
+typedef struct {
+    uint32_t magic;                         /* MSA_MAGIC */
+    uint32_t version;                       /* MSA_VERSION_COMPACT */
+    uint32_t header_size;                   /* Header + metadatos */
+    uint32_t checksum;                      /* CRC32 del paquete (con este campo a 0) */
+    uint32_t num_files;
+    uint32_t total_size;
+    uint32_t dict_id;                       /* Como en msa_header_t */
+    uint32_t reserved;
+} __attribute__((packed)) msa_v2_header_t;
+
+/* ==================== CRC32 ==================== */
+
+/* CRC32 (polinomio 0xEDB88320) de un bloque de datos */
+uint32_t msa_crc32(const void *data, size_t len);
+
+/* Continúa un CRC32 ya calculado con más datos */
+uint32_t msa_crc32_update(uint32_t crc, const void *data, size_t len);
+
+/* CRC32 de A||B a partir de crc(A), crc(B) y la longitud de B */
+uint32_t msa_crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b);
+
+/* ==================== Paquetes ==================== */
+
+/**
+ * Comprueba el mapa de una entrada dispersa: stored_size bytes en data
+ * (formato arriba) para un archivo de size bytes. Retorna el número de
+ * extents, o -1 si el mapa no es coherente.
+ */
+int msa_sparse_check(const uint8_t *data, uint32_t stored_size, uint32_t size);
+
+/**
+ * Comprueba que un paquete en memoria es coherente: magic, versión,
+ * tamaño del header y que los datos de cada entrada caen dentro del
+ * archivo. En caso de error deja una descripción en err.
+ * Retorna 0 si es válido, -1 si no.
+ */
+int msa_validate(const uint8_t *data, size_t size, char *err, size_t err_len);
+
+/**
+ * Lee header y file table (v1 o v2) y los valida. El resultado siempre usa
+ * las estructuras v1: en v2, h->version es 2, h->header_size el tamaño real
+ * y los offsets de las entradas son absolutos. *entries con malloc.
+ * avail: bytes disponibles desde el inicio; size: tamaño del archivo.
+ */
+int msa_parse(const uint8_t *data, size_t avail, uint64_t size, msa_header_t *h,
+              msa_file_entry_t **entries, char *err, size_t err_len);
+
+/**
+ * Igual que msa_validate, pero solo con los primeros avail bytes del paquete
+ * en memoria (header + file table) y el tamaño real del archivo aparte.
+ */
+int msa_validate_header(const uint8_t *data, size_t avail, uint64_t size,
+                        char *err, size_t err_len);
+
+/* Offset del campo checksum según la versión del paquete */
+size_t msa_checksum_offset(const uint8_t *data);
+
+/* CRC32 de un paquete completo, tratando el campo checksum como 0 */
+uint32_t msa_package_crc(const uint8_t *data, size_t size);
+
+/* Índices de las entradas ordenadas por ruta (orden de la tabla v2) */
+void msa_sort_order(const msa_file_entry_t *entries, uint32_t count, uint32_t *order);
+
+/**
+ * Índices de las entradas en el orden de sus datos dentro del paquete
+ * (directorios primero). Recorrerlas así lee el paquete solo hacia delante.
+ */
+void msa_data_order(const msa_file_entry_t *entries, uint32_t count, uint32_t *order);
+
+/**
+ * Codifica header y file table en formato v2. Las entradas deben estar
+ * ordenadas por ruta y sus offsets ser relativos al inicio de datos.
+ * *out con malloc; el campo checksum queda a 0.
+ */
+int msa_encode_v2(const msa_header_t *h, const msa_file_entry_t *entries, uint32_t count,
+                  uint8_t **out, size_t *out_len);
+
+/**
+ * Construye el header de un paquete en el formato de h->version. Recibe
+ * offsets relativos a los datos y los deja absolutos; fija header_size y
+ * num_files. *out con malloc; el campo checksum queda a 0.
+ */
+int msa_build_header(msa_header_t *h, msa_file_entry_t *entries, uint32_t count,
+                     uint8_t **out, size_t *out_len);
+
+/**
+ * Lee el header y la file table de un paquete abierto y los valida.
+ * *entries se reserva con malloc. size recibe el tamaño del archivo.
+ * Retorna 0, o -1 con la descripción del error en err.
+ */
+int msa_read_table(int fd, msa_header_t *h, msa_file_entry_t **entries,
+                   uint64_t *size, char *err, size_t err_len);
+
+/* CRC32 de un rango de un archivo abierto */
+int msa_file_crc(int fd, uint64_t offset, uint64_t len, uint32_t *crc);
+
+/**
+ * Copia un rango entre dos archivos con copy_file_range (el kernel puede
+ * compartir extents en btrfs/XFS); si no se puede, con pread/pwrite.
+ */
+int msa_copy_range(int in_fd, uint64_t in_off, int out_fd, uint64_t out_off, uint64_t len);
+
+/**
+ * Escribe un paquete a partir de entradas de otros paquetes: entries[i]
+ * conserva el offset en su origen src_fds[i]. Los datos se colocan en el
+ * orden de entries, se copian sin pasar por espacio de usuario y el checksum
+ * se calcula combinando el CRC de cada entrada. De cada paquete de origen se
+ * comprueban cabecera y file table contra su checksum, y de cada entrada
+ * copiada, sus datos contra su CRC (errno EBADMSG si no coinciden); el resto
+ * de datos del origen no se lee. El formato lo indica h->version; al
+ * volver, entries queda como la file table escrita.
+ * Retorna el tamaño del paquete escrito, o -1 en error.
+ */
+int64_t msa_assemble(int out_fd, msa_header_t *h, msa_file_entry_t *entries,
+                     const int *src_fds, uint32_t count);
+
+#endif /* MSA_H */
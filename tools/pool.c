@@ -0,0 +1,306 @@
+/**
+ * @file pool.c
+ * @brief Pool de hilos con robo de tareas para las herramientas de host
+ *
+ * Cada cola es un anillo protegido por su propio mutex: el dueño encola y
+ * saca por el final, los ladrones sacan por el principio. Las tareas de las
+ * herramientas son gruesas (un paquete, un tramo de bloques, un chunk), así
+ * que el mutex no se nota frente a una cola sin bloqueos. Los hilos sin
+ * trabajo duermen en una condición del pool; queued cuenta las tareas en
+ * colas y pending las que aún no han terminado.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "pool.h"
+
+typedef struct {
+    pool_fn_t fn;
+    void *arg;
+} pool_task_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pool_task_t *tasks;                     /* Anillo de cap tareas */
+    size_t cap;
+    size_t head;                            /* Principio: aquí roban los demás */
+    size_t count;
+    pool_stats_t stats;                     /* Solo los escribe este hilo */
+    pthread_t thread;
+    struct pool *pool;
+    int index;
+} pool_worker_t;
+
+struct pool {
+    int width;
+    pool_worker_t *workers;                 /* El 0 es el hilo de pool_wait */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    long queued;                            /* Tareas en colas (bajo lock) */
+    long pending;                           /* Encoladas y sin terminar */
+    int stop;
+    unsigned next;                          /* Reparto de las tareas de fuera */
+};
+
+static long default_width = 0;
+static pool_t *process_pool = NULL;
+static pthread_once_t process_once = PTHREAD_ONCE_INIT;
+static __thread pool_worker_t *current = NULL;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int env_flag(const char *name) {
+    const char *v = getenv(name);
+    return v && *v && strcmp(v, "0") != 0;
+}
+
+/* ==================== Colas ==================== */
+
+static int push(pool_worker_t *w, pool_task_t t) {
+    pthread_mutex_lock(&w->lock);
+    if (w->count == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 64;
+        pool_task_t *tasks = malloc(cap * sizeof(*tasks));
+        if (!tasks) {
+            pthread_mutex_unlock(&w->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < w->count; i++)
+            tasks[i] = w->tasks[(w->head + i) % w->cap];
+        free(w->tasks);
+        w->tasks = tasks;
+        w->cap = cap;
+        w->head = 0;
+    }
+    w->tasks[(w->head + w->count) % w->cap] = t;
+    w->count++;
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+/* Saca del final (el dueño) o del principio (un ladrón) */
+static int pop(pool_worker_t *w, pool_task_t *t, int steal) {
+    if (__atomic_load_n(&w->count, __ATOMIC_RELAXED) == 0)
+        return 0;
+    pthread_mutex_lock(&w->lock);
+    int found = w->count > 0;
+    if (found) {
+        if (steal) {
+            *t = w->tasks[w->head];
+            w->head = (w->head + 1) % w->cap;
+        } else {
+            *t = w->tasks[(w->head + w->count - 1) % w->cap];
+        }
+        w->count--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+/* Siguiente tarea para w: la suya o una robada, empezando por su vecino */
+static int take(pool_worker_t *w, pool_task_t *t) {
+    pool_t *p = w->pool;
+    if (pop(w, t, 0))
+        goto found;
+    for (int i = 1; i < p->width; i++) {
+        if (pop(&p->workers[(w->index + i) % p->width], t, 1)) {
+            w->stats.steals++;
+            goto found;
+        }
+    }
+    return 0;
+found:
+    pthread_mutex_lock(&p->lock);
+    p->queued--;
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+static void run(pool_worker_t *w, pool_task_t t) {
+    pool_t *p = w->pool;
+    double start = now();
+    t.fn(t.arg, w->index);
+    double elapsed = now() - start;
+
+    w->stats.tasks++;
+    w->stats.busy += elapsed;
+    if (elapsed > w->stats.max_task)
+        w->stats.max_task = elapsed;
+    if (__atomic_sub_fetch(&p->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/* ==================== Hilos ==================== */
+
+static void *worker_main(void *arg) {
+    pool_worker_t *w = arg;
+    pool_t *p = w->pool;
+    pool_task_t t;
+
+    current = w;
+    for (;;) {
+        if (take(w, &t)) {
+            run(w, t);
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && p->queued <= 0)
+            pthread_cond_wait(&p->cond, &p->lock);
+        int stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+        if (stop)
+            break;
+    }
+    return NULL;
+}
+
+/* Fija el hilo a la n-ésima CPU de las que tiene permitidas el proceso */
+static void set_affinity(pthread_t thread, int n) {
+    cpu_set_t allowed, one;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return;
+    n %= CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && n-- == 0) {
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(thread, sizeof(one), &one);
+            return;
+        }
+    }
+}
+
+static void print_stats(void) {
+    pool_t *p = process_pool;
+    if (!p)
+        return;
+    fprintf(stderr, "pool: %d threads\n", p->width);
+    for (int i = 0; i < p->width; i++) {
+        pool_stats_t s;
+        pool_stats(p, i, &s);
+        fprintf(stderr, "  worker %2d: %8llu tasks, %6llu stolen, %9.3f s busy, %.3f s max\n", i,
+                (unsigned long long)s.tasks, (unsigned long long)s.steals, s.busy, s.max_task);
+    }
+}
+
+static void create_process_pool(void) {
+    long width = default_width;
+    const char *env = getenv("MESA_JOBS");
+    if (width <= 0 && env)
+        width = strtol(env, NULL, 10);
+    if (width <= 0)
+        width = sysconf(_SC_NPROCESSORS_ONLN);
+    if (width <= 0)
+        width = 1;
+    if (width > 256)
+        width = 256;
+
+    pool_t *p = calloc(1, sizeof(*p));
+    if (!p)
+        return;
+    p->workers = calloc(width, sizeof(*p->workers));
+    if (!p->workers) {
+        free(p);
+        return;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    for (long i = 0; i < width; i++) {
+        pthread_mutex_init(&p->workers[i].lock, NULL);
+        p->workers[i].pool = p;
+        p->workers[i].index = i;
+    }
+
+    /* El worker 0 es quien llama a pool_wait; si no arranca un hilo, el pool se estrecha */
+    int affinity = env_flag("MESA_AFFINITY");
+    p->width = 1;
+    for (long i = 1; i < width; i++) {
+        if (pthread_create(&p->workers[i].thread, NULL, worker_main, &p->workers[i]) != 0)
+            break;
+        if (affinity)
+            set_affinity(p->workers[i].thread, i);
+        p->width++;
+    }
+    if (affinity)
+        set_affinity(pthread_self(), 0);
+
+    /* Los hilos viven lo que el proceso: no se paran al salir */
+    process_pool = p;
+    if (env_flag("MESA_POOL_STATS"))
+        atexit(print_stats);
+}
+
+/* ==================== API ==================== */
+
+void pool_set_width(long threads) {
+    default_width = threads;
+}
+
+pool_t *pool_get(void) {
+    pthread_once(&process_once, create_process_pool);
+    return process_pool;
+}
+
+int pool_width(const pool_t *pool) {
+    return pool->width;
+}
+
+int pool_submit(pool_t *pool, pool_fn_t fn, void *arg) {
+    pool_task_t t = { fn, arg };
+    pool_worker_t *w = current && current->pool == pool
+        ? current
+        : &pool->workers[__atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED) % pool->width];
+
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+    if (push(w, t) != 0) {
+        __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+        return -1;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void pool_wait(pool_t *pool) {
+    pool_worker_t *w = &pool->workers[0];
+    pool_worker_t *saved = current;
+    pool_task_t t;
+
+    current = w;
+    for (;;) {
+        if (take(w, &t)) {
+            run(w, t);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0 && pool->queued <= 0)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        int done = __atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (done)
+            break;
+    }
+    current = saved;
+}
+
+void pool_stats(const pool_t *pool, int worker, pool_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (worker >= 0 && worker < pool->width)
+        *stats = pool->workers[worker].stats;
+}
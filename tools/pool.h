@@ -0,0 +1,61 @@
+/**
+ * @file pool.h
+ * @brief Pool de hilos con robo de tareas compartido por las herramientas de host
+ *
+ * Cada hilo tiene su cola de tareas: saca de su final las que encola él
+ * mismo (LIFO, con la caché caliente) y, cuando se queda sin trabajo, roba
+ * del principio de la de otro. Hay un solo pool por proceso (pool_get), así
+ * que las fases paralelas de una herramienta se reparten los mismos hilos
+ * en vez de crear cada una los suyos. Se compila junto a cada herramienta:
+ *   gcc -o msa-verify msa-verify.c msa.c mesafs.c pool.c -lpthread
+ *
+ * Ancho: pool_set_width (la opción -j de cada herramienta) o la variable
+ * MESA_JOBS; por defecto, las CPUs disponibles. MESA_AFFINITY=1 fija cada
+ * hilo a una CPU y MESA_POOL_STATS=1 imprime al salir los contadores de
+ * cada hilo (tareas, robos y tiempo ocupado).
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+/* Tarea: worker es el índice del hilo que la ejecuta (0 .. pool_width - 1) */
+typedef void (*pool_fn_t)(void *arg, int worker);
+
+typedef struct pool pool_t;
+
+/* Contadores de un hilo */
+typedef struct {
+    uint64_t tasks;                         /* Tareas ejecutadas */
+    uint64_t steals;                        /* De ellas, robadas a otro hilo */
+    double   busy;                          /* Segundos ejecutando tareas */
+    double   max_task;                      /* La tarea más larga */
+} pool_stats_t;
+
+/* Fija el ancho del pool del proceso antes de usarlo (<= 0: por defecto) */
+void pool_set_width(long threads);
+
+/* Pool del proceso; se crea en la primera llamada. NULL si no se puede */
+pool_t *pool_get(void);
+
+/* Hilos del pool, contando el que espera en pool_wait */
+int pool_width(const pool_t *pool);
+
+/**
+ * Encola una tarea. Desde una tarea va a la cola del propio hilo; desde
+ * fuera, se reparten entre las colas. Retorna 0, o -1 sin memoria.
+ */
+int pool_submit(pool_t *pool, pool_fn_t fn, void *arg);
+
+/**
+ * Espera a que terminen todas las tareas encoladas, ejecutando tareas
+ * mientras tanto (el hilo que llama es el worker 0). No se puede llamar
+ * desde una tarea.
+ */
+void pool_wait(pool_t *pool);
+
+/* Contadores del hilo worker */
+void pool_stats(const pool_t *pool, int worker, pool_stats_t *stats);
+
+#endif /* POOL_H */